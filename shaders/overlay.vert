@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Rectangle across the middle of the output, halfway into the scene. GL's depth decides where it is hidden.
+const vec2 c_corners[6] = vec2[](vec2(-0.5, -0.25), vec2(-0.5, 0.25), vec2(0.5, -0.25), vec2(0.5, -0.25), vec2(-0.5, 0.25), vec2(0.5, 0.25));
+const float c_depth = 0.5;
+
+void main()
+{
+    gl_Position = vec4(c_corners[gl_VertexIndex], c_depth, 1.0);
+}
@@ -6,9 +6,17 @@ layout(location = 1) in vec2 inUv;
 
 layout(binding = 1) uniform sampler2D sharedImage;
 
+layout(push_constant) uniform PushConstants
+{
+    // Part of the shared image GL rendered, the maximum keeps bilinear taps inside it
+    vec2 uvScale;
+    vec2 uvMax;
+}
+pc;
+
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-    outColor = vec4(inColor.r, inColor.g, inColor.b, 1.0) * 0.2 + texture(sharedImage, inUv) * 0.8;
+    outColor = vec4(inColor.r, inColor.g, inColor.b, 1.0) * 0.2 + texture(sharedImage, min(inUv * pc.uvScale, pc.uvMax)) * 0.8;
 }
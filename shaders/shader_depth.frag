@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec2 inUv;
+
+layout(binding = 1) uniform sampler2D sharedImage;
+// Rendered by GL together with the shared image, at the same coordinates
+layout(binding = 2) uniform sampler2D sharedDepth;
+
+layout(push_constant) uniform PushConstants
+{
+    // Part of the shared image GL rendered, the maximum keeps bilinear taps inside it
+    vec2 uvScale;
+    vec2 uvMax;
+}
+pc;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    const vec2 uv = min(inUv * pc.uvScale, pc.uvMax);
+    outColor = vec4(inColor.r, inColor.g, inColor.b, 1.0) * 0.2 + texture(sharedImage, uv) * 0.8;
+    // The composition takes over GL's depth, later Vulkan draws are tested against it
+    gl_FragDepth = texture(sharedDepth, uv).r;
+}
@@ -0,0 +1,134 @@
+#include "CommandRecorder.hpp"
+#include "VulkanUtils.hpp"
+#include "Utils.hpp"
+
+CommandRecorder::CommandRecorder(Context& context, uint32_t threadCount) :
+    m_device(context.getDevice()),
+    m_workers(threadCount)
+{
+    CHECK(threadCount > 0);
+
+    // Command pools are externally synchronized, each one is only used by the thread that owns it
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = context.getGraphicsQueueFamily();
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    for (Worker& worker : m_workers)
+    {
+        worker.pools.resize(context.getFrameCount());
+        worker.buffers.resize(context.getFrameCount());
+        worker.usedBuffers.resize(context.getFrameCount(), 0);
+        for (VkCommandPool& pool : worker.pools)
+        {
+            VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &pool));
+        }
+    }
+
+    printf("Recording: %u worker threads\n", threadCount);
+    for (Worker& worker : m_workers)
+    {
+        worker.thread = std::thread(&CommandRecorder::run, this, std::ref(worker));
+    }
+}
+
+CommandRecorder::~CommandRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobsQueued.notify_all();
+
+    for (Worker& worker : m_workers)
+    {
+        worker.thread.join();
+        // Destroying a pool frees its command buffers
+        for (VkCommandPool pool : worker.pools)
+        {
+            vkDestroyCommandPool(m_device, pool, nullptr);
+        }
+    }
+}
+
+uint32_t CommandRecorder::getThreadCount() const
+{
+    return ui32Size(m_workers);
+}
+
+std::vector<VkCommandBuffer> CommandRecorder::record(uint32_t frameIndex, const std::vector<Job>& jobs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobs = &jobs;
+    m_results.assign(jobs.size(), VK_NULL_HANDLE);
+    m_nextJob = 0;
+    m_remainingJobs = jobs.size();
+    m_frameIndex = frameIndex;
+    ++m_batch;
+    m_jobsQueued.notify_all();
+
+    m_jobsDone.wait(lock, [this] { return m_remainingJobs == 0; });
+    m_jobs = nullptr;
+    return m_results;
+}
+
+void CommandRecorder::run(Worker& worker)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_jobsQueued.wait(lock, [this] { return m_stop || (m_jobs && m_nextJob < m_jobs->size()); });
+        if (m_stop)
+        {
+            return;
+        }
+        const Job& job = (*m_jobs)[m_nextJob];
+        const size_t jobIndex = m_nextJob++;
+        const uint32_t frameIndex = m_frameIndex;
+        const uint64_t batch = m_batch;
+        lock.unlock();
+
+        // The frame that last used the slot has completed, all of its buffers are reset at once
+        if (worker.resetBatch != batch)
+        {
+            VK_CHECK(vkResetCommandPool(m_device, worker.pools[frameIndex], 0));
+            worker.usedBuffers[frameIndex] = 0;
+            worker.resetBatch = batch;
+        }
+
+        VkCommandBuffer cb = getCommandBuffer(worker, frameIndex);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &job.inheritance;
+        VK_CHECK(vkBeginCommandBuffer(cb, &beginInfo));
+        job.record(cb);
+        VK_CHECK(vkEndCommandBuffer(cb));
+
+        lock.lock();
+        m_results[jobIndex] = cb;
+        if (--m_remainingJobs == 0)
+        {
+            m_jobsDone.notify_one();
+        }
+    }
+}
+
+VkCommandBuffer CommandRecorder::getCommandBuffer(Worker& worker, uint32_t frameIndex)
+{
+    std::vector<VkCommandBuffer>& buffers = worker.buffers[frameIndex];
+    uint32_t& used = worker.usedBuffers[frameIndex];
+    if (used == buffers.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = worker.pools[frameIndex];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        buffers.push_back(VK_NULL_HANDLE);
+        VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &buffers.back()));
+    }
+    return buffers[used++];
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Context.hpp"
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Records secondary command buffers on a pool of worker threads. Every worker has a command pool per frame slot
+// that is reset as a whole the first time the worker records for the slot in a frame, instead of resetting
+// command buffers one by one.
+class CommandRecorder final
+{
+public:
+    struct Job
+    {
+        // Render pass, subpass and framebuffer the commands are executed in
+        VkCommandBufferInheritanceInfo inheritance;
+        std::function<void(VkCommandBuffer cb)> record;
+    };
+
+    CommandRecorder(Context& context, uint32_t threadCount);
+    ~CommandRecorder();
+
+    uint32_t getThreadCount() const;
+    // Returns the command buffers in the order of the jobs once all of them are recorded. The slot's previous
+    // submission has to be complete.
+    std::vector<VkCommandBuffer> record(uint32_t frameIndex, const std::vector<Job>& jobs);
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        std::vector<VkCommandPool> pools;
+        // Allocated from each pool, the first usedBuffers of them are recorded in the current frame
+        std::vector<std::vector<VkCommandBuffer>> buffers;
+        std::vector<uint32_t> usedBuffers;
+        uint64_t resetBatch = 0;
+    };
+
+    void run(Worker& worker);
+    VkCommandBuffer getCommandBuffer(Worker& worker, uint32_t frameIndex);
+
+    VkDevice m_device;
+    std::vector<Worker> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobsQueued;
+    std::condition_variable m_jobsDone;
+    // Guarded by m_mutex, each job's result is only written by the worker that took it
+    bool m_stop = false;
+    const std::vector<Job>* m_jobs = nullptr;
+    std::vector<VkCommandBuffer> m_results;
+    size_t m_nextJob = 0;
+    size_t m_remainingJobs = 0;
+    uint64_t m_batch = 0;
+    uint32_t m_frameIndex = 0;
+};
@@ -6,10 +6,50 @@
 
 #include <set>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
 
 namespace
 {
 const uint64_t c_timeout = 10'000'000'000;
+// Frames recorded while earlier ones are still executing, as many as a triple buffered swapchain allows
+const uint32_t c_frameCount = 3;
+// Enough to render a frame while one is queued and another is shown
+const uint32_t c_preferredImageCount = 3;
+
+// Modes in the order they are tried, FIFO is always supported
+std::vector<VkPresentModeKHR> getPresentModeCandidates(PresentMode mode)
+{
+    switch (mode)
+    {
+    case PresentMode::Mailbox:
+        return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    case PresentMode::Immediate:
+        return {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    case PresentMode::FifoRelaxed:
+        return {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    case PresentMode::Fifo:
+        break;
+    }
+    return {VK_PRESENT_MODE_FIFO_KHR};
+}
+
+const char* getPresentModeName(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo-relaxed";
+    default:
+        return "fifo";
+    }
+}
 
 VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT /*flags*/,
                                              VkDebugReportObjectTypeEXT /*objType*/,
@@ -25,15 +65,35 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT /*flags*/,
 }
 } // namespace
 
-Context::Context()
+Context::Context(const Settings& settings) :
+    m_headless(settings.headless),
+    m_windowSystem(!settings.headless || !settings.surfacelessGL),
+    m_outputs(settings.outputCount),
+    m_requestedPresentMode(settings.presentMode),
+    m_lowLatency(settings.lowLatency),
+    m_passthrough(settings.passthrough),
+    m_synchronization2(settings.synchronization2)
 {
     initGLFW();
     createInstance();
     createDebugCallback();
-    createWindow();
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        if (m_headless)
+        {
+            createHeadlessSurface(m_outputs[i]);
+        }
+        else
+        {
+            createWindow(m_outputs[i], i);
+        }
+    }
     enumeratePhysicalDevice();
     createDevice();
-    createSwapchain();
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        createSwapchain(m_outputs[i], i);
+    }
     createCommandPools();
     createSemaphores();
     createFences();
@@ -43,22 +103,43 @@ Context::~Context()
 {
     vkDeviceWaitIdle(m_device);
 
+    m_completedSerial = m_submitSerial + 1;
+    runDeferredDestroys();
+
     for (VkFence fence : m_inFlightFences)
     {
         vkDestroyFence(m_device, fence, nullptr);
     }
 
-    vkDestroySemaphore(m_device, m_renderFinished, nullptr);
-    vkDestroySemaphore(m_device, m_imageAvailable, nullptr);
+    for (VkSemaphore semaphore : m_renderFinished)
+    {
+        vkDestroySemaphore(m_device, semaphore, nullptr);
+    }
+    for (const Output& output : m_outputs)
+    {
+        for (VkSemaphore semaphore : output.imageAvailable)
+        {
+            vkDestroySemaphore(m_device, semaphore, nullptr);
+        }
+    }
     vkDestroyCommandPool(m_device, m_computeCommandPool, nullptr);
     vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);
 
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+    for (const Output& output : m_outputs)
+    {
+        vkDestroySwapchainKHR(m_device, output.swapchain, nullptr);
+    }
 
     vkDestroyDevice(m_device, nullptr);
 
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-    glfwDestroyWindow(m_window);
+    for (const Output& output : m_outputs)
+    {
+        vkDestroySurfaceKHR(m_instance, output.surface, nullptr);
+        if (output.window)
+        {
+            glfwDestroyWindow(output.window);
+        }
+    }
 
     auto destroyDebugReportCallback
         = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugReportCallbackEXT");
@@ -82,9 +163,34 @@ VkDevice Context::getDevice() const
     return m_device;
 }
 
-const std::vector<VkImage>& Context::getSwapchainImages() const
+uint32_t Context::getFrameCount() const
+{
+    return c_frameCount;
+}
+
+uint32_t Context::getOutputCount() const
+{
+    return ui32Size(m_outputs);
+}
+
+const std::vector<VkImage>& Context::getSwapchainImages(uint32_t output) const
 {
-    return m_swapchainImages;
+    return m_outputs[output].images;
+}
+
+VkExtent2D Context::getSwapchainExtent(uint32_t output) const
+{
+    return m_outputs[output].extent;
+}
+
+uint64_t Context::getSwapchainGeneration(uint32_t output) const
+{
+    return m_outputs[output].generation;
+}
+
+bool Context::isSwapchainTransferDst(uint32_t output) const
+{
+    return m_outputs[output].transferDst;
 }
 
 VkQueue Context::getGraphicsQueue() const
@@ -97,27 +203,99 @@ VkCommandPool Context::getGraphicsCommandPool() const
     return m_graphicsCommandPool;
 }
 
+uint32_t Context::getGraphicsQueueFamily() const
+{
+    return m_graphicsQueueFamily;
+}
+
+PFN_vkCmdPipelineBarrier2KHR Context::getPipelineBarrier2() const
+{
+    return m_pipelineBarrier2;
+}
+
+bool Context::isDeviceExtensionEnabled(const char* extension) const
+{
+    const auto matches = [extension](const char* enabled) { return strcmp(enabled, extension) == 0; };
+    return std::any_of(m_enabledDeviceExtensions.begin(), m_enabledDeviceExtensions.end(), matches);
+}
+
 bool Context::update()
 {
-    glfwPollEvents();
-    return !(glfwWindowShouldClose(m_window) || m_shouldQuit);
+    // Events still arrive for the GL window when headless
+    if (m_windowSystem)
+    {
+        glfwPollEvents();
+    }
+    const auto closed = [](const Output& output) { return output.window && glfwWindowShouldClose(output.window); };
+    return !(std::any_of(m_outputs.begin(), m_outputs.end(), closed) || m_shouldQuit);
 }
 
-uint32_t Context::acquireNextSwapchainImage()
+void Context::waitForEvents(double timeoutSeconds)
 {
-    VK_CHECK(vkAcquireNextImageKHR(m_device, m_swapchain, c_timeout, m_imageAvailable, VK_NULL_HANDLE, &m_imageIndex));
-    VK_CHECK(vkWaitForFences(m_device, 1, &m_inFlightFences[m_imageIndex], true, c_timeout));
-    VK_CHECK(vkResetFences(m_device, 1, &m_inFlightFences[m_imageIndex]));
-    return m_imageIndex;
+    if (!m_windowSystem)
+    {
+        // Nothing can wake the loop early, new frames from a source wait for the timeout
+        std::this_thread::sleep_for(std::chrono::duration<double>(timeoutSeconds));
+        return;
+    }
+    glfwWaitEventsTimeout(timeoutSeconds);
+}
+
+bool Context::isSwapchainOutOfDate() const
+{
+    return std::any_of(m_outputs.begin(), m_outputs.end(), [](const Output& output) { return output.outOfDate; });
+}
+
+uint32_t Context::acquireNextFrame()
+{
+    // The slot's semaphores and the per frame resources of its previous frame are only reused once it completed
+    m_frameIndex = (m_frameIndex + 1) % c_frameCount;
+    VK_CHECK(vkWaitForFences(m_device, 1, &m_inFlightFences[m_frameIndex], true, c_timeout));
+    m_completedSerial = std::max(m_completedSerial, m_fenceSerials[m_frameIndex]);
+    runDeferredDestroys();
+
+    waitForQueuedPresents();
+
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        Output& output = m_outputs[i];
+        while (true)
+        {
+            if (output.outOfDate)
+            {
+                recreateSwapchain(output, i);
+            }
+
+            const VkResult result = vkAcquireNextImageKHR(m_device, output.swapchain, c_timeout, output.imageAvailable[m_frameIndex], VK_NULL_HANDLE, &output.imageIndex);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                output.outOfDate = true;
+                continue;
+            }
+            CHECK(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+            // A suboptimal image can still be presented, the swapchain is recreated for the next frame
+            output.outOfDate = output.outOfDate || result == VK_SUBOPTIMAL_KHR;
+            break;
+        }
+    }
+    return m_frameIndex;
+}
+
+uint32_t Context::getSwapchainImageIndex(uint32_t output) const
+{
+    return m_outputs[output].imageIndex;
 }
 
 void Context::submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBuffers, WaitAndSignalInfo waitAndSignalInfo)
 {
     CHECK(waitAndSignalInfo.waitSemaphores.size() == waitAndSignalInfo.waitStages.size());
 
-    waitAndSignalInfo.waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-    waitAndSignalInfo.waitSemaphores.push_back(m_imageAvailable);
-    waitAndSignalInfo.signalSemaphores.push_back(m_renderFinished);
+    for (const Output& output : m_outputs)
+    {
+        waitAndSignalInfo.waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        waitAndSignalInfo.waitSemaphores.push_back(output.imageAvailable[m_frameIndex]);
+    }
+    waitAndSignalInfo.signalSemaphores.push_back(m_renderFinished[m_frameIndex]);
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -129,22 +307,154 @@ void Context::submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBu
     submitInfo.signalSemaphoreCount = ui32Size(waitAndSignalInfo.signalSemaphores);
     submitInfo.pSignalSemaphores = waitAndSignalInfo.signalSemaphores.data();
 
-    VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_imageIndex]));
+    VK_CHECK(vkResetFences(m_device, 1, &m_inFlightFences[m_frameIndex]));
+    VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_frameIndex]));
+    m_fenceSerials[m_frameIndex] = ++m_submitSerial;
+
+    // All outputs are presented together, they wait for the same rendering
+    const size_t outputCount = m_outputs.size();
+    std::vector<VkSwapchainKHR> swapchains;
+    std::vector<uint32_t> imageIndices;
+    std::vector<std::vector<VkRectLayerKHR>> rectangles(outputCount);
+    std::vector<VkPresentRegionKHR> regions(outputCount);
+    bool hasRegions = false;
+    for (size_t i = 0; i < outputCount; ++i)
+    {
+        Output& output = m_outputs[i];
+        swapchains.push_back(output.swapchain);
+        imageIndices.push_back(output.imageIndex);
+        for (const VkRect2D& region : output.presentRegions)
+        {
+            rectangles[i].push_back(VkRectLayerKHR{region.offset, region.extent, 0});
+        }
+        // No rectangles means the whole image changed
+        regions[i].rectangleCount = ui32Size(rectangles[i]);
+        regions[i].pRectangles = rectangles[i].data();
+        hasRegions = hasRegions || !rectangles[i].empty();
+        output.presentRegions.clear();
+    }
+    std::vector<VkResult> results(outputCount, VK_SUCCESS);
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &m_renderFinished;
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &m_swapchain;
-    presentInfo.pImageIndices = &m_imageIndex;
-    presentInfo.pResults = nullptr; // Optional
+    presentInfo.pWaitSemaphores = &m_renderFinished[m_frameIndex];
+    presentInfo.swapchainCount = ui32Size(swapchains);
+    presentInfo.pSwapchains = swapchains.data();
+    presentInfo.pImageIndices = imageIndices.data();
+    presentInfo.pResults = results.data();
+
+    const uint64_t presentId = m_presentId + 1;
+    const std::vector<uint64_t> presentIds(outputCount, presentId);
+    VkPresentIdKHR presentIdInfo{};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = ui32Size(presentIds);
+    presentIdInfo.pPresentIds = presentIds.data();
+
+    VkPresentRegionsKHR presentRegions{};
+    presentRegions.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+    presentRegions.swapchainCount = ui32Size(regions);
+    presentRegions.pRegions = regions.data();
+    if (hasRegions && isDeviceExtensionEnabled(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME))
+    {
+        presentInfo.pNext = &presentRegions;
+    }
+    if (m_lowLatency)
+    {
+        presentIdInfo.pNext = presentInfo.pNext;
+        presentInfo.pNext = &presentIdInfo;
+    }
+
+    vkQueuePresentKHR(m_presentQueue, &presentInfo);
 
-    VK_CHECK(vkQueuePresentKHR(m_presentQueue, &presentInfo));
+    // Every swapchain reports its own result, one output going out of date doesn't keep the others from presenting
+    bool presented = false;
+    for (size_t i = 0; i < outputCount; ++i)
+    {
+        if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR)
+        {
+            m_outputs[i].outOfDate = true;
+        }
+        else
+        {
+            VK_CHECK(results[i]);
+        }
+        // An out of date swapchain didn't present, the id is never reached on it
+        presented = presented || results[i] != VK_ERROR_OUT_OF_DATE_KHR;
+    }
+    if (presented)
+    {
+        m_presentId = presentId;
+        recordPresentInterval();
+    }
+}
+
+void Context::setPresentRegions(uint32_t output, std::vector<VkRect2D> regions)
+{
+    m_outputs[output].presentRegions = std::move(regions);
+}
+
+void Context::waitForSubmittedFrame()
+{
+    VK_CHECK(vkWaitForFences(m_device, 1, &m_inFlightFences[m_frameIndex], true, c_timeout));
+}
+
+void Context::printStatistics()
+{
+    if (m_presentIntervals == 0)
+    {
+        return;
+    }
+
+    const double average = m_presentIntervalSum / double(m_presentIntervals);
+    const double variance = m_presentIntervalSquareSum / double(m_presentIntervals) - average * average;
+    printf("Present %s%s: %.2f ms average interval, %.2f ms jitter, %.2f ms longest\n",
+           getPresentModeName(m_presentMode),
+           m_lowLatency ? " low latency" : "",
+           average,
+           std::sqrt(std::max(variance, 0.0)),
+           m_longestPresentInterval);
+
+    m_presentIntervals = 0;
+    m_presentIntervalSum = 0.0;
+    m_presentIntervalSquareSum = 0.0;
+    m_longestPresentInterval = 0.0;
+}
+
+void Context::deferDestroy(std::function<void()> destroy)
+{
+    m_deferredDestroys.push_back(DeferredDestroy{m_submitSerial + 1, std::move(destroy)});
+}
+
+void Context::addKeyHandler(KeyHandler handler)
+{
+    m_keyHandlers.push_back(std::move(handler));
+}
+
+void Context::runDeferredDestroys()
+{
+    std::vector<DeferredDestroy> pending;
+    for (DeferredDestroy& deferred : m_deferredDestroys)
+    {
+        if (deferred.serial <= m_completedSerial)
+        {
+            deferred.destroy();
+        }
+        else
+        {
+            pending.push_back(std::move(deferred));
+        }
+    }
+    m_deferredDestroys.swap(pending);
 }
 
 void Context::initGLFW()
 {
+    // Only the GL context comes from GLFW, the Vulkan loader is used directly
+    if (m_headless)
+    {
+        return;
+    }
     const int vulkanSupported = glfwVulkanSupported();
     CHECK(vulkanSupported == GLFW_TRUE);
 }
@@ -159,7 +469,7 @@ void Context::createInstance()
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.apiVersion = VK_API_VERSION_1_0;
 
-    const std::vector<const char*> extensions = getRequiredInstanceExtensions();
+    const std::vector<const char*> extensions = getRequiredInstanceExtensions(m_headless);
 
     VkInstanceCreateInfo instanceCreateInfo{};
     instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -188,23 +498,55 @@ void Context::createDebugCallback()
     createDebugReportCallback(m_instance, &cbCreateInfo, nullptr, &m_callback);
 }
 
-void Context::createWindow()
+void Context::createWindow(Output& output, uint32_t index)
 {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    m_window = glfwCreateWindow(c_windowWidth, c_windowHeight, "Vulkan", nullptr, nullptr);
-    CHECK(m_window);
-    glfwSetWindowPos(m_window, 1200, 200);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    const std::string title = index == 0 ? "Vulkan" : "Vulkan " + std::to_string(index + 1);
+    output.window = glfwCreateWindow(c_windowWidth, c_windowHeight, title.c_str(), nullptr, nullptr);
+    CHECK(output.window);
+    // Further outputs are stacked with an offset so that all of them stay visible
+    glfwSetWindowPos(output.window, 1200 + 40 * int(index), 200 + 40 * int(index));
 
     auto keyCallback = [](GLFWwindow* window, int key, int scancode, int action, int mods) {
         static_cast<Context*>(glfwGetWindowUserPointer(window))->handleKey(window, key, scancode, action, mods);
     };
+    auto resizeCallback = [](GLFWwindow* window, int /*width*/, int /*height*/) {
+        static_cast<Context*>(glfwGetWindowUserPointer(window))->handleResize(window);
+    };
+
+    glfwSetInputMode(output.window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetWindowUserPointer(output.window, this);
+    glfwSetKeyCallback(output.window, keyCallback);
+    glfwSetFramebufferSizeCallback(output.window, resizeCallback);
 
-    glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetWindowUserPointer(m_window, this);
-    glfwSetKeyCallback(m_window, keyCallback);
+    VK_CHECK(glfwCreateWindowSurface(m_instance, output.window, nullptr, &output.surface));
+}
 
-    VK_CHECK(glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface));
+void Context::createHeadlessSurface(Output& output)
+{
+    auto createHeadlessSurfaceAddr = vkGetInstanceProcAddr(m_instance, "vkCreateHeadlessSurfaceEXT");
+    auto createHeadlessSurface = PFN_vkCreateHeadlessSurfaceEXT(createHeadlessSurfaceAddr);
+    CHECK(createHeadlessSurface);
+
+    VkHeadlessSurfaceCreateInfoEXT createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    VK_CHECK(createHeadlessSurface(m_instance, &createInfo, nullptr, &output.surface));
+    printf("Presenting to a headless surface\n");
+}
+
+VkExtent2D Context::getFramebufferSize(const Output& output) const
+{
+    // A headless surface has no size of its own, it gets the default window size
+    if (m_headless)
+    {
+        return {uint32_t(c_windowWidth), uint32_t(c_windowHeight)};
+    }
+
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(output.window, &width, &height);
+    return {uint32_t(width), uint32_t(height)};
 }
 
 void Context::handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
@@ -213,6 +555,21 @@ void Context::handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int a
     {
         m_shouldQuit = true;
     }
+    if (action == GLFW_PRESS || action == GLFW_REPEAT)
+    {
+        for (const KeyHandler& handler : m_keyHandlers)
+        {
+            handler(key);
+        }
+    }
+}
+
+void Context::handleResize(GLFWwindow* window)
+{
+    for (Output& output : m_outputs)
+    {
+        output.outOfDate = output.outOfDate || output.window == window;
+    }
 }
 
 void Context::enumeratePhysicalDevice()
@@ -227,7 +584,9 @@ void Context::enumeratePhysicalDevice()
     m_physicalDevice = VK_NULL_HANDLE;
     for (VkPhysicalDevice device : devices)
     {
-        if (isDeviceSuitable(device, m_surface))
+        // Every output is presented from the same queue
+        const auto suitable = [device](const Output& output) { return isDeviceSuitable(device, output.surface); };
+        if (std::all_of(m_outputs.begin(), m_outputs.end(), suitable))
         {
             m_physicalDevice = device;
             break;
@@ -241,7 +600,7 @@ void Context::enumeratePhysicalDevice()
 
 void Context::createDevice()
 {
-    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_surface);
+    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_outputs[0].surface);
 
     const std::set<int> uniqueQueueFamilies = //
         {
@@ -262,15 +621,111 @@ void Context::createDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    m_enabledDeviceExtensions = c_deviceExtensions;
+    const std::vector<const char*> interopExtensions = getAvailableDeviceExtensions(m_physicalDevice, c_interopDeviceExtensions);
+    m_enabledDeviceExtensions.insert(m_enabledDeviceExtensions.end(), interopExtensions.begin(), interopExtensions.end());
+    const std::vector<const char*> presentExtensions = getAvailableDeviceExtensions(m_physicalDevice, c_presentDeviceExtensions);
+    m_enabledDeviceExtensions.insert(m_enabledDeviceExtensions.end(), presentExtensions.begin(), presentExtensions.end());
+
+    auto vkGetPhysicalDeviceFeatures2KHRAddr = vkGetInstanceProcAddr(m_instance, "vkGetPhysicalDeviceFeatures2KHR");
+    auto vkGetPhysicalDeviceFeatures2KHR = PFN_vkGetPhysicalDeviceFeatures2KHR(vkGetPhysicalDeviceFeatures2KHRAddr);
+
+    VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcrFeatures{};
+    ycbcrFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES;
+    const std::vector<const char*> ycbcrExtensions = getAvailableDeviceExtensions(m_physicalDevice, c_ycbcrDeviceExtensions);
+    if (ycbcrExtensions.size() == c_ycbcrDeviceExtensions.size())
+    {
+        CHECK(vkGetPhysicalDeviceFeatures2KHR);
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &ycbcrFeatures;
+        vkGetPhysicalDeviceFeatures2KHR(m_physicalDevice, &features);
+        if (ycbcrFeatures.samplerYcbcrConversion)
+        {
+            m_enabledDeviceExtensions.insert(m_enabledDeviceExtensions.end(), ycbcrExtensions.begin(), ycbcrExtensions.end());
+        }
+    }
+
+    // Low latency pacing waits for the previous present to be shown before the next frame is started
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    const std::vector<const char*> presentWaitExtensions = getAvailableDeviceExtensions(m_physicalDevice, c_presentWaitDeviceExtensions);
+    if (m_lowLatency)
+    {
+        if (presentWaitExtensions.size() == c_presentWaitDeviceExtensions.size() && vkGetPhysicalDeviceFeatures2KHR)
+        {
+            presentIdFeatures.pNext = &presentWaitFeatures;
+
+            VkPhysicalDeviceFeatures2 features{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &presentIdFeatures;
+            vkGetPhysicalDeviceFeatures2KHR(m_physicalDevice, &features);
+        }
+        m_lowLatency = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+        if (m_lowLatency)
+        {
+            m_enabledDeviceExtensions.insert(m_enabledDeviceExtensions.end(), presentWaitExtensions.begin(), presentWaitExtensions.end());
+        }
+        else
+        {
+            printf("Low latency pacing needs present id and present wait support, using regular pacing\n");
+        }
+    }
+
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    const std::vector<const char*> synchronization2Extensions = getAvailableDeviceExtensions(m_physicalDevice, c_synchronization2DeviceExtensions);
+    if (m_synchronization2)
+    {
+        if (synchronization2Extensions.size() == c_synchronization2DeviceExtensions.size() && vkGetPhysicalDeviceFeatures2KHR)
+        {
+            VkPhysicalDeviceFeatures2 features{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &synchronization2Features;
+            vkGetPhysicalDeviceFeatures2KHR(m_physicalDevice, &features);
+        }
+        m_synchronization2 = synchronization2Features.synchronization2;
+        if (m_synchronization2)
+        {
+            m_enabledDeviceExtensions.insert(m_enabledDeviceExtensions.end(), synchronization2Extensions.begin(), synchronization2Extensions.end());
+        }
+        else
+        {
+            printf("VK_KHR_synchronization2 isn't supported, recording barriers with vkCmdPipelineBarrier\n");
+        }
+    }
+
+    // Only the supported features are chained
+    void* features = nullptr;
+    if (m_lowLatency)
+    {
+        presentWaitFeatures.pNext = features;
+        features = &presentIdFeatures;
+    }
+    if (m_synchronization2)
+    {
+        synchronization2Features.pNext = features;
+        features = &synchronization2Features;
+    }
+    if (ycbcrFeatures.samplerYcbcrConversion)
+    {
+        ycbcrFeatures.pNext = features;
+        features = &ycbcrFeatures;
+    }
+
     VkPhysicalDeviceFeatures deviceFeatures{};
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = features;
     createInfo.queueCreateInfoCount = ui32Size(queueCreateInfos);
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = ui32Size(c_deviceExtensions);
-    createInfo.ppEnabledExtensionNames = c_deviceExtensions.data();
+    createInfo.enabledExtensionCount = ui32Size(m_enabledDeviceExtensions);
+    createInfo.ppEnabledExtensionNames = m_enabledDeviceExtensions.data();
     createInfo.enabledLayerCount = ui32Size(c_validationLayers);
     createInfo.ppEnabledLayerNames = c_validationLayers.data();
 
@@ -279,11 +734,22 @@ void Context::createDevice()
     vkGetDeviceQueue(m_device, indices.graphicsFamily, 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, indices.computeFamily, 0, &m_computeQueue);
     vkGetDeviceQueue(m_device, indices.presentFamily, 0, &m_presentQueue);
+
+    if (m_lowLatency)
+    {
+        m_waitForPresent = PFN_vkWaitForPresentKHR(vkGetDeviceProcAddr(m_device, "vkWaitForPresentKHR"));
+        CHECK(m_waitForPresent);
+    }
+    if (m_synchronization2)
+    {
+        m_pipelineBarrier2 = PFN_vkCmdPipelineBarrier2KHR(vkGetDeviceProcAddr(m_device, "vkCmdPipelineBarrier2KHR"));
+        CHECK(m_pipelineBarrier2);
+    }
 }
 
-void Context::createSwapchain()
+void Context::createSwapchain(Output& output, uint32_t index)
 {
-    const SwapchainCapabilities capabilities = getSwapchainCapabilities(m_physicalDevice, m_surface);
+    const SwapchainCapabilities capabilities = getSwapchainCapabilities(m_physicalDevice, output.surface);
 
     bool formatAvailable = true;
     for (const VkSurfaceFormatKHR& format : capabilities.formats)
@@ -292,54 +758,155 @@ void Context::createSwapchain()
     }
     CHECK(formatAvailable);
 
-    const VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-    const auto foundPresentMode = std::find(std::begin(capabilities.presentModes), std::end(capabilities.presentModes), presentMode);
-    CHECK(foundPresentMode != std::end(capabilities.presentModes));
+    const VkPresentModeKHR presentMode = choosePresentMode(capabilities.presentModes, output.swapchain == VK_NULL_HANDLE);
 
-    const VkExtent2D extent{c_windowWidth, c_windowHeight};
-    CHECK(extent.width <= capabilities.surfaceCapabilities.maxImageExtent.width);
-    CHECK(extent.width >= capabilities.surfaceCapabilities.minImageExtent.width);
-    CHECK(extent.height <= capabilities.surfaceCapabilities.maxImageExtent.height);
-    CHECK(extent.height >= capabilities.surfaceCapabilities.minImageExtent.height);
+    // The surface either dictates the extent or lets the window's framebuffer size decide
+    const VkSurfaceCapabilitiesKHR& surfaceCapabilities = capabilities.surfaceCapabilities;
+    VkExtent2D extent = surfaceCapabilities.currentExtent;
+    if (extent.width == UINT32_MAX)
+    {
+        const VkExtent2D size = getFramebufferSize(output);
+        extent.width = std::clamp(size.width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+        extent.height = std::clamp(size.height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+    }
 
-    const uint32_t imageCount = 3;
-    CHECK(imageCount > capabilities.surfaceCapabilities.minImageCount);
-    CHECK(imageCount < capabilities.surfaceCapabilities.maxImageCount);
+    // A max of zero means there is no limit
+    uint32_t imageCount = std::max(c_preferredImageCount, surfaceCapabilities.minImageCount + 1);
+    if (surfaceCapabilities.maxImageCount > 0)
+    {
+        imageCount = std::min(imageCount, surfaceCapabilities.maxImageCount);
+    }
 
-    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_surface);
+    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, output.surface);
     uint32_t queueFamilyIndices[] = {(uint32_t)indices.graphicsFamily, (uint32_t)indices.presentFamily};
     CHECK(indices.graphicsFamily == indices.presentFamily);
 
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    createInfo.surface = m_surface;
+    createInfo.surface = output.surface;
     createInfo.minImageCount = imageCount;
     createInfo.imageFormat = c_surfaceFormat.format;
     createInfo.imageColorSpace = c_surfaceFormat.colorSpace;
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Passthrough copies the shared image into the swapchain image instead of drawing it
+    output.transferDst = m_passthrough && (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (output.transferDst ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
     createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     createInfo.queueFamilyIndexCount = 0;
     createInfo.pQueueFamilyIndices = nullptr;
     createInfo.preTransform = capabilities.surfaceCapabilities.currentTransform;
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
-    createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // Partial redraws build on the previous content of an image, including the parts that were hidden
+    createInfo.clipped = VK_FALSE;
+    createInfo.oldSwapchain = output.swapchain;
 
-    VK_CHECK(vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapchain));
+    VK_CHECK(vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &output.swapchain));
+
+    // The retired swapchain can still have images queued for presentation
+    if (createInfo.oldSwapchain != VK_NULL_HANDLE)
+    {
+        VkDevice device = m_device;
+        VkSwapchainKHR oldSwapchain = createInfo.oldSwapchain;
+        deferDestroy([device, oldSwapchain]() { vkDestroySwapchainKHR(device, oldSwapchain, nullptr); });
+    }
+    output.extent = extent;
+    ++output.generation;
+    // Present ids restart on the new swapchain, earlier ones are never waited for on it
+    output.firstPresentId = m_presentId + 1;
 
+    // The implementation may create more images than requested, the count may also change on recreation
     uint32_t queriedImageCount;
-    vkGetSwapchainImagesKHR(m_device, m_swapchain, &queriedImageCount, nullptr);
-    CHECK(queriedImageCount == imageCount);
-    m_swapchainImages.resize(imageCount);
-    vkGetSwapchainImagesKHR(m_device, m_swapchain, &queriedImageCount, m_swapchainImages.data());
+    vkGetSwapchainImagesKHR(m_device, output.swapchain, &queriedImageCount, nullptr);
+    if (createInfo.oldSwapchain == VK_NULL_HANDLE)
+    {
+        printf("Present on output %u: %s, %u images\n", index, getPresentModeName(presentMode), queriedImageCount);
+    }
+    if (index == 0)
+    {
+        m_presentMode = presentMode;
+    }
+    output.images.resize(queriedImageCount);
+    vkGetSwapchainImagesKHR(m_device, output.swapchain, &queriedImageCount, output.images.data());
+}
+
+VkPresentModeKHR Context::choosePresentMode(const std::vector<VkPresentModeKHR>& supportedModes, bool report) const
+{
+    const std::vector<VkPresentModeKHR> candidates = getPresentModeCandidates(m_requestedPresentMode);
+    for (VkPresentModeKHR mode : candidates)
+    {
+        if (std::find(supportedModes.begin(), supportedModes.end(), mode) != supportedModes.end())
+        {
+            if (mode != candidates.front() && report)
+            {
+                printf("Present mode %s isn't supported, falling back to %s\n", getPresentModeName(candidates.front()), getPresentModeName(mode));
+            }
+            return mode;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void Context::waitForQueuedPresents()
+{
+    // Waiting for the previous present caps the queue at one frame, the next frame is rendered from fresh input
+    if (!m_lowLatency)
+    {
+        return;
+    }
+
+    for (Output& output : m_outputs)
+    {
+        if (output.outOfDate || m_presentId < output.firstPresentId)
+        {
+            continue;
+        }
+        const VkResult result = m_waitForPresent(m_device, output.swapchain, m_presentId, c_timeout);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+        {
+            output.outOfDate = true;
+        }
+        else
+        {
+            VK_CHECK(result);
+        }
+    }
+}
+
+void Context::recordPresentInterval()
+{
+    if (m_presented)
+    {
+        const double interval = m_presentTimer.elapsedMilliseconds();
+        ++m_presentIntervals;
+        m_presentIntervalSum += interval;
+        m_presentIntervalSquareSum += interval * interval;
+        m_longestPresentInterval = std::max(m_longestPresentInterval, interval);
+    }
+    m_presentTimer.reset();
+    m_presented = true;
+}
+
+void Context::recreateSwapchain(Output& output, uint32_t index)
+{
+    // Nothing can be presented while the window is minimized
+    VkExtent2D size = getFramebufferSize(output);
+    while (size.width == 0 || size.height == 0)
+    {
+        glfwWaitEvents();
+        size = getFramebufferSize(output);
+    }
+
+    createSwapchain(output, index);
+    output.outOfDate = false;
+    printf("Swapchain of output %u recreated at %ux%u\n", index, output.extent.width, output.extent.height);
 }
 
 void Context::createCommandPools()
 {
-    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_surface);
+    const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_outputs[0].surface);
+    m_graphicsQueueFamily = uint32_t(indices.graphicsFamily);
 
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -357,13 +924,25 @@ void Context::createSemaphores()
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailable));
-    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinished));
+    m_renderFinished.resize(c_frameCount);
+    for (VkSemaphore& semaphore : m_renderFinished)
+    {
+        VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+    }
+    for (Output& output : m_outputs)
+    {
+        output.imageAvailable.resize(c_frameCount);
+        for (VkSemaphore& semaphore : output.imageAvailable)
+        {
+            VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+        }
+    }
 }
 
 void Context::createFences()
 {
-    m_inFlightFences.resize(m_swapchainImages.size());
+    m_inFlightFences.resize(c_frameCount);
+    m_fenceSerials.resize(c_frameCount, 0);
 
     VkFenceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
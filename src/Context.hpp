@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <functional>
+#include "Settings.hpp"
 #include "VulkanUtils.hpp"
 
 class GLFWwindow;
@@ -15,50 +17,140 @@ public:
         std::vector<VkSemaphore> signalSemaphores;
     };
 
-    Context();
+    // Called from update() for keys pressed in the Vulkan window, with GLFW key codes
+    using KeyHandler = std::function<void(int key)>;
+
+    explicit Context(const Settings& settings);
     ~Context();
 
     VkInstance getInstance() const;
     VkPhysicalDevice getPhysicalDevice() const;
     VkDevice getDevice() const;
-    const std::vector<VkImage>& getSwapchainImages() const;
+    // Frames that can be in flight at once, per frame resources are indexed by the frame index from acquireNextFrame()
+    uint32_t getFrameCount() const;
+    // Windows or headless surfaces that all show the same frame, each with its own swapchain
+    uint32_t getOutputCount() const;
+    const std::vector<VkImage>& getSwapchainImages(uint32_t output) const;
+    VkExtent2D getSwapchainExtent(uint32_t output) const;
+    // Incremented whenever the output's swapchain is recreated, size dependent resources follow it
+    uint64_t getSwapchainGeneration(uint32_t output) const;
+    // With --passthrough, when the surface allows copies into the swapchain images
+    bool isSwapchainTransferDst(uint32_t output) const;
     VkQueue getGraphicsQueue() const;
     VkCommandPool getGraphicsCommandPool() const;
+    uint32_t getGraphicsQueueFamily() const;
+    // vkCmdPipelineBarrier2KHR with --sync2 when the device supports it, nullptr otherwise
+    PFN_vkCmdPipelineBarrier2KHR getPipelineBarrier2() const;
+    bool isDeviceExtensionEnabled(const char* extension) const;
 
     bool update();
-    uint32_t acquireNextSwapchainImage();
+    // Sleeps until a window event arrives or the timeout expires, events are handled like in update()
+    void waitForEvents(double timeoutSeconds);
+    // A window changed and the next frame recreates its swapchain
+    bool isSwapchainOutOfDate() const;
+    // Waits until the frame slot is free and acquires an image from every output, returns the frame index
+    uint32_t acquireNextFrame();
+    uint32_t getSwapchainImageIndex(uint32_t output) const;
+    // Submits the frame and presents every output's image in a single present call
     void submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBuffers, WaitAndSignalInfo waitAndSignalInfo);
+    // Parts of the output's next presented image that changed since its previous present, empty when all of it did.
+    // Only a hint for the presentation engine, used with VK_KHR_incremental_present and reset after every present.
+    void setPresentRegions(uint32_t output, std::vector<VkRect2D> regions);
+    void waitForSubmittedFrame();
+    // Runs destroy once the frame being recorded and every frame before it have completed
+    void deferDestroy(std::function<void()> destroy);
+    void addKeyHandler(KeyHandler handler);
+    // Intervals between presents as seen by the application, paced by the display in FIFO and low latency modes
+    void printStatistics();
 
 private:
+    struct DeferredDestroy
+    {
+        uint64_t serial;
+        std::function<void()> destroy;
+    };
+
+    struct Output
+    {
+        // Null when headless
+        GLFWwindow* window = nullptr;
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        std::vector<VkImage> images;
+        VkExtent2D extent{};
+        uint64_t generation = 0;
+        bool transferDst = false;
+        bool outOfDate = false;
+        // One per frame slot, an image can be acquired while an earlier frame still waits for its semaphore
+        std::vector<VkSemaphore> imageAvailable;
+        uint32_t imageIndex = 0;
+        std::vector<VkRect2D> presentRegions;
+        // Present ids count up across swapchains, a new swapchain only knows the ones presented to it
+        uint64_t firstPresentId = 1;
+    };
+
     void initGLFW();
     void createInstance();
     void createDebugCallback();
-    void createWindow();
+    void createWindow(Output& output, uint32_t index);
+    void createHeadlessSurface(Output& output);
+    VkExtent2D getFramebufferSize(const Output& output) const;
     void handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/);
+    void handleResize(GLFWwindow* window);
     void enumeratePhysicalDevice();
     void createDevice();
-    void createSwapchain();
+    void createSwapchain(Output& output, uint32_t index);
+    VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& supportedModes, bool report) const;
+    void waitForQueuedPresents();
+    void recordPresentInterval();
+    void recreateSwapchain(Output& output, uint32_t index);
+    void runDeferredDestroys();
     void createCommandPools();
     void createSemaphores();
     void createFences();
 
     VkInstance m_instance;
     VkDebugReportCallbackEXT m_callback;
-    GLFWwindow* m_window;
+    bool m_headless;
+    // GLFW is only initialized when Vulkan or GL has a window
+    bool m_windowSystem;
+    std::vector<Output> m_outputs;
     bool m_shouldQuit = false;
-    VkSurfaceKHR m_surface;
     VkPhysicalDevice m_physicalDevice;
     VkPhysicalDeviceProperties m_physicalDeviceProperties;
     VkDevice m_device;
+    std::vector<const char*> m_enabledDeviceExtensions;
     VkQueue m_graphicsQueue;
     VkQueue m_computeQueue;
     VkQueue m_presentQueue;
-    VkSwapchainKHR m_swapchain;
-    std::vector<VkImage> m_swapchainImages;
+    uint32_t m_graphicsQueueFamily = 0;
     VkCommandPool m_graphicsCommandPool;
     VkCommandPool m_computeCommandPool;
-    VkSemaphore m_imageAvailable;
-    VkSemaphore m_renderFinished;
+    // Per frame slot, independent of the swapchain images so that outputs can have different image counts
+    std::vector<VkSemaphore> m_renderFinished;
     std::vector<VkFence> m_inFlightFences;
-    uint32_t m_imageIndex;
+    uint32_t m_frameIndex = 0;
+
+    PresentMode m_requestedPresentMode;
+    VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    bool m_lowLatency;
+    bool m_passthrough;
+    PFN_vkWaitForPresentKHR m_waitForPresent = nullptr;
+    bool m_synchronization2;
+    PFN_vkCmdPipelineBarrier2KHR m_pipelineBarrier2 = nullptr;
+    uint64_t m_presentId = 0;
+
+    Timer m_presentTimer;
+    bool m_presented = false;
+    uint64_t m_presentIntervals = 0;
+    double m_presentIntervalSum = 0.0;
+    double m_presentIntervalSquareSum = 0.0;
+    double m_longestPresentInterval = 0.0;
+
+    // Submissions complete in order on the graphics queue, the serial of a waited fence tells what has finished
+    std::vector<uint64_t> m_fenceSerials;
+    uint64_t m_submitSerial = 0;
+    uint64_t m_completedSerial = 0;
+    std::vector<DeferredDestroy> m_deferredDestroys;
+    std::vector<KeyHandler> m_keyHandlers;
 };
@@ -0,0 +1,427 @@
+#include "FrameGraph.hpp"
+#include "Utils.hpp"
+
+namespace
+{
+const VkAccessFlags c_writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// Host reads happen after the CPU has waited for the frame so later barriers don't need to wait for them
+VkPipelineStageFlags getDeviceStages(VkPipelineStageFlags stages)
+{
+    return stages & ~VK_PIPELINE_STAGE_HOST_BIT;
+}
+
+// Synchronization2 splits the shader accesses, the passes only sample and write storage images. Transfer passes
+// copy as well as blit, they keep the stage covering both.
+VkAccessFlags2KHR getPreciseAccess(VkAccessFlags2KHR access, bool image, VkImageLayout layout)
+{
+    if ((access & VK_ACCESS_2_SHADER_READ_BIT_KHR) && image && layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    {
+        access = (access & ~VK_ACCESS_2_SHADER_READ_BIT_KHR) | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR;
+    }
+    if (access & VK_ACCESS_2_SHADER_WRITE_BIT_KHR)
+    {
+        access = (access & ~VK_ACCESS_2_SHADER_WRITE_BIT_KHR) | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR;
+    }
+    return access;
+}
+} // namespace
+
+FrameGraph::FrameGraph(uint32_t queueFamily, PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2) :
+    m_queueFamily(queueFamily),
+    m_pipelineBarrier2(pipelineBarrier2)
+{
+}
+
+FrameGraph::Resource FrameGraph::importImage(VkImage image, VkImageAspectFlags aspect, const Access& state, bool external)
+{
+    const Resource resource = addResource(image, VK_NULL_HANDLE, aspect, state);
+    m_resources[resource].acquire = external;
+    return resource;
+}
+
+FrameGraph::Resource FrameGraph::importBuffer(VkBuffer buffer, const Access& state)
+{
+    return addResource(VK_NULL_HANDLE, buffer, 0, state);
+}
+
+void FrameGraph::exportResource(Resource resource, const Access& state, bool external)
+{
+    CHECK(!m_resources[resource].exported);
+    m_resources[resource].exported = true;
+    m_resources[resource].release = external;
+    m_resources[resource].exportState = state;
+}
+
+FrameGraph::Pass FrameGraph::addPass(const char* name, RecordFunction record)
+{
+    m_passes.push_back(PassInfo{name, std::move(record), {}, false});
+    return ui32Size(m_passes) - 1;
+}
+
+void FrameGraph::read(Pass pass, Resource resource, const Access& access)
+{
+    m_passes[pass].uses.push_back(Use{resource, access, false, false});
+}
+
+void FrameGraph::write(Pass pass, Resource resource, const Access& access, bool discard)
+{
+    m_passes[pass].uses.push_back(Use{resource, access, true, discard});
+}
+
+void FrameGraph::setSideEffects(Pass pass)
+{
+    m_passes[pass].sideEffects = true;
+}
+
+void FrameGraph::execute(VkCommandBuffer cb)
+{
+    const size_t firstPass = m_executedPasses;
+    m_executedPasses = m_passes.size();
+    const std::vector<bool> alive = cull(firstPass);
+
+    // Reads of the same content are all made visible by the barrier of the first one
+    std::vector<Use*> firstReads(m_resources.size(), nullptr);
+    for (size_t i = firstPass; i < m_passes.size(); ++i)
+    {
+        for (Use& use : m_passes[i].uses)
+        {
+            Use*& firstRead = firstReads[use.resource];
+            if (!alive[i])
+            {
+                continue;
+            }
+            if (use.write)
+            {
+                firstRead = nullptr;
+            }
+            else if (firstRead && firstRead->access.layout == use.access.layout)
+            {
+                firstRead->access.stages |= use.access.stages;
+                firstRead->access.access |= use.access.access;
+            }
+            else
+            {
+                firstRead = &use;
+            }
+        }
+    }
+
+    for (size_t i = firstPass; i < m_passes.size(); ++i)
+    {
+        if (!alive[i])
+        {
+            ++m_culledPassCount;
+            continue;
+        }
+
+        Batch batch;
+        for (const Use& use : m_passes[i].uses)
+        {
+            addBarrier(batch, m_resources[use.resource], use);
+        }
+        recordBatch(cb, batch);
+
+        if (m_passes[i].record)
+        {
+            m_passes[i].record(cb);
+        }
+    }
+
+    // Hand-offs to the consumers after the last pass, in one batch as well
+    Batch batch;
+    for (Resource i = 0; i < ui32Size(m_resources); ++i)
+    {
+        ResourceState& resource = m_resources[i];
+        if (resource.exported && !resource.exportRecorded)
+        {
+            resource.exportRecorded = true;
+            const bool write = (resource.exportState.access & c_writeAccess) != 0;
+            addBarrier(batch, resource, Use{i, resource.exportState, write, false}, resource.release);
+        }
+    }
+    recordBatch(cb, batch);
+}
+
+VkImage FrameGraph::getImage(Resource resource) const
+{
+    return m_resources[resource].image;
+}
+
+VkImageLayout FrameGraph::getLayout(Resource resource) const
+{
+    return m_resources[resource].layout;
+}
+
+VkPipelineStageFlags FrameGraph::getFirstUseStages(Resource resource) const
+{
+    // Without a device access the semaphore still has to be waited before anything after it
+    const VkPipelineStageFlags stages = m_resources[resource].firstUseStages;
+    return stages ? stages : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+}
+
+uint32_t FrameGraph::getBarrierCount() const
+{
+    return m_barrierCount;
+}
+
+uint32_t FrameGraph::getCulledPassCount() const
+{
+    return m_culledPassCount;
+}
+
+FrameGraph::Resource FrameGraph::addResource(VkImage image, VkBuffer buffer, VkImageAspectFlags aspect, const Access& state)
+{
+    ResourceState resource{};
+    resource.image = image;
+    resource.buffer = buffer;
+    resource.aspect = aspect;
+    resource.layout = state.layout;
+    // Without write access the state is what earlier reads left, they only need to finish before the next write
+    if (state.access & c_writeAccess)
+    {
+        resource.writeStages = state.stages;
+        resource.writeAccess = state.access;
+    }
+    else
+    {
+        resource.readStages = state.stages;
+        resource.readAccess = state.access;
+    }
+    m_resources.push_back(resource);
+    return ui32Size(m_resources) - 1;
+}
+
+std::vector<bool> FrameGraph::cull(size_t firstPass) const
+{
+    // Backwards from the exports and the passes with side effects, a pass is needed if a later one reads what it writes
+    std::vector<bool> needed(m_resources.size(), false);
+    for (size_t i = 0; i < m_resources.size(); ++i)
+    {
+        needed[i] = m_resources[i].exported;
+    }
+
+    std::vector<bool> alive(m_passes.size(), false);
+    for (size_t i = m_passes.size(); i-- > firstPass;)
+    {
+        const PassInfo& pass = m_passes[i];
+        alive[i] = pass.sideEffects;
+        for (const Use& use : pass.uses)
+        {
+            alive[i] = alive[i] || (use.write && needed[use.resource]);
+        }
+        if (!alive[i])
+        {
+            continue;
+        }
+
+        // Earlier content is only needed if this pass keeps or reads it
+        for (const Use& use : pass.uses)
+        {
+            if (use.write && use.discard)
+            {
+                needed[use.resource] = false;
+            }
+        }
+        for (const Use& use : pass.uses)
+        {
+            if (!use.write || !use.discard)
+            {
+                needed[use.resource] = true;
+            }
+        }
+    }
+    return alive;
+}
+
+void FrameGraph::addBarrier(Batch& batch, ResourceState& resource, const Use& use, bool release)
+{
+    if (resource.firstUseStages == 0)
+    {
+        resource.firstUseStages = getDeviceStages(use.access.stages);
+    }
+
+    const bool image = resource.image != VK_NULL_HANDLE;
+    const bool layoutChange = image && resource.layout != use.access.layout;
+    const bool acquire = resource.acquire;
+    resource.acquire = false;
+    if (acquire && release)
+    {
+        // Never used, the resource stays with the external owner as it is
+        CHECK(!layoutChange);
+        return;
+    }
+
+    VkPipelineStageFlags sourceStages = 0;
+    VkAccessFlags sourceAccess = 0;
+    bool needed = false;
+    if (acquire)
+    {
+        // The release made the writes available, the transition only has to follow the semaphore wait at these stages
+        sourceStages = getDeviceStages(use.access.stages);
+        needed = true;
+    }
+    else if (use.write || layoutChange || release)
+    {
+        // Writes and layout transitions wait for everything before them, only earlier writes have to be made available
+        sourceStages = resource.writeStages | getDeviceStages(resource.readStages);
+        sourceAccess = resource.writeAccess;
+        needed = sourceStages != 0 || layoutChange || release;
+    }
+    else
+    {
+        // Reads only wait for the last write, and only once per stage and access
+        const bool covered = (use.access.stages & ~resource.readStages) == 0 && (use.access.access & ~resource.readAccess) == 0;
+        sourceStages = resource.writeStages;
+        sourceAccess = resource.writeAccess;
+        needed = resource.writeStages != 0 && !covered;
+    }
+
+    // The external consumer waits for the submission's semaphore, which follows every stage
+    const VkPipelineStageFlags destinationStages = release ? 0 : use.access.stages;
+    const VkAccessFlags destinationAccess = release ? 0 : use.access.access;
+    const uint32_t sourceQueueFamily = acquire ? VK_QUEUE_FAMILY_EXTERNAL : (release ? m_queueFamily : VK_QUEUE_FAMILY_IGNORED);
+    const uint32_t destinationQueueFamily = acquire ? m_queueFamily : (release ? VK_QUEUE_FAMILY_EXTERNAL : VK_QUEUE_FAMILY_IGNORED);
+
+    if (needed)
+    {
+        const VkImageLayout oldLayout = use.write && use.discard ? VK_IMAGE_LAYOUT_UNDEFINED : resource.layout;
+        VkAccessFlags2KHR barrierSourceAccess = sourceAccess;
+        VkAccessFlags2KHR barrierDestinationAccess = destinationAccess;
+        if (m_pipelineBarrier2)
+        {
+            barrierSourceAccess = getPreciseAccess(barrierSourceAccess, image, oldLayout);
+            barrierDestinationAccess = getPreciseAccess(barrierDestinationAccess, image, use.access.layout);
+        }
+
+        if (image)
+        {
+            VkImageMemoryBarrier2KHR barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+            barrier.srcStageMask = sourceStages;
+            barrier.srcAccessMask = barrierSourceAccess;
+            barrier.dstStageMask = destinationStages;
+            barrier.dstAccessMask = barrierDestinationAccess;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = use.access.layout;
+            barrier.srcQueueFamilyIndex = sourceQueueFamily;
+            barrier.dstQueueFamilyIndex = destinationQueueFamily;
+            barrier.image = resource.image;
+            barrier.subresourceRange = VkImageSubresourceRange{resource.aspect, 0, 1, 0, 1};
+            batch.imageBarriers.push_back(barrier);
+        }
+        else
+        {
+            VkBufferMemoryBarrier2KHR barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+            barrier.srcStageMask = sourceStages;
+            barrier.srcAccessMask = barrierSourceAccess;
+            barrier.dstStageMask = destinationStages;
+            barrier.dstAccessMask = barrierDestinationAccess;
+            barrier.srcQueueFamilyIndex = sourceQueueFamily;
+            barrier.dstQueueFamilyIndex = destinationQueueFamily;
+            barrier.buffer = resource.buffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            batch.bufferBarriers.push_back(barrier);
+        }
+    }
+
+    if (image)
+    {
+        resource.layout = use.access.layout;
+    }
+    if (use.write)
+    {
+        resource.writeStages = use.access.stages;
+        resource.writeAccess = use.access.access;
+        resource.readStages = 0;
+        resource.readAccess = 0;
+    }
+    else if (acquire)
+    {
+        // The content is available, later reads at other stages only have to follow the acquire
+        resource.writeStages = getDeviceStages(use.access.stages);
+        resource.writeAccess = 0;
+        resource.readStages = use.access.stages;
+        resource.readAccess = use.access.access;
+    }
+    else if (layoutChange)
+    {
+        // The transition waited for the earlier readers
+        resource.readStages = use.access.stages;
+        resource.readAccess = use.access.access;
+    }
+    else
+    {
+        resource.readStages |= use.access.stages;
+        resource.readAccess |= use.access.access;
+    }
+}
+
+void FrameGraph::recordBatch(VkCommandBuffer cb, const Batch& batch)
+{
+    if (batch.imageBarriers.empty() && batch.bufferBarriers.empty())
+    {
+        return;
+    }
+    ++m_barrierCount;
+
+    if (m_pipelineBarrier2)
+    {
+        VkDependencyInfoKHR dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependencyInfo.bufferMemoryBarrierCount = ui32Size(batch.bufferBarriers);
+        dependencyInfo.pBufferMemoryBarriers = batch.bufferBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = ui32Size(batch.imageBarriers);
+        dependencyInfo.pImageMemoryBarriers = batch.imageBarriers.data();
+        m_pipelineBarrier2(cb, &dependencyInfo);
+        return;
+    }
+
+    // Without synchronization2 the barriers share the union of their stages
+    VkPipelineStageFlags sourceStages = 0;
+    VkPipelineStageFlags destinationStages = 0;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    for (const VkImageMemoryBarrier2KHR& barrier2 : batch.imageBarriers)
+    {
+        sourceStages |= VkPipelineStageFlags(barrier2.srcStageMask);
+        destinationStages |= VkPipelineStageFlags(barrier2.dstStageMask);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VkAccessFlags(barrier2.srcAccessMask);
+        barrier.dstAccessMask = VkAccessFlags(barrier2.dstAccessMask);
+        barrier.oldLayout = barrier2.oldLayout;
+        barrier.newLayout = barrier2.newLayout;
+        barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+        barrier.image = barrier2.image;
+        barrier.subresourceRange = barrier2.subresourceRange;
+        imageBarriers.push_back(barrier);
+    }
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    for (const VkBufferMemoryBarrier2KHR& barrier2 : batch.bufferBarriers)
+    {
+        sourceStages |= VkPipelineStageFlags(barrier2.srcStageMask);
+        destinationStages |= VkPipelineStageFlags(barrier2.dstStageMask);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VkAccessFlags(barrier2.srcAccessMask);
+        barrier.dstAccessMask = VkAccessFlags(barrier2.dstAccessMask);
+        barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+        barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+        barrier.buffer = barrier2.buffer;
+        barrier.offset = barrier2.offset;
+        barrier.size = barrier2.size;
+        bufferBarriers.push_back(barrier);
+    }
+
+    // No stages are the start and the end of the pipeline
+    sourceStages = sourceStages ? sourceStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destinationStages = destinationStages ? destinationStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(cb, sourceStages, destinationStages, 0, 0, nullptr, ui32Size(bufferBarriers), bufferBarriers.data(),
+                         ui32Size(imageBarriers), imageBarriers.data());
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <vector>
+
+// Passes of one frame's command buffer with the images and buffers they read and write. execute() drops passes
+// whose results nobody uses and records the barriers between the remaining ones, all barriers a pass needs are
+// batched into one. Resources are imported in the state an earlier frame or an external producer like GL left
+// them in, exporting a resource hands it over to an external consumer in the given state. execute() can be
+// called again, it records what was added since, for example exports that depend on state the passes read.
+// With VK_KHR_synchronization2 every barrier keeps its own stages instead of sharing those of its batch.
+class FrameGraph final
+{
+public:
+    using Resource = uint32_t;
+    using Pass = uint32_t;
+    using RecordFunction = std::function<void(VkCommandBuffer cb)>;
+
+    struct Access
+    {
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        // Ignored for buffers
+        VkImageLayout layout;
+    };
+
+    // pipelineBarrier2 is nullptr without synchronization2, the barriers are recorded with vkCmdPipelineBarrier then
+    FrameGraph(uint32_t queueFamily, PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2);
+
+    // An external image is acquired from VK_QUEUE_FAMILY_EXTERNAL at its first use, after the semaphore wait
+    Resource importImage(VkImage image, VkImageAspectFlags aspect, const Access& state, bool external = false);
+    Resource importBuffer(VkBuffer buffer, const Access& state);
+    // Keeps the passes writing the resource, the barrier after the passes makes it available to the consumer. An
+    // external export releases it to VK_QUEUE_FAMILY_EXTERNAL, the consumer waits for the submission's semaphore.
+    void exportResource(Resource resource, const Access& state, bool external = false);
+
+    // A pass without a record function only declares accesses that happen outside of the command buffer
+    Pass addPass(const char* name, RecordFunction record);
+    void read(Pass pass, Resource resource, const Access& access);
+    // A discarding write overwrites everything, the previous content isn't kept across a layout change
+    void write(Pass pass, Resource resource, const Access& access, bool discard = false);
+    // Presents, host reads and other effects outside of the graph's resources keep a pass from being culled
+    void setSideEffects(Pass pass);
+
+    void execute(VkCommandBuffer cb);
+
+    VkImage getImage(Resource resource) const;
+    // After the passes executed so far
+    VkImageLayout getLayout(Resource resource) const;
+    // Device stages that first access the resource, a semaphore from its producer has to be waited there
+    VkPipelineStageFlags getFirstUseStages(Resource resource) const;
+    uint32_t getBarrierCount() const;
+    uint32_t getCulledPassCount() const;
+
+private:
+    struct ResourceState
+    {
+        VkImage image;
+        VkBuffer buffer;
+        VkImageAspectFlags aspect;
+        VkImageLayout layout;
+        // Last write and the reads that already waited for it
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+        VkPipelineStageFlags readStages;
+        VkAccessFlags readAccess;
+        VkPipelineStageFlags firstUseStages;
+        bool acquire;
+        bool exported;
+        bool exportRecorded;
+        bool release;
+        Access exportState;
+    };
+
+    struct Use
+    {
+        Resource resource;
+        Access access;
+        bool write;
+        bool discard;
+    };
+
+    struct PassInfo
+    {
+        const char* name;
+        RecordFunction record;
+        std::vector<Use> uses;
+        bool sideEffects;
+    };
+
+    // Barriers of one pass, recorded together. Stages of 0 are none, before the first command or after the last.
+    struct Batch
+    {
+        std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+        std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+    };
+
+    Resource addResource(VkImage image, VkBuffer buffer, VkImageAspectFlags aspect, const Access& state);
+    std::vector<bool> cull(size_t firstPass) const;
+    void addBarrier(Batch& batch, ResourceState& resource, const Use& use, bool release = false);
+    void recordBatch(VkCommandBuffer cb, const Batch& batch);
+
+    uint32_t m_queueFamily;
+    PFN_vkCmdPipelineBarrier2KHR m_pipelineBarrier2;
+    std::vector<ResourceState> m_resources;
+    std::vector<PassInfo> m_passes;
+    size_t m_executedPasses = 0;
+    uint32_t m_barrierCount = 0;
+    uint32_t m_culledPassCount = 0;
+};
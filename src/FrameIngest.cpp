@@ -0,0 +1,199 @@
+#include "FrameIngest.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+FrameIngest::FrameIngest(std::unique_ptr<FrameSource> source, SharedImageFormat format, bool windowSystem) :
+    m_source(std::move(source)),
+    m_format(format),
+    m_frameSize(getFrameSize(format)),
+    m_windowSystem(windowSystem)
+{
+    // Persistent coherent mappings replace orphaning, fences tell when GL has finished reading a buffer
+    const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (Slot& slot : m_slots)
+    {
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, GLsizeiptr(m_frameSize), nullptr, mapFlags);
+        slot.data = static_cast<uint8_t*>(glMapNamedBufferRange(slot.buffer, 0, GLsizeiptr(m_frameSize), mapFlags));
+        CHECK(slot.data);
+        slot.fence = nullptr;
+        slot.state = SlotState::Free;
+        slot.sequence = 0;
+    }
+
+    printf("Ingest: %s source, %zu buffers of %llu bytes\n", m_source->getName(), m_slots.size(), static_cast<unsigned long long>(m_frameSize));
+    m_worker = std::thread(&FrameIngest::decode, this);
+}
+
+FrameIngest::~FrameIngest()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_slotFreed.notify_all();
+    m_worker.join();
+
+    for (Slot& slot : m_slots)
+    {
+        if (slot.fence)
+        {
+            glDeleteSync(slot.fence);
+        }
+        glUnmapNamedBuffer(slot.buffer);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+bool FrameIngest::upload(const std::vector<GLuint>& textures)
+{
+    releaseUploadedSlots();
+
+    Slot* newest = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Slot& slot : m_slots)
+        {
+            if (slot.state == SlotState::Ready && (!newest || slot.sequence > newest->sequence))
+            {
+                newest = &slot;
+            }
+        }
+        if (!newest)
+        {
+            return false;
+        }
+
+        // Only the newest frame is shown, older decoded frames are dropped
+        for (Slot& slot : m_slots)
+        {
+            if (slot.state == SlotState::Ready && &slot != newest)
+            {
+                slot.state = SlotState::Free;
+                ++m_framesDropped;
+            }
+        }
+        newest->state = SlotState::Uploading;
+        ++m_framesUploaded;
+    }
+    m_slotFreed.notify_one();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, newest->buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (m_format == SharedImageFormat::Nv12)
+    {
+        const size_t uvOffset = size_t(c_windowWidth) * c_windowHeight;
+        glTextureSubImage2D(textures[0], 0, 0, 0, c_windowWidth, c_windowHeight, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glTextureSubImage2D(textures[1], 0, 0, 0, c_windowWidth / 2, c_windowHeight / 2, GL_RG, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(uvOffset));
+    }
+    else
+    {
+        glTextureSubImage2D(textures[0], 0, 0, 0, c_windowWidth, c_windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    newest->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+
+bool FrameIngest::isFrameReady()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::any_of(m_slots.begin(), m_slots.end(), [](const Slot& slot) { return slot.state == SlotState::Ready; });
+}
+
+void FrameIngest::printStatistics(double seconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const double megabytes = double(m_framesUploaded * m_frameSize) / (1024.0 * 1024.0);
+    printf("Ingest %s: %.1f MB/s uploaded, %.1f frames/s decoded, %llu frames dropped, %llu decoder stalls%s\n", m_source->getName(), megabytes / seconds,
+           m_framesDecoded / seconds, static_cast<unsigned long long>(m_framesDropped), static_cast<unsigned long long>(m_decodeStalls),
+           m_sourceEnded ? ", source ended" : "");
+
+    m_framesDecoded = 0;
+    m_decodeStalls = 0;
+    m_framesUploaded = 0;
+    m_framesDropped = 0;
+}
+
+void FrameIngest::releaseUploadedSlots()
+{
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Slot& slot : m_slots)
+        {
+            if (slot.state != SlotState::Uploading)
+            {
+                continue;
+            }
+            const GLenum result = glClientWaitSync(slot.fence, 0, 0);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            {
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+                slot.state = SlotState::Free;
+                released = true;
+            }
+        }
+    }
+    if (released)
+    {
+        m_slotFreed.notify_one();
+    }
+}
+
+void FrameIngest::decode()
+{
+    while (true)
+    {
+        Slot* slot = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto findFreeSlot = [this, &slot]() {
+                for (Slot& candidate : m_slots)
+                {
+                    if (candidate.state == SlotState::Free)
+                    {
+                        slot = &candidate;
+                        return true;
+                    }
+                }
+                return m_stop;
+            };
+            if (!findFreeSlot())
+            {
+                // Every buffer is either waiting to be shown or still read by GL
+                ++m_decodeStalls;
+                m_slotFreed.wait(lock, findFreeSlot);
+            }
+            if (m_stop)
+            {
+                return;
+            }
+            slot->state = SlotState::Decoding;
+        }
+
+        // The mapping is only touched by this thread while the slot is decoding
+        const bool decoded = m_source->readFrame(m_format, slot->data);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!decoded)
+        {
+            slot->state = SlotState::Free;
+            m_sourceEnded = true;
+            return;
+        }
+        slot->state = SlotState::Ready;
+        slot->sequence = ++m_sequence;
+        ++m_framesDecoded;
+        // Wakes the main loop in case it waits for events, which it only does with GLFW
+        if (m_windowSystem)
+        {
+            glfwPostEmptyEvent();
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "FrameSource.hpp"
+#include "Settings.hpp"
+#include <glad/glad.h>
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Streams frames from a FrameSource into GL textures. A worker thread decodes into a ring of persistently
+// mapped pixel unpack buffers while GL uploads the newest decoded frame, older ones are dropped.
+class FrameIngest final
+{
+public:
+    // Without a window system GLFW isn't initialized and the main loop isn't woken for new frames
+    FrameIngest(std::unique_ptr<FrameSource> source, SharedImageFormat format, bool windowSystem);
+    ~FrameIngest();
+
+    // One texture for RGBA8, the Y and UV plane textures for NV12. Returns false if no new frame was ready.
+    bool upload(const std::vector<GLuint>& textures);
+    // A decoded frame is waiting to be uploaded
+    bool isFrameReady();
+    void printStatistics(double seconds);
+
+private:
+    enum class SlotState
+    {
+        Free,
+        Decoding,
+        Ready,
+        Uploading
+    };
+
+    struct Slot
+    {
+        GLuint buffer;
+        uint8_t* data;
+        GLsync fence;
+        SlotState state;
+        uint64_t sequence;
+    };
+
+    void releaseUploadedSlots();
+    void decode();
+
+    std::unique_ptr<FrameSource> m_source;
+    SharedImageFormat m_format;
+    uint64_t m_frameSize;
+    bool m_windowSystem;
+
+    std::array<Slot, 4> m_slots{};
+    std::mutex m_mutex;
+    std::condition_variable m_slotFreed;
+    std::thread m_worker;
+    // Slot states and everything below are guarded by m_mutex
+    bool m_stop = false;
+    bool m_sourceEnded = false;
+    uint64_t m_sequence = 0;
+    uint64_t m_framesDecoded = 0;
+    uint64_t m_decodeStalls = 0;
+    uint64_t m_framesUploaded = 0;
+    uint64_t m_framesDropped = 0;
+};
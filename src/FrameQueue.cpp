@@ -0,0 +1,224 @@
+#include "FrameQueue.hpp"
+#include "Utils.hpp"
+#include <chrono>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+namespace
+{
+// Long enough for a peer that answers within a fraction of a frame, short enough not to burn a core while it doesn't
+const std::chrono::microseconds c_spinTime(200);
+// A sleeping side checks the socket this often to notice a peer that crashed without waking it
+const long c_peerCheckNanoseconds = 100 * 1000 * 1000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The frame queue's counters are shared between processes");
+
+#ifdef __linux__
+// Not private, the other process waits on or wakes the same word
+void futexWait(std::atomic<uint32_t>& word, uint32_t value)
+{
+    const timespec timeout{0, c_peerCheckNanoseconds};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+#endif
+} // namespace
+
+uint64_t getSteadyNanoseconds()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+#ifdef __linux__
+FrameQueue::FrameQueue(const IpcChannel& channel) :
+    m_channel(channel)
+{
+    m_memory = memfd_create("glvk-frame-queue", MFD_CLOEXEC);
+    CHECK(m_memory >= 0);
+    CHECK(ftruncate(m_memory, sizeof(Shared)) == 0);
+    map();
+    // The memory starts out zeroed, this only begins the lifetime of the counters
+    new (m_shared) Shared();
+}
+
+FrameQueue::FrameQueue(const IpcChannel& channel, ExternalHandle memory) :
+    m_channel(channel),
+    m_memory(memory)
+{
+    map();
+}
+
+FrameQueue::~FrameQueue()
+{
+    munmap(m_shared, sizeof(Shared));
+    close(m_memory);
+}
+
+void FrameQueue::map()
+{
+    void* mapping = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, m_memory, 0);
+    CHECK(mapping != MAP_FAILED);
+    m_shared = static_cast<Shared*>(mapping);
+}
+
+template<typename T>
+bool FrameQueue::push(Ring<T>& ring, const T& entry)
+{
+    const uint32_t written = ring.written.value.load(std::memory_order_relaxed);
+    uint32_t read = ring.read.value.load(std::memory_order_acquire);
+    while (written - read == c_frameQueueSize)
+    {
+        if (!waitWhile(ring.read, read))
+        {
+            return false;
+        }
+        read = ring.read.value.load(std::memory_order_acquire);
+    }
+
+    ring.entries[written % c_frameQueueSize] = entry;
+    // Sequentially consistent with the sleeping flag, either the reader sees the new value or this sees the flag
+    ring.written.value.store(written + 1, std::memory_order_seq_cst);
+    if (ring.written.sleeping.load(std::memory_order_seq_cst))
+    {
+        futexWake(ring.written.value);
+    }
+    return true;
+}
+
+template<typename T>
+bool FrameQueue::pop(Ring<T>& ring, T& entry)
+{
+    const uint32_t read = ring.read.value.load(std::memory_order_relaxed);
+    uint32_t written = ring.written.value.load(std::memory_order_acquire);
+    while (written == read)
+    {
+        if (!waitWhile(ring.written, written))
+        {
+            return false;
+        }
+        written = ring.written.value.load(std::memory_order_acquire);
+    }
+
+    entry = ring.entries[read % c_frameQueueSize];
+    ring.read.value.store(read + 1, std::memory_order_seq_cst);
+    if (ring.read.sleeping.load(std::memory_order_seq_cst))
+    {
+        futexWake(ring.read.value);
+    }
+    return true;
+}
+
+bool FrameQueue::waitWhile(Counter& counter, uint32_t value)
+{
+    ++m_waitStatistics.waits;
+    // With a single core the peer can't run while this one spins
+    static const bool spin = std::thread::hardware_concurrency() > 1;
+    const auto spinEnd = std::chrono::steady_clock::now() + c_spinTime;
+    while (spin && counter.value.load(std::memory_order_acquire) == value)
+    {
+        if (std::chrono::steady_clock::now() >= spinEnd)
+        {
+            break;
+        }
+    }
+    if (counter.value.load(std::memory_order_acquire) != value)
+    {
+        return true;
+    }
+
+    ++m_waitStatistics.sleeps;
+    while (counter.value.load(std::memory_order_acquire) == value)
+    {
+        counter.sleeping.store(1, std::memory_order_seq_cst);
+        // The kernel compares the value again, a change after this check returns right away
+        if (counter.value.load(std::memory_order_seq_cst) == value)
+        {
+            futexWait(counter.value, value);
+        }
+        counter.sleeping.store(0, std::memory_order_relaxed);
+
+        if (counter.value.load(std::memory_order_acquire) == value && !m_channel.isConnected())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+#else
+FrameQueue::FrameQueue(const IpcChannel& channel) :
+    m_channel(channel),
+    m_memory(c_invalidExternalHandle)
+{
+    printf("IPC: the frame queue needs memfd and futexes\n");
+    CHECK(false);
+}
+
+FrameQueue::FrameQueue(const IpcChannel& channel, ExternalHandle memory) :
+    m_channel(channel),
+    m_memory(memory)
+{
+    printf("IPC: the frame queue needs memfd and futexes\n");
+    CHECK(false);
+}
+
+FrameQueue::~FrameQueue()
+{
+}
+
+template<typename T>
+bool FrameQueue::push(Ring<T>&, const T&)
+{
+    return false;
+}
+
+template<typename T>
+bool FrameQueue::pop(Ring<T>&, T&)
+{
+    return false;
+}
+#endif
+
+ExternalHandle FrameQueue::getHandle() const
+{
+    return m_memory;
+}
+
+bool FrameQueue::pushRequest(const FrameRequest& request)
+{
+    return push(m_shared->requests, request);
+}
+
+bool FrameQueue::popRequest(FrameRequest& request)
+{
+    return pop(m_shared->requests, request);
+}
+
+bool FrameQueue::pushReply(const FrameReply& reply)
+{
+    return push(m_shared->replies, reply);
+}
+
+bool FrameQueue::popReply(FrameReply& reply)
+{
+    return pop(m_shared->replies, reply);
+}
+
+FrameQueue::WaitStatistics FrameQueue::takeWaitStatistics()
+{
+    const WaitStatistics statistics = m_waitStatistics;
+    m_waitStatistics = {};
+    return statistics;
+}
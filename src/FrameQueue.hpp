@@ -0,0 +1,103 @@
+#pragma once
+
+#include "IpcChannel.hpp"
+#include "VulkanUtils.hpp"
+#include <atomic>
+
+const uint32_t c_maxIpcDamageRects = 16;
+const uint32_t c_frameQueueSize = 4;
+
+// Consumer to producer: GL may render one frame, Vulkan's signal of the ready semaphore is submitted
+struct FrameRequest
+{
+    uint64_t frame;
+    // The producer receives a Resize message over the socket first when it doesn't have this shared image yet
+    uint64_t generation;
+    VkExtent2D renderExtent;
+    uint32_t toggleAnimation;
+    // The last request, the producer exits
+    uint32_t teardown;
+    // Steady clock, which is the same monotonic clock in both processes
+    uint64_t sentNanoseconds;
+};
+
+// Producer to consumer: answer to a request, GL's signal of the complete semaphore is flushed if it published
+struct FrameReply
+{
+    uint64_t frame;
+    uint32_t running;
+    uint32_t published;
+    double gpuMilliseconds;
+    uint64_t gpuSampleCount;
+    uint64_t receivedNanoseconds;
+    uint32_t damageCount;
+    VkRect2D damage[c_maxIpcDamageRects];
+};
+
+uint64_t getSteadyNanoseconds();
+
+// Single producer, single consumer rings of frame requests and replies in memory shared by the two processes. The
+// socket is only used to hand over the memory and to notice a peer that exited or crashed. Pushing and popping
+// are lock-free, a waiting side spins for a short while before it sleeps on the ring's counter with a futex, and
+// the other side only makes the wake syscall when it announced that it sleeps. Only available on Linux.
+class FrameQueue final
+{
+public:
+    struct WaitStatistics
+    {
+        uint64_t waits;
+        // Waits that ended in the kernel, the rest were answered while spinning
+        uint64_t sleeps;
+    };
+
+    // Consumer side, creates the shared memory, getHandle() is sent to the producer with the setup
+    explicit FrameQueue(const IpcChannel& channel);
+    // Producer side, maps the consumer's memory and takes ownership of the handle
+    FrameQueue(const IpcChannel& channel, ExternalHandle memory);
+    ~FrameQueue();
+
+    ExternalHandle getHandle() const;
+
+    // Block while the ring is full or empty, return false once the peer is gone
+    bool pushRequest(const FrameRequest& request);
+    bool popRequest(FrameRequest& request);
+    bool pushReply(const FrameReply& reply);
+    bool popReply(FrameReply& reply);
+
+    // Since the last call
+    WaitStatistics takeWaitStatistics();
+
+private:
+    // Only ever grows, the futex word of the side waiting for it to change
+    struct alignas(64) Counter
+    {
+        std::atomic<uint32_t> value;
+        std::atomic<uint32_t> sleeping;
+    };
+
+    template<typename T>
+    struct Ring
+    {
+        Counter written;
+        Counter read;
+        T entries[c_frameQueueSize];
+    };
+
+    struct Shared
+    {
+        Ring<FrameRequest> requests;
+        Ring<FrameReply> replies;
+    };
+
+    void map();
+    template<typename T>
+    bool push(Ring<T>& ring, const T& entry);
+    template<typename T>
+    bool pop(Ring<T>& ring, T& entry);
+    bool waitWhile(Counter& counter, uint32_t value);
+
+    const IpcChannel& m_channel;
+    ExternalHandle m_memory;
+    Shared* m_shared = nullptr;
+    WaitStatistics m_waitStatistics{};
+};
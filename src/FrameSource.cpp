@@ -0,0 +1,234 @@
+#include "FrameSource.hpp"
+#include "PixelConversion.hpp"
+#include "Utils.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+const size_t c_pixelCount = size_t(c_windowWidth) * c_windowHeight;
+
+void rgbaToFrame(const uint8_t* rgba, SharedImageFormat format, uint8_t* destination)
+{
+    if (format == SharedImageFormat::Rgba8)
+    {
+        memcpy(destination, rgba, c_pixelCount * 4);
+        return;
+    }
+    rgbaToNv12(rgba, size_t(c_windowWidth) * 4, c_windowWidth, c_windowHeight, destination, c_windowWidth, destination + c_pixelCount, c_windowWidth);
+}
+
+bool hasSuffix(const std::string& value, const std::string& suffix)
+{
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+class CallbackFrameSource final : public FrameSource
+{
+public:
+    CallbackFrameSource(Callback callback) :
+        m_callback(std::move(callback))
+    {
+    }
+
+    const char* getName() const override
+    {
+        return "callback";
+    }
+
+    bool readFrame(SharedImageFormat format, uint8_t* destination) override
+    {
+        if (format == SharedImageFormat::Rgba8)
+        {
+            return m_callback(destination);
+        }
+        m_rgba.resize(c_pixelCount * 4);
+        if (!m_callback(m_rgba.data()))
+        {
+            return false;
+        }
+        rgbaToFrame(m_rgba.data(), format, destination);
+        return true;
+    }
+
+private:
+    Callback m_callback;
+    std::vector<uint8_t> m_rgba;
+};
+
+class RawFrameSource final : public FrameSource
+{
+public:
+    RawFrameSource(const std::string& path) :
+        m_file(path, std::ios::ate | std::ios::binary)
+    {
+        CHECK(m_file.is_open());
+        const uint64_t fileSize = static_cast<uint64_t>(m_file.tellg());
+        CHECK(fileSize >= c_pixelCount * 4 && fileSize % (c_pixelCount * 4) == 0);
+        m_file.seekg(0);
+    }
+
+    const char* getName() const override
+    {
+        return "raw";
+    }
+
+    bool readFrame(SharedImageFormat format, uint8_t* destination) override
+    {
+        m_rgba.resize(c_pixelCount * 4);
+        uint8_t* rgba = format == SharedImageFormat::Rgba8 ? destination : m_rgba.data();
+        if (!m_file.read(reinterpret_cast<char*>(rgba), c_pixelCount * 4))
+        {
+            m_file.clear();
+            m_file.seekg(0);
+            CHECK(m_file.read(reinterpret_cast<char*>(rgba), c_pixelCount * 4));
+        }
+        if (rgba != destination)
+        {
+            rgbaToFrame(rgba, format, destination);
+        }
+        return true;
+    }
+
+private:
+    std::ifstream m_file;
+    std::vector<uint8_t> m_rgba;
+};
+
+// Only the tags needed to validate the stream are parsed, the frames have to be 4:2:0 at window size
+class Y4mFrameSource final : public FrameSource
+{
+public:
+    Y4mFrameSource(const std::string& path) :
+        m_file(path, std::ios::binary)
+    {
+        CHECK(m_file.is_open());
+
+        std::string header;
+        CHECK(std::getline(m_file, header));
+        std::istringstream tags(header);
+        std::string tag;
+        tags >> tag;
+        CHECK(tag == "YUV4MPEG2");
+
+        int width = 0;
+        int height = 0;
+        while (tags >> tag)
+        {
+            if (tag[0] == 'W')
+            {
+                width = atoi(tag.c_str() + 1);
+            }
+            else if (tag[0] == 'H')
+            {
+                height = atoi(tag.c_str() + 1);
+            }
+            else if (tag[0] == 'C')
+            {
+                CHECK(tag.compare(1, 3, "420") == 0);
+            }
+        }
+        CHECK(width == c_windowWidth && height == c_windowHeight);
+
+        m_dataStart = m_file.tellg();
+        m_planes.resize(c_pixelCount * 3 / 2);
+    }
+
+    const char* getName() const override
+    {
+        return "y4m";
+    }
+
+    bool readFrame(SharedImageFormat format, uint8_t* destination) override
+    {
+        if (!readPlanes())
+        {
+            m_file.clear();
+            m_file.seekg(m_dataStart);
+            CHECK(readPlanes());
+        }
+
+        // I420 has separate U and V planes, NV12 interleaves them
+        const size_t chromaCount = c_pixelCount / 4;
+        const uint8_t* y = m_planes.data();
+        const uint8_t* u = y + c_pixelCount;
+        const uint8_t* v = u + chromaCount;
+        m_uv.resize(chromaCount * 2);
+        uint8_t* uv = format == SharedImageFormat::Nv12 ? destination + c_pixelCount : m_uv.data();
+        for (size_t i = 0; i < chromaCount; ++i)
+        {
+            uv[i * 2] = u[i];
+            uv[i * 2 + 1] = v[i];
+        }
+
+        if (format == SharedImageFormat::Nv12)
+        {
+            memcpy(destination, y, c_pixelCount);
+        }
+        else
+        {
+            nv12ToRgba(y, c_windowWidth, uv, c_windowWidth, c_windowWidth, c_windowHeight, destination, size_t(c_windowWidth) * 4);
+        }
+        return true;
+    }
+
+private:
+    bool readPlanes()
+    {
+        std::string frameHeader;
+        if (!std::getline(m_file, frameHeader))
+        {
+            return false;
+        }
+        CHECK(frameHeader.compare(0, 5, "FRAME") == 0);
+        return bool(m_file.read(reinterpret_cast<char*>(m_planes.data()), m_planes.size()));
+    }
+
+    std::ifstream m_file;
+    std::streampos m_dataStart;
+    std::vector<uint8_t> m_planes;
+    std::vector<uint8_t> m_uv;
+};
+} // namespace
+
+uint64_t getFrameSize(SharedImageFormat format)
+{
+    return format == SharedImageFormat::Nv12 ? c_pixelCount * 3 / 2 : c_pixelCount * 4;
+}
+
+std::unique_ptr<FrameSource> createFrameSource(const std::string& source)
+{
+    if (source == "pattern")
+    {
+        // Moving gradient, stands in for a decoder that produces RGBA
+        uint32_t frame = 0;
+        return createCallbackFrameSource([frame](uint8_t* rgba) mutable {
+            for (int y = 0; y < c_windowHeight; ++y)
+            {
+                for (int x = 0; x < c_windowWidth; ++x)
+                {
+                    uint8_t* pixel = rgba + (size_t(y) * c_windowWidth + x) * 4;
+                    pixel[0] = uint8_t(x + frame);
+                    pixel[1] = uint8_t(y);
+                    pixel[2] = uint8_t(frame);
+                    pixel[3] = 255;
+                }
+            }
+            ++frame;
+            return true;
+        });
+    }
+    if (hasSuffix(source, ".y4m"))
+    {
+        return std::make_unique<Y4mFrameSource>(source);
+    }
+    return std::make_unique<RawFrameSource>(source);
+}
+
+std::unique_ptr<FrameSource> createCallbackFrameSource(FrameSource::Callback callback)
+{
+    return std::make_unique<CallbackFrameSource>(std::move(callback));
+}
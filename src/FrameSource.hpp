@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Settings.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// CPU-side producer of window sized frames. Frames are tightly packed, RGBA8 or NV12 with the Y plane
+// followed by the interleaved UV plane. readFrame() is called from the ingest worker thread only.
+class FrameSource
+{
+public:
+    // Writes an RGBA8 frame, returns false at the end of the stream
+    using Callback = std::function<bool(uint8_t* rgba)>;
+
+    virtual ~FrameSource() = default;
+
+    virtual const char* getName() const = 0;
+    // Returns false at the end of the stream, files start over instead
+    virtual bool readFrame(SharedImageFormat format, uint8_t* destination) = 0;
+};
+
+uint64_t getFrameSize(SharedImageFormat format);
+
+// "pattern" for a generated test pattern, files ending in .y4m are 4:2:0 YUV4MPEG2, anything else is raw RGBA8
+std::unique_ptr<FrameSource> createFrameSource(const std::string& source);
+std::unique_ptr<FrameSource> createCallbackFrameSource(FrameSource::Callback callback);
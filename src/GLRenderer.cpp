@@ -1,96 +1,708 @@
 #include "GLRenderer.hpp"
+#include "PixelConversion.hpp"
 #include "Utils.hpp"
 
 #include <GLFW/glfw3.h>
+#ifdef GLVK_EGL
+#include <EGL/eglext.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <string>
 
 namespace
 {
+#ifdef _WIN32
 #define GL_HANDLE_TYPE GL_HANDLE_TYPE_OPAQUE_WIN32_EXT
+#else
+#define GL_HANDLE_TYPE GL_HANDLE_TYPE_OPAQUE_FD_EXT
+#endif
+
+const GLuint64 c_readbackTimeout = 1'000'000'000;
+const uint32_t c_squareSpeed = 4;
+
+#ifdef GLVK_EGL
+bool hasEglExtension(const char* extensions, const std::string& extension)
+{
+    return extensions && (" " + std::string(extensions) + " ").find(" " + extension + " ") != std::string::npos;
+}
+#endif
 } // namespace
 
-GLRenderer::GLRenderer(Interop& interop) :
-    m_interop(interop)
+GLRenderer::GLRenderer(InteropEndpoint& interop, const Settings& settings, bool windowSystem) :
+    m_interop(interop),
+    m_mirror(settings.glMirror),
+    m_windowSystem(windowSystem)
 {
-    createWindow();
-    initializeRenderer();
+    createContext(settings);
+    initializeRenderer(settings);
 }
 
 GLRenderer::~GLRenderer()
 {
     glFinish();
+    m_ingest.reset();
+    glDeleteQueries(GLsizei(m_timerQueries.size()), m_timerQueries.data());
     glDeleteFramebuffers(1, &m_framebuffer);
-    glDeleteTextures(1, &m_texture);
-    glDeleteSemaphoresEXT(1, &m_vulkanCompleteSemaphore);
-    glDeleteSemaphoresEXT(1, &m_glCompleteSemaphore);
-    glfwDestroyWindow(m_window);
+    glDeleteTextures(GLsizei(m_textures.size()), m_textures.data());
+    glDeleteTextures(1, &m_depthTexture);
+
+    for (HostReadback& readback : m_hostReadbacks)
+    {
+        if (readback.fence)
+        {
+            glDeleteSync(readback.fence);
+        }
+        if (readback.buffer)
+        {
+            glUnmapNamedBuffer(readback.buffer);
+            glDeleteBuffers(1, &readback.buffer);
+        }
+    }
+
+    if (!m_memoryObjects.empty())
+    {
+        glDeleteMemoryObjectsEXT(GLsizei(m_memoryObjects.size()), m_memoryObjects.data());
+        if (m_depthMemoryObject)
+        {
+            glDeleteMemoryObjectsEXT(1, &m_depthMemoryObject);
+        }
+        glDeleteSemaphoresEXT(1, &m_vulkanCompleteSemaphore);
+        glDeleteSemaphoresEXT(1, &m_glCompleteSemaphore);
+    }
+#ifdef GLVK_EGL
+    if (m_eglDisplay != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_eglDisplay, m_eglContext);
+        eglTerminate(m_eglDisplay);
+    }
+#endif
+    if (m_window)
+    {
+        glfwDestroyWindow(m_window);
+    }
 }
 
 bool GLRenderer::render()
 {
+    const bool external = m_interop.getTransport() == InteropTransport::ExternalMemory;
+    const bool nv12 = m_interop.getSharedImageFormat() == SharedImageFormat::Nv12;
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+
+    if (external && m_importedGeneration != m_interop.getSharedImageGeneration())
+    {
+        // Vulkan replaced the shared image after a resize, the old one is released once GL is done with it
+        releaseSharedImage();
+        importSharedImage();
+    }
+
+    // Vulkan keeps showing the previous frame, host copies still in flight are handed over as they finish
+    if (!hasNewContent())
+    {
+        if (!external)
+        {
+            deliverFinishedHostReadbacks();
+        }
+        return isRunning();
+    }
+
     static float f = 0.0f;
-    f += 0.0001f;
-    if (f > 1.0f)
+    if (m_animating)
     {
-        f = 0.0f;
+        f += 0.0001f;
+        if (f > 1.0f)
+        {
+            f = 0.0f;
+        }
     }
 
-    GLenum srcLayout = GL_LAYOUT_COLOR_ATTACHMENT_EXT;
-    glWaitSemaphoreEXT(m_vulkanCompleteSemaphore, 0, nullptr, 1, &m_texture, &srcLayout);
+    if (external)
+    {
+        GLenum srcLayout = m_interop.isSharedImageHostAccessible() ? GL_LAYOUT_GENERAL_EXT : GL_LAYOUT_COLOR_ATTACHMENT_EXT;
+        if (nv12)
+        {
+            srcLayout = GL_LAYOUT_TRANSFER_DST_EXT;
+        }
+        std::vector<GLuint> textures = m_textures;
+        std::vector<GLenum> srcLayouts(m_textures.size(), srcLayout);
+        if (m_depthTexture)
+        {
+            textures.push_back(m_depthTexture);
+            srcLayouts.push_back(GL_LAYOUT_DEPTH_STENCIL_ATTACHMENT_EXT);
+        }
+        glWaitSemaphoreEXT(m_vulkanCompleteSemaphore, 0, nullptr, GLuint(textures.size()), textures.data(), srcLayouts.data());
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    beginTimer();
 
-    // Just clear the texture with a changing color, good enough for demo purposes
-    glViewport(0, 0, c_windowWidth, c_windowHeight);
-    glClearColor(0.2f, 0.3f, f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    // In case one wishes to show the output on the window
-    glBlitNamedFramebuffer(m_framebuffer, 0, 0, 0, c_windowWidth, c_windowHeight, 0, 0, c_windowWidth, c_windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    if (m_ingest)
+    {
+        // Keeps showing the previous frame when the source hasn't produced a new one
+        m_ingest->upload(m_textures);
+    }
+    else if (nv12)
+    {
+        uploadNv12Frame(f);
+    }
+    else if (m_interop.isDamageTracking())
+    {
+        renderDamageScene();
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+
+        // Just clear the texture with a changing color, good enough for demo purposes. With render scaling only
+        // the top left part is rendered, the scissor limits the clear to it.
+        const VkExtent2D renderExtent = m_interop.getRenderExtent();
+        const GLint width = GLint(renderExtent.width);
+        const GLint height = GLint(renderExtent.height);
+        glViewport(0, 0, width, height);
+        glScissor(0, 0, width, height);
+        glEnable(GL_SCISSOR_TEST);
+        glClearColor(0.2f, 0.3f, f, 1.0f);
+        glClearDepth(1.0);
+        glClear(GL_COLOR_BUFFER_BIT | (m_depthTexture ? GL_DEPTH_BUFFER_BIT : 0));
+        if (m_depthTexture)
+        {
+            // A band near the viewer moving across the background, Vulkan's overlay lies between the two
+            const GLint bandWidth = width / 4;
+            glScissor(GLint(f * float(width - bandWidth)), 0, bandWidth, height);
+            glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
+            glClearDepth(0.25);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
 
-    GLenum dstLayout = GL_LAYOUT_SHADER_READ_ONLY_EXT;
-    glSignalSemaphoreEXT(m_glCompleteSemaphore, 0, nullptr, 1, &m_texture, &dstLayout);
+    endTimer();
+    m_contentLost = false;
+    m_renderedExtent = m_interop.getRenderExtent();
 
-    glFlush();
+    if (m_mirror && m_framebuffer)
+    {
+        // Debug view, the whole rendered part is copied since the window's back buffer is undefined after a swap
+        const GLint width = GLint(m_renderedExtent.width);
+        const GLint height = GLint(m_renderedExtent.height);
+        glBlitNamedFramebuffer(m_framebuffer, 0, 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glfwSwapBuffers(m_window);
+    }
+
+    if (external)
+    {
+        const GLenum dstLayout = m_interop.isSharedImageHostAccessible() ? GL_LAYOUT_GENERAL_EXT : GL_LAYOUT_SHADER_READ_ONLY_EXT;
+        std::vector<GLuint> textures = m_textures;
+        std::vector<GLenum> dstLayouts(m_textures.size(), dstLayout);
+        if (m_depthTexture)
+        {
+            // Vulkan acquires depth in the attachment layout and moves it to a read-only one itself
+            textures.push_back(m_depthTexture);
+            dstLayouts.push_back(GL_LAYOUT_DEPTH_STENCIL_ATTACHMENT_EXT);
+        }
+        glSignalSemaphoreEXT(m_glCompleteSemaphore, 0, nullptr, GLuint(textures.size()), textures.data(), dstLayouts.data());
+        glFlush();
+        m_interop.publishContent();
+    }
+    else
+    {
+        readBackToHost();
+    }
+
+    return isRunning();
+}
+
+void GLRenderer::toggleAnimation()
+{
+    m_animating = !m_animating;
+    printf("GL: animation %s\n", m_animating ? "resumed" : "paused");
+}
+
+void GLRenderer::printStatistics(double seconds)
+{
+    if (m_timedFrames > 0)
+    {
+        printf("GL: %.3f ms GPU per frame\n", m_gpuMilliseconds / double(m_timedFrames));
+        m_gpuMilliseconds = 0.0;
+        m_timedFrames = 0;
+    }
+    if (m_scenePixels > 0)
+    {
+        printf("GL: %.1f%% of the shared image redrawn\n", double(m_redrawnPixels) * 100.0 / double(m_scenePixels));
+        m_redrawnPixels = 0;
+        m_scenePixels = 0;
+    }
+    if (m_ingest)
+    {
+        m_ingest->printStatistics(seconds);
+    }
+}
+
+double GLRenderer::getGpuMilliseconds() const
+{
+    return m_lastGpuMilliseconds;
+}
+
+uint64_t GLRenderer::getGpuSampleCount() const
+{
+    return m_gpuSampleCount;
+}
 
-    //glfwSwapBuffers(m_window);
-    return !glfwWindowShouldClose(m_window);
+void GLRenderer::createContext(const Settings& settings)
+{
+#ifdef GLVK_EGL
+    if (settings.surfacelessGL)
+    {
+        createSurfacelessContext();
+        return;
+    }
+#endif
+    CHECK(!settings.surfacelessGL);
+    createWindow(settings.glMirror);
 }
 
-void GLRenderer::createWindow()
+void GLRenderer::createWindow(bool visible)
 {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
     m_window = glfwCreateWindow(c_windowWidth, c_windowHeight, "GL", NULL, NULL);
     CHECK(m_window);
 
     glfwMakeContextCurrent(m_window);
+    // The mirror must not hold GL back to the refresh rate
+    glfwSwapInterval(0);
 
     CHECK(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress));
-    CHECK(glGenSemaphoresEXT);
 }
 
-void GLRenderer::initializeRenderer()
+#ifdef GLVK_EGL
+void GLRenderer::createSurfacelessContext()
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    CHECK(hasEglExtension(clientExtensions, "EGL_MESA_platform_surfaceless"));
+    auto getPlatformDisplay = PFNEGLGETPLATFORMDISPLAYEXTPROC(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    CHECK(getPlatformDisplay);
+
+    m_eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    CHECK(m_eglDisplay != EGL_NO_DISPLAY);
+    EGLint major = 0;
+    EGLint minor = 0;
+    CHECK(eglInitialize(m_eglDisplay, &major, &minor));
+    CHECK(hasEglExtension(eglQueryString(m_eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"));
+    CHECK(eglBindAPI(EGL_OPENGL_API));
+
+    const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    CHECK(eglChooseConfig(m_eglDisplay, configAttributes, &config, 1, &configCount) && configCount == 1);
+
+    const EGLint contextAttributes[] = //
+        {
+            EGL_CONTEXT_MAJOR_VERSION, 4, //
+            EGL_CONTEXT_MINOR_VERSION, 6, //
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, //
+            EGL_NONE //
+        };
+    m_eglContext = eglCreateContext(m_eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    CHECK(m_eglContext != EGL_NO_CONTEXT);
+
+    // No surface and no default framebuffer, GL only renders into the shared image
+    CHECK(eglMakeCurrent(m_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext));
+    CHECK(gladLoadGLLoader((GLADloadproc)eglGetProcAddress));
+    printf("GL: surfaceless EGL %d.%d context\n", major, minor);
+}
+#endif
+
+bool GLRenderer::isRunning() const
 {
-    { // Semaphores
-        glGenSemaphoresEXT(1, &m_vulkanCompleteSemaphore);
-        glGenSemaphoresEXT(1, &m_glCompleteSemaphore);
+    return !m_window || !glfwWindowShouldClose(m_window);
+}
+
+bool GLRenderer::hasNewContent()
+{
+    const VkExtent2D renderExtent = m_interop.getRenderExtent();
+    if (m_contentLost || renderExtent.width != m_renderedExtent.width || renderExtent.height != m_renderedExtent.height)
+    {
+        return true;
+    }
+    if (m_ingest)
+    {
+        return m_ingest->isFrameReady();
+    }
+    return m_animating;
+}
+
+const char* GLRenderer::getExternalSharingError() const
+{
+#ifdef _WIN32
+    const bool handleExtensions = GLAD_GL_EXT_memory_object_win32 && GLAD_GL_EXT_semaphore_win32;
+#else
+    const bool handleExtensions = GLAD_GL_EXT_memory_object_fd && GLAD_GL_EXT_semaphore_fd;
+#endif
+    if (!GLAD_GL_EXT_memory_object || !GLAD_GL_EXT_semaphore || !handleExtensions)
+    {
+        return "GL memory object or semaphore extensions are not available";
+    }
 
-        glImportSemaphoreWin32HandleEXT(m_vulkanCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getVKReadyHandle());
-        glImportSemaphoreWin32HandleEXT(m_glCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getGLCompleteHandle());
+    // Memory can only be imported by the same physical device
+    GLint deviceCount = 0;
+    glGetIntegerv(GL_NUM_DEVICE_UUIDS_EXT, &deviceCount);
+    for (GLint i = 0; i < deviceCount; ++i)
+    {
+        GLubyte uuid[GL_UUID_SIZE_EXT]{};
+        glGetUnsignedBytei_vEXT(GL_DEVICE_UUID_EXT, i, uuid);
+        if (memcmp(uuid, m_interop.getDeviceUUID().data(), GL_UUID_SIZE_EXT) == 0)
+        {
+            return nullptr;
+        }
+    }
+    return "GL and Vulkan run on different devices";
+}
+
+void GLRenderer::initializeRenderer(const Settings& settings)
+{
+    if (m_interop.getTransport() == InteropTransport::ExternalMemory)
+    {
+        const char* error = getExternalSharingError();
+        if (error)
+        {
+            m_interop.fallbackToHostCopy(error);
+        }
     }
 
-    { // Vulkan allocated memory to GL texture
-        glGenTextures(1, &m_texture);
-        glBindTexture(GL_TEXTURE_2D, m_texture);
-        glCreateMemoryObjectsEXT(1, &m_memoryObject);
-        glImportMemoryWin32HandleEXT(m_memoryObject, m_interop.getSharedImageMemorySize(), GL_HANDLE_TYPE, m_interop.getSharedImageMemoryHandle());
-        glTextureStorageMem2DEXT(m_texture, 1, GL_RGBA8, c_windowWidth, c_windowHeight, m_memoryObject, 0);
+    if (m_interop.getTransport() == InteropTransport::ExternalMemory)
+    {
+        importSemaphores();
+        importSharedImage();
+    }
+    else
+    {
+        createHostTransport();
+    }
+
+    glGenQueries(GLsizei(m_timerQueries.size()), m_timerQueries.data());
+
+    if (!settings.source.empty())
+    {
+        m_ingest = std::make_unique<FrameIngest>(createFrameSource(settings.source), m_interop.getSharedImageFormat(), m_windowSystem);
+    }
+
+    if (m_interop.getSharedImageFormat() == SharedImageFormat::Nv12)
+    {
+        if (!m_ingest)
+        {
+            createNv12Pattern();
+        }
+        return;
     }
 
     glGenFramebuffers(1, &m_framebuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_textures[0], 0);
+    if (m_depthTexture)
+    {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+    }
+
+    if (m_interop.getTransport() == InteropTransport::HostCopy)
+    {
+        // Reading in the driver's preferred format avoids a conversion on its side, BGRA is swizzled while copying
+        GLint readFormat = GL_RGBA;
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &readFormat);
+        m_hostReadFormat = readFormat == GL_BGRA ? GL_BGRA : GL_RGBA;
+    }
+}
+
+void GLRenderer::importSemaphores()
+{
+    // On Linux GL takes ownership of the file descriptors
+    glGenSemaphoresEXT(1, &m_vulkanCompleteSemaphore);
+    glGenSemaphoresEXT(1, &m_glCompleteSemaphore);
+
+#ifdef _WIN32
+    glImportSemaphoreWin32HandleEXT(m_vulkanCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getVKReadyHandle());
+    glImportSemaphoreWin32HandleEXT(m_glCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getGLCompleteHandle());
+#else
+    glImportSemaphoreFdEXT(m_vulkanCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getVKReadyHandle());
+    glImportSemaphoreFdEXT(m_glCompleteSemaphore, GL_HANDLE_TYPE, m_interop.getGLCompleteHandle());
+#endif
+}
+
+void GLRenderer::importSharedImage()
+{
+    // Vulkan allocated memory to GL textures, NV12 planes are bound to their own allocations
+    const bool nv12 = m_interop.getSharedImageFormat() == SharedImageFormat::Nv12;
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    const uint32_t count = m_interop.getSharedImageMemoryCount();
+    m_textures.resize(count);
+    m_memoryObjects.resize(count);
+    glGenTextures(GLsizei(count), m_textures.data());
+    glCreateMemoryObjectsEXT(GLsizei(count), m_memoryObjects.data());
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+        if (m_interop.isSharedImageHostAccessible())
+        {
+            glTextureParameteri(m_textures[i], GL_TEXTURE_TILING_EXT, GL_LINEAR_TILING_EXT);
+        }
+#ifdef _WIN32
+        glImportMemoryWin32HandleEXT(m_memoryObjects[i], m_interop.getSharedImageMemorySize(i), GL_HANDLE_TYPE, m_interop.getSharedImageMemoryHandle(i));
+#else
+        glImportMemoryFdEXT(m_memoryObjects[i], m_interop.getSharedImageMemorySize(i), GL_HANDLE_TYPE, m_interop.getSharedImageMemoryHandle(i));
+#endif
+        // The chroma plane is subsampled by two in both directions
+        const GLenum internalFormat = nv12 ? (i == 0 ? GL_R8 : GL_RG8) : GL_RGBA8;
+        const GLsizei width = GLsizei(i == 0 ? extent.width : extent.width / 2);
+        const GLsizei height = GLsizei(i == 0 ? extent.height : extent.height / 2);
+        glTextureStorageMem2DEXT(m_textures[i], 1, internalFormat, width, height, m_memoryObjects[i], 0);
+    }
+    if (m_interop.isDepthSharing())
+    {
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_depthTexture);
+        glCreateMemoryObjectsEXT(1, &m_depthMemoryObject);
+#ifdef _WIN32
+        glImportMemoryWin32HandleEXT(m_depthMemoryObject, m_interop.getSharedDepthMemorySize(), GL_HANDLE_TYPE, m_interop.getSharedDepthMemoryHandle());
+#else
+        glImportMemoryFdEXT(m_depthMemoryObject, m_interop.getSharedDepthMemorySize(), GL_HANDLE_TYPE, m_interop.getSharedDepthMemoryHandle());
+#endif
+        // Matches VK_FORMAT_D32_SFLOAT
+        glTextureStorageMem2DEXT(m_depthTexture, 1, GL_DEPTH_COMPONENT32F, GLsizei(extent.width), GLsizei(extent.height), m_depthMemoryObject, 0);
+    }
+    m_importedGeneration = m_interop.getSharedImageGeneration();
+    // The new image starts out undefined
+    m_contentLost = true;
+
+    if (m_framebuffer)
+    {
+        glNamedFramebufferTexture(m_framebuffer, GL_COLOR_ATTACHMENT0, m_textures[0], 0);
+        if (m_depthTexture)
+        {
+            glNamedFramebufferTexture(m_framebuffer, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+        }
+    }
+    if (!m_nv12Source.empty())
+    {
+        createNv12Pattern();
+    }
+}
+
+void GLRenderer::releaseSharedImage()
+{
+    // GL keeps the storage alive until commands using it have completed
+    glDeleteTextures(GLsizei(m_textures.size()), m_textures.data());
+    glDeleteMemoryObjectsEXT(GLsizei(m_memoryObjects.size()), m_memoryObjects.data());
+    m_textures.clear();
+    m_memoryObjects.clear();
+    if (m_depthTexture)
+    {
+        glDeleteTextures(1, &m_depthTexture);
+        glDeleteMemoryObjectsEXT(1, &m_depthMemoryObject);
+        m_depthTexture = 0;
+        m_depthMemoryObject = 0;
+    }
+}
+
+void GLRenderer::createNv12Pattern()
+{
+    // A gradient converted on the CPU every frame stands in for decoded video
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    const size_t pixelCount = size_t(extent.width) * extent.height;
+    m_nv12Source.resize(pixelCount * 4);
+    m_nv12Y.resize(pixelCount);
+    m_nv12UV.resize(pixelCount / 2);
+    for (uint32_t y = 0; y < extent.height; ++y)
+    {
+        for (uint32_t x = 0; x < extent.width; ++x)
+        {
+            uint8_t* pixel = &m_nv12Source[(size_t(y) * extent.width + x) * 4];
+            pixel[0] = uint8_t(x * 255 / extent.width);
+            pixel[1] = uint8_t(y * 255 / extent.height);
+            pixel[2] = 0;
+            pixel[3] = 255;
+        }
+    }
+}
+
+void GLRenderer::uploadNv12Frame(float blue)
+{
+    const uint8_t blueValue = uint8_t(blue * 255.0f);
+    for (size_t i = 2; i < m_nv12Source.size(); i += 4)
+    {
+        m_nv12Source[i] = blueValue;
+    }
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    rgbaToNv12(m_nv12Source.data(), size_t(extent.width) * 4, extent.width, extent.height, m_nv12Y.data(), extent.width, m_nv12UV.data(), extent.width);
+
+    const GLsizei width = GLsizei(extent.width);
+    const GLsizei height = GLsizei(extent.height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(m_textures[0], 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, m_nv12Y.data());
+    glTextureSubImage2D(m_textures[1], 0, 0, 0, width / 2, height / 2, GL_RG, GL_UNSIGNED_BYTE, m_nv12UV.data());
+}
+
+void GLRenderer::renderDamageScene()
+{
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    const uint32_t size = std::max(std::min(extent.width, extent.height) / 8, 1u);
+    const uint32_t travel = extent.width - size;
+
+    // The square bounces between the left and right edge
+    VkRect2D square{};
+    square.extent = {size, size};
+    const uint32_t speed = m_animating ? c_squareSpeed : 0;
+    m_squareTravel = travel > 0 ? (m_squareTravel + speed) % (2 * travel) : 0;
+    square.offset.x = int32_t(m_squareTravel < travel ? m_squareTravel : 2 * travel - m_squareTravel);
+    square.offset.y = int32_t(extent.height - size) / 2;
+
+    // The square moves a few pixels per frame, the rectangle spanning its old and new position is all that changed
+    VkRect2D damage{{0, 0}, extent};
+    if (!m_contentLost)
+    {
+        const int32_t left = std::min(m_square.offset.x, square.offset.x);
+        const int32_t top = std::min(m_square.offset.y, square.offset.y);
+        const int32_t right = std::max(m_square.offset.x + int32_t(m_square.extent.width), square.offset.x + int32_t(size));
+        const int32_t bottom = std::max(m_square.offset.y + int32_t(m_square.extent.height), square.offset.y + int32_t(size));
+        damage = VkRect2D{{left, top}, {uint32_t(right - left), uint32_t(bottom - top)}};
+    }
+    m_square = square;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, GLsizei(extent.width), GLsizei(extent.height));
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(damage.offset.x, damage.offset.y, GLsizei(damage.extent.width), GLsizei(damage.extent.height));
+    glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    // The damage always contains the square
+    glScissor(square.offset.x, square.offset.y, GLsizei(size), GLsizei(size));
+    glClearColor(0.9f, 0.6f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    m_interop.addDamage(damage);
+    m_redrawnPixels += uint64_t(damage.extent.width) * damage.extent.height;
+    m_scenePixels += uint64_t(extent.width) * extent.height;
+}
+
+void GLRenderer::createHostTransport()
+{
+    m_textures.resize(1);
+    glCreateTextures(GL_TEXTURE_2D, 1, m_textures.data());
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    glTextureStorage2D(m_textures[0], 1, GL_RGBA8, GLsizei(extent.width), GLsizei(extent.height));
+
+    const GLsizeiptr size = GLsizeiptr(m_interop.getHostFrameSize());
+    const GLbitfield mapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (HostReadback& readback : m_hostReadbacks)
+    {
+        glCreateBuffers(1, &readback.buffer);
+        glNamedBufferStorage(readback.buffer, size, nullptr, mapFlags | GL_CLIENT_STORAGE_BIT);
+        readback.data = glMapNamedBufferRange(readback.buffer, 0, size, mapFlags);
+        CHECK(readback.data);
+        readback.fence = nullptr;
+    }
+}
+
+void GLRenderer::readBackToHost()
+{
+    // The ring is full, the oldest readback has to be handed over before its buffer is reused
+    HostReadback& current = m_hostReadbacks[m_hostReadbackIndex];
+    if (current.fence)
+    {
+        const GLenum result = glClientWaitSync(current.fence, GL_SYNC_FLUSH_COMMANDS_BIT, c_readbackTimeout);
+        CHECK(result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+        deliverHostReadback(current);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, current.buffer);
+    const VkExtent2D extent = m_interop.getSharedImageExtent();
+    glReadPixels(0, 0, GLsizei(extent.width), GLsizei(extent.height), m_hostReadFormat, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    m_hostReadbackIndex = (m_hostReadbackIndex + 1) % m_hostReadbacks.size();
+    deliverFinishedHostReadbacks();
+}
+
+void GLRenderer::deliverFinishedHostReadbacks()
+{
+    // Hand over finished readbacks oldest first without blocking
+    for (size_t i = 0; i < m_hostReadbacks.size(); ++i)
+    {
+        HostReadback& readback = m_hostReadbacks[(m_hostReadbackIndex + i) % m_hostReadbacks.size()];
+        if (!readback.fence)
+        {
+            continue;
+        }
+        const GLenum result = glClientWaitSync(readback.fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        deliverHostReadback(readback);
+    }
+}
+
+void GLRenderer::deliverHostReadback(HostReadback& readback)
+{
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+
+    void* destination = m_interop.acquireHostWriteSlot();
+    if (!destination)
+    {
+        return;
+    }
+
+    if (m_hostReadFormat == GL_BGRA)
+    {
+        swizzleRgbaBgra(static_cast<const uint8_t*>(readback.data), static_cast<uint8_t*>(destination), m_interop.getHostFrameSize() / 4);
+    }
+    else
+    {
+        memcpy(destination, readback.data, m_interop.getHostFrameSize());
+    }
+    m_interop.submitHostWriteSlot();
+}
+
+void GLRenderer::beginTimer()
+{
+    // Frames whose query is still in flight aren't timed rather than stalling on the result
+    const size_t index = m_timerIndex;
+    if (m_timerPending[index])
+    {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(m_timerQueries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            return;
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(m_timerQueries[index], GL_QUERY_RESULT, &nanoseconds);
+        m_lastGpuMilliseconds = double(nanoseconds) / 1e6;
+        ++m_gpuSampleCount;
+        m_gpuMilliseconds += m_lastGpuMilliseconds;
+        ++m_timedFrames;
+        m_timerPending[index] = false;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[index]);
+    m_timerActive = true;
+}
+
+void GLRenderer::endTimer()
+{
+    if (!m_timerActive)
+    {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    m_timerPending[m_timerIndex] = true;
+    m_timerIndex = (m_timerIndex + 1) % m_timerQueries.size();
+    m_timerActive = false;
 }
@@ -1,27 +1,108 @@
 #pragma once
 
-#include "Interop.hpp"
+#include "FrameIngest.hpp"
+#include "InteropEndpoint.hpp"
+#include "Settings.hpp"
 #include <glad/glad.h>
+#ifdef GLVK_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#endif
+#include <array>
+#include <memory>
+#include <vector>
 
 class GLFWwindow;
 
-class GLRenderer final
+class GLRenderer final : public FrameProducer
 {
 public:
-    GLRenderer(Interop& interop);
+    // windowSystem tells whether the caller initialized GLFW
+    GLRenderer(InteropEndpoint& interop, const Settings& settings, bool windowSystem);
     ~GLRenderer();
 
-    bool render();
+    bool render() override;
+    void toggleAnimation() override;
+    void printStatistics(double seconds) override;
+    double getGpuMilliseconds() const override;
+    uint64_t getGpuSampleCount() const override;
 
 private:
-    void createWindow();
-    void initializeRenderer();
+    struct HostReadback
+    {
+        GLuint buffer;
+        const void* data;
+        GLsync fence;
+    };
 
-    Interop& m_interop;
-    GLFWwindow* m_window;
+    void createContext(const Settings& settings);
+    void createWindow(bool visible);
+#ifdef GLVK_EGL
+    void createSurfacelessContext();
+#endif
+    bool isRunning() const;
+    bool hasNewContent();
+    const char* getExternalSharingError() const;
+    void initializeRenderer(const Settings& settings);
+    void importSemaphores();
+    void importSharedImage();
+    void releaseSharedImage();
+    void createNv12Pattern();
+    void uploadNv12Frame(float blue);
+    void renderDamageScene();
+    void createHostTransport();
+    void readBackToHost();
+    void deliverFinishedHostReadbacks();
+    void deliverHostReadback(HostReadback& readback);
+    void beginTimer();
+    void endTimer();
+
+    InteropEndpoint& m_interop;
+    // Null with a surfaceless context
+    GLFWwindow* m_window = nullptr;
+#ifdef GLVK_EGL
+    EGLDisplay m_eglDisplay = EGL_NO_DISPLAY;
+    EGLContext m_eglContext = EGL_NO_CONTEXT;
+#endif
+    bool m_mirror;
+    bool m_windowSystem;
     GLuint m_vulkanCompleteSemaphore = 0;
     GLuint m_glCompleteSemaphore = 0;
-    GLuint m_memoryObject = 0;
-    GLuint m_texture = 0;
+    // One texture per memory object, the planes of an NV12 image are separate R8 and RG8 textures
+    std::vector<GLuint> m_memoryObjects;
+    std::vector<GLuint> m_textures;
+    // Shared depth, rendered with the shared image and handed to Vulkan with it
+    GLuint m_depthMemoryObject = 0;
+    GLuint m_depthTexture = 0;
+    uint64_t m_importedGeneration = 0;
+    bool m_animating = true;
+    // The shared image has to be drawn completely, it's new or its size changed
+    bool m_contentLost = true;
+    VkExtent2D m_renderedExtent{};
     GLuint m_framebuffer = 0;
+
+    std::vector<uint8_t> m_nv12Source;
+    std::vector<uint8_t> m_nv12Y;
+    std::vector<uint8_t> m_nv12UV;
+    std::unique_ptr<FrameIngest> m_ingest;
+
+    // Damage tracking scene, a square moving across a static background
+    VkRect2D m_square{};
+    uint32_t m_squareTravel = 0;
+    uint64_t m_redrawnPixels = 0;
+    uint64_t m_scenePixels = 0;
+
+    std::array<HostReadback, 3> m_hostReadbacks{};
+    size_t m_hostReadbackIndex = 0;
+    GLenum m_hostReadFormat = GL_RGBA;
+
+    // GPU time of the GL frame, results are read a few frames later without waiting
+    std::array<GLuint, 3> m_timerQueries{};
+    std::array<bool, 3> m_timerPending{};
+    size_t m_timerIndex = 0;
+    bool m_timerActive = false;
+    double m_lastGpuMilliseconds = 0.0;
+    uint64_t m_gpuSampleCount = 0;
+    double m_gpuMilliseconds = 0.0;
+    uint64_t m_timedFrames = 0;
 };
@@ -0,0 +1,77 @@
+#include "GpuTimer.hpp"
+#include "VulkanUtils.hpp"
+#include "Utils.hpp"
+#include <array>
+
+GpuTimer::GpuTimer(Context& context, uint32_t slotCount) :
+    m_device(context.getDevice()),
+    m_pending(slotCount, false)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.getPhysicalDevice(), &properties);
+    if (!properties.limits.timestampComputeAndGraphics)
+    {
+        return;
+    }
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = slotCount * 2;
+
+    VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+}
+
+GpuTimer::~GpuTimer()
+{
+    if (m_queryPool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+    }
+}
+
+bool GpuTimer::isSupported() const
+{
+    return m_queryPool != VK_NULL_HANDLE;
+}
+
+void GpuTimer::begin(VkCommandBuffer cb, uint32_t slot, VkPipelineStageFlagBits stage)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    vkCmdResetQueryPool(cb, m_queryPool, slot * 2, 2);
+    vkCmdWriteTimestamp(cb, stage, m_queryPool, slot * 2);
+}
+
+void GpuTimer::end(VkCommandBuffer cb, uint32_t slot, VkPipelineStageFlagBits stage)
+{
+    if (m_queryPool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    vkCmdWriteTimestamp(cb, stage, m_queryPool, slot * 2 + 1);
+    m_pending[slot] = true;
+}
+
+void GpuTimer::markReused(uint32_t slot)
+{
+    m_pending[slot] = m_queryPool != VK_NULL_HANDLE;
+}
+
+bool GpuTimer::collect(uint32_t slot, double& milliseconds)
+{
+    if (!m_pending[slot])
+    {
+        return false;
+    }
+    m_pending[slot] = false;
+
+    // The slot's fence has been waited, the results are available
+    std::array<uint64_t, 2> timestamps{};
+    VK_CHECK(vkGetQueryPoolResults(m_device, m_queryPool, slot * 2, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
+    milliseconds = double(timestamps[1] - timestamps[0]) * m_timestampPeriod / 1e6;
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Context.hpp"
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// GPU time between two points of a command buffer, one pair of timestamps per slot. Measures nothing
+// when the graphics queue doesn't support timestamps.
+class GpuTimer final
+{
+public:
+    GpuTimer(Context& context, uint32_t slotCount);
+    ~GpuTimer();
+
+    bool isSupported() const;
+    // Outside of a render pass
+    void begin(VkCommandBuffer cb, uint32_t slot, VkPipelineStageFlagBits stage);
+    void end(VkCommandBuffer cb, uint32_t slot, VkPipelineStageFlagBits stage);
+    // The slot's timestamps are submitted again in a command buffer recorded earlier
+    void markReused(uint32_t slot);
+    // The slot's previous submission has to be complete, returns false if it wasn't measured
+    bool collect(uint32_t slot, double& milliseconds);
+
+private:
+    VkDevice m_device;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    double m_timestampPeriod = 0.0;
+    std::vector<bool> m_pending;
+};
@@ -1,92 +1,499 @@
 #include "Interop.hpp"
 #include "VulkanUtils.hpp"
 #include "Utils.hpp"
-#include <vulkan/vulkan_win32.h>
 #include <array>
+#include <algorithm>
 
-Interop::Interop(Context& context) :
+namespace
+{
+const VkImageUsageFlags c_rgbaImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+// GL uploads the planes, each plane of a disjoint image aliases a single-plane image of the plane's format
+const VkImageUsageFlags c_nv12ImageUsage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+const VkImageCreateFlags c_nv12ImageFlags = VK_IMAGE_CREATE_DISJOINT_BIT | VK_IMAGE_CREATE_ALIAS_BIT;
+constexpr std::array<VkImageAspectFlagBits, 2> c_nv12PlaneAspects = {VK_IMAGE_ASPECT_PLANE_0_BIT, VK_IMAGE_ASPECT_PLANE_1_BIT};
+// GL renders depth into it, Vulkan samples it
+const VkFormat c_sharedDepthFormat = VK_FORMAT_D32_SFLOAT;
+const VkImageUsageFlags c_sharedDepthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+// GL leaves the depth image in this state and gets it back in it, like the shared image's write state
+const FrameGraph::Access c_sharedDepthWriteState{VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                                                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+// GL reads back and Vulkan uploads up to this many frames apart
+const size_t c_hostTransportDepth = 3;
+
+const char* getTransportName(InteropTransport transport)
+{
+    return transport == InteropTransport::ExternalMemory ? "external memory" : "host copy";
+}
+
+// Stages that read the shared image, host copies are only ordered after them
+const VkPipelineStageFlags c_previousReadStages =
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+} // namespace
+
+Interop::Interop(Context& context, const Settings& settings) :
     m_context(context),
     m_device(context.getDevice())
 {
-    createInteropSemaphores();
+    queryDeviceUUID();
+
+    m_sharedImageFormat = settings.sharedImageFormat;
+    const bool nv12 = m_sharedImageFormat == SharedImageFormat::Nv12;
+    CHECK(!nv12 || isNv12Supported(settings));
+    m_sharedImageVkFormat = nv12 ? VK_FORMAT_G8_B8R8_2PLANE_420_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+    m_sharedImageFlags = nv12 ? c_nv12ImageFlags : 0;
+    m_sharedImageUsage = nv12 ? c_nv12ImageUsage : c_rgbaImageUsage;
+    // Passthrough blits the shared image into the swapchain
+    m_sharedImageUsage |= settings.passthrough && !nv12 ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0;
+
+    const bool hostAccessRequested = settings.readback && settings.readbackMethod == ReadbackMethod::Mapped;
+    m_hostAccessible = hostAccessRequested && isHostAccessSupported();
+    // Host access needs the general layout, it's also valid for attachments and sampling
+    m_readLayout = m_hostAccessible ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    m_writeLayout = m_hostAccessible ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    m_writeAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    m_writeStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    if (nv12)
+    {
+        m_writeLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        m_writeAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+        m_writeStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+
+    m_externalSharingSupported = settings.transport != InteropTransport::HostCopy && isExternalSharingSupported();
+    CHECK(m_externalSharingSupported || (settings.transport != InteropTransport::ExternalMemory && !nv12));
+    m_transport = m_externalSharingSupported ? InteropTransport::ExternalMemory : InteropTransport::HostCopy;
+    m_resizable = m_transport == InteropTransport::ExternalMemory && !settings.readback && settings.source.empty();
+
+    // Frame sources, NV12 uploads and readback always cover the whole shared image
+    m_renderScaling = settings.renderScaling;
+    CHECK(!m_renderScaling || (!nv12 && settings.source.empty() && !settings.readback));
+    m_renderScale = settings.renderScale;
+    updateRenderExtent();
+    // Damage is tracked for the GL scene, frame sources and NV12 uploads replace the whole image
+    m_damageTracking = settings.damageTracking;
+    CHECK(!m_damageTracking || (!nv12 && settings.source.empty() && !m_renderScaling));
+    // Depth is sampled at the shared image's coordinates after GL cleared all of it, frame sources have none
+    CHECK(!settings.sharedDepth || (!nv12 && settings.source.empty() && !m_renderScaling && !m_damageTracking && !settings.passthrough));
+    m_depthSharing = settings.sharedDepth && isDepthSharingSupported();
+
+    if (m_externalSharingSupported)
+    {
+        createInteropSemaphores();
+    }
+    if (nv12)
+    {
+        createYcbcrConversion();
+    }
     createInteropTexture();
+    if (m_transport == InteropTransport::HostCopy)
+    {
+        createHostTransport();
+    }
 }
 
 Interop::~Interop()
 {
     vkDeviceWaitIdle(m_device);
 
-    vkDestroyImage(m_device, m_sharedImage, nullptr);
-    vkFreeMemory(m_device, m_sharedImageMemory, nullptr);
+    for (const HostSlot& slot : m_hostSlots)
+    {
+        vkUnmapMemory(m_device, slot.memory);
+        vkDestroyBuffer(m_device, slot.buffer, nullptr);
+        vkFreeMemory(m_device, slot.memory, nullptr);
+    }
+
+    if (m_sharedImageMapping)
+    {
+        vkUnmapMemory(m_device, m_sharedImageMemories[0].memory);
+    }
     vkDestroyImageView(m_device, m_sharedImageView, nullptr);
+    vkDestroyImage(m_device, m_sharedImage, nullptr);
+    for (const SharedMemory& memory : m_sharedImageMemories)
+    {
+        vkFreeMemory(m_device, memory.memory, nullptr);
+    }
+    vkDestroyImageView(m_device, m_sharedDepthView, nullptr);
+    vkDestroyImage(m_device, m_sharedDepthImage, nullptr);
+    vkFreeMemory(m_device, m_sharedDepthMemory.memory, nullptr);
+    if (m_ycbcrConversion != VK_NULL_HANDLE)
+    {
+        auto vkDestroySamplerYcbcrConversionKHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkDestroySamplerYcbcrConversionKHR");
+        auto vkDestroySamplerYcbcrConversionKHR = PFN_vkDestroySamplerYcbcrConversionKHR(vkDestroySamplerYcbcrConversionKHRAddr);
+        CHECK(vkDestroySamplerYcbcrConversionKHR);
+        vkDestroySamplerYcbcrConversionKHR(m_device, m_ycbcrConversion, nullptr);
+    }
     vkDestroySemaphore(m_device, m_glCompleteSemaphore, nullptr);
     vkDestroySemaphore(m_device, m_vulkanCompleteSemaphore, nullptr);
 }
 
-void Interop::transformSharedImageForGLWrite(VkCommandBuffer cb)
+InteropTransport Interop::getTransport() const
 {
-    CHECK(!m_stateIsGLWrite);
+    return m_transport;
+}
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = m_sharedImage;
-    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.layerCount = 1;
-    const VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    const VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    vkCmdPipelineBarrier(cb, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+void Interop::fallbackToHostCopy(const char* reason)
+{
+    CHECK(m_transport == InteropTransport::ExternalMemory);
+    printf("Interop: %s, falling back to host copy transport\n", reason);
+    // Host copies are only implemented for RGBA8
+    CHECK(m_sharedImageFormat == SharedImageFormat::Rgba8);
+    // Vulkan already samples the shared depth, it can't be copied through the host
+    CHECK(!m_depthSharing);
 
-    m_stateIsGLWrite = true;
+    m_transport = InteropTransport::HostCopy;
+    m_resizable = false;
+    createHostTransport();
 }
 
-void Interop::transformSharedImageForVKRead(VkCommandBuffer cb)
+void Interop::beginFrame(uint32_t frameIndex)
 {
+    // The frame's fence has been waited so its uploads are done
+    m_frameIndex = frameIndex;
+    for (HostSlot& slot : m_hostSlots)
+    {
+        if (slot.state == HostSlotState::InFlight && slot.frameIndex == frameIndex)
+        {
+            slot.state = HostSlotState::Free;
+        }
+    }
+}
+
+FrameGraph::Resource Interop::importSharedImage(FrameGraph& graph)
+{
+    if (m_transport == InteropTransport::HostCopy)
+    {
+        // The previous frames on this queue sampled the image, the upload only has to wait for them
+        const FrameGraph::Resource image =
+            graph.importImage(m_sharedImage, VK_IMAGE_ASPECT_COLOR_BIT, {c_previousReadStages, 0, m_readLayout});
+        addHostUploadPass(graph, image);
+        return image;
+    }
+
     CHECK(m_stateIsGLWrite);
+    markVKRead();
+    // Without new content the image was last released to GL by Vulkan itself, it's acquired back the same way
+    return graph.importImage(m_sharedImage, VK_IMAGE_ASPECT_COLOR_BIT, {m_writeStage, m_writeAccess, m_writeLayout}, true);
+}
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = m_sharedImage;
-    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.layerCount = 1;
-    const VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    const VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    vkCmdPipelineBarrier(cb, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+void Interop::exportSharedImage(FrameGraph& graph, FrameGraph::Resource image)
+{
+    if (m_transport == InteropTransport::HostCopy)
+    {
+        // Passthrough leaves the image in a transfer layout, the next frame imports it in the read layout
+        if (graph.getLayout(image) != m_readLayout)
+        {
+            graph.exportResource(image, {c_previousReadStages, 0, m_readLayout});
+        }
+        // Host copies arrive a few frames late, the first of them after a scale change are upscaled with the new extent
+        updateRenderExtent();
+        m_damage.clear();
+        return;
+    }
+
+    CHECK(!m_stateIsGLWrite);
+
+    // This frame still reads the old image, GL writes the new one from the next frame on
+    const bool resized = m_requestedExtent.width != m_extent.width || m_requestedExtent.height != m_extent.height;
+    if (resized)
+    {
+        retireSharedImage();
+        m_extent = m_requestedExtent;
+        createSharedImage();
+        ++m_generation;
+        image = graph.importImage(m_sharedImage, VK_IMAGE_ASPECT_COLOR_BIT, {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED});
+        if (m_depthSharing)
+        {
+            const FrameGraph::Resource depth =
+                graph.importImage(m_sharedDepthImage, VK_IMAGE_ASPECT_DEPTH_BIT, {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED});
+            graph.exportResource(depth, c_sharedDepthWriteState, true);
+        }
+    }
+    graph.exportResource(image, {m_writeStage, m_writeAccess, m_writeLayout}, true);
+
+    markGLWrite();
+}
+
+FrameGraph::Access Interop::getSharedImageReadAccess(VkPipelineStageFlags stages) const
+{
+    const VkAccessFlags access = (stages & VK_PIPELINE_STAGE_HOST_BIT) ? VK_ACCESS_HOST_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+    return {stages, access, m_readLayout};
+}
+
+bool Interop::isDepthSharing() const
+{
+    return m_depthSharing;
+}
+
+FrameGraph::Resource Interop::importSharedDepth(FrameGraph& graph)
+{
+    CHECK(m_depthSharing && !m_stateIsGLWrite);
+    return graph.importImage(m_sharedDepthImage, VK_IMAGE_ASPECT_DEPTH_BIT, c_sharedDepthWriteState, true);
+}
+
+void Interop::exportSharedDepth(FrameGraph& graph, FrameGraph::Resource depth)
+{
+    CHECK(m_depthSharing && !m_stateIsGLWrite);
+    graph.exportResource(depth, c_sharedDepthWriteState, true);
+}
+
+bool Interop::canReuseSharedImageBarriers() const
+{
+    const bool resizePending = m_requestedExtent.width != m_extent.width || m_requestedExtent.height != m_extent.height;
+    return m_transport == InteropTransport::ExternalMemory && !resizePending;
+}
+
+void Interop::reuseSharedImageBarriers()
+{
+    CHECK(canReuseSharedImageBarriers() && m_stateIsGLWrite);
+    markVKRead();
+    markGLWrite();
+}
 
+void Interop::markVKRead()
+{
+    m_frameHasNewContent = m_consumedGeneration != m_contentGeneration;
+    m_consumedGeneration = m_contentGeneration;
     m_stateIsGLWrite = false;
 }
 
-HANDLE Interop::getGLCompleteHandle() const
+void Interop::markGLWrite()
+{
+    updateRenderExtent();
+    m_damage.clear();
+    m_stateIsGLWrite = true;
+}
+
+void Interop::addFrameSemaphores(Context::WaitAndSignalInfo& waitAndSignalInfo, VkPipelineStageFlags waitStage) const
+{
+    if (m_transport == InteropTransport::HostCopy)
+    {
+        return;
+    }
+
+    // GL didn't write since the previous frame and hasn't waited for it yet. This frame reads the image too, so
+    // it consumes the previous frame's signal and GL waits for this one instead.
+    waitAndSignalInfo.waitStages.push_back(waitStage);
+    waitAndSignalInfo.waitSemaphores.push_back(m_frameHasNewContent ? m_glCompleteSemaphore : m_vulkanCompleteSemaphore);
+    waitAndSignalInfo.signalSemaphores.push_back(m_vulkanCompleteSemaphore);
+}
+
+void Interop::publishContent()
+{
+    CHECK(m_transport == InteropTransport::ExternalMemory);
+    ++m_contentGeneration;
+}
+
+uint64_t Interop::getContentGeneration() const
+{
+    return m_contentGeneration;
+}
+
+void* Interop::acquireHostWriteSlot()
+{
+    CHECK(m_transport == InteropTransport::HostCopy && m_hostWriteSlot == -1);
+
+    int oldestWritten = -1;
+    for (size_t i = 0; i < m_hostSlots.size(); ++i)
+    {
+        const HostSlot& slot = m_hostSlots[i];
+        if (slot.state == HostSlotState::Free)
+        {
+            m_hostWriteSlot = static_cast<int>(i);
+            break;
+        }
+        if (slot.state == HostSlotState::Written && (oldestWritten == -1 || slot.sequence < m_hostSlots[oldestWritten].sequence))
+        {
+            oldestWritten = static_cast<int>(i);
+        }
+    }
+
+    // Vulkan hasn't kept up, replace the oldest frame it hasn't picked yet
+    if (m_hostWriteSlot == -1 && oldestWritten != -1)
+    {
+        m_hostWriteSlot = oldestWritten;
+        ++m_hostFramesDropped;
+    }
+
+    if (m_hostWriteSlot == -1)
+    {
+        ++m_hostFramesDropped;
+        return nullptr;
+    }
+
+    HostSlot& slot = m_hostSlots[m_hostWriteSlot];
+    slot.state = HostSlotState::Writing;
+    return slot.data;
+}
+
+void Interop::submitHostWriteSlot()
+{
+    CHECK(m_hostWriteSlot != -1);
+
+    HostSlot& slot = m_hostSlots[m_hostWriteSlot];
+    slot.state = HostSlotState::Written;
+    slot.sequence = ++m_hostSequence;
+    m_hostWriteSlot = -1;
+    ++m_contentGeneration;
+}
+
+uint64_t Interop::getHostFrameSize() const
+{
+    return uint64_t(m_extent.width) * m_extent.height * 4;
+}
+
+void Interop::printStatistics(double seconds, uint64_t frames)
+{
+    printf("Interop %s: %.1f fps, %.2f ms/frame", getTransportName(m_transport), frames / seconds, frames > 0 ? seconds * 1000.0 / frames : 0.0);
+    if (m_transport == InteropTransport::HostCopy)
+    {
+        const double megabytes = double(m_hostFramesUploaded * getHostFrameSize()) / (1024.0 * 1024.0);
+        printf(", %.1f MB/s uploaded, %llu frames dropped", megabytes / seconds, static_cast<unsigned long long>(m_hostFramesDropped));
+    }
+    printf("\n");
+
+    m_hostFramesUploaded = 0;
+    m_hostFramesDropped = 0;
+}
+
+bool Interop::isResizable() const
+{
+    return m_resizable;
+}
+
+void Interop::requestResize(VkExtent2D extent)
+{
+    CHECK(m_resizable && extent.width > 0 && extent.height > 0);
+    m_requestedExtent = extent;
+    if (m_sharedImageFormat == SharedImageFormat::Nv12)
+    {
+        // The chroma plane is half the size in both directions
+        m_requestedExtent.width = std::max(extent.width & ~1u, 2u);
+        m_requestedExtent.height = std::max(extent.height & ~1u, 2u);
+    }
+}
+
+uint64_t Interop::getSharedImageGeneration() const
+{
+    return m_generation;
+}
+
+VkExtent2D Interop::getSharedImageExtent() const
+{
+    return m_extent;
+}
+
+bool Interop::isRenderScaling() const
+{
+    return m_renderScaling;
+}
+
+void Interop::setRenderScale(float scale)
+{
+    CHECK(m_renderScaling);
+    m_renderScale = std::clamp(scale, c_minRenderScale, 1.0f);
+}
+
+float Interop::getRenderScale() const
+{
+    return m_renderScale;
+}
+
+VkExtent2D Interop::getRenderExtent() const
+{
+    return m_renderExtent;
+}
+
+bool Interop::isDamageTracking() const
+{
+    return m_damageTracking;
+}
+
+void Interop::addDamage(const VkRect2D& rect)
+{
+    CHECK(m_damageTracking);
+    const int32_t left = std::max(rect.offset.x, 0);
+    const int32_t top = std::max(rect.offset.y, 0);
+    const int32_t right = std::min(rect.offset.x + int32_t(rect.extent.width), int32_t(m_extent.width));
+    const int32_t bottom = std::min(rect.offset.y + int32_t(rect.extent.height), int32_t(m_extent.height));
+    if (left < right && top < bottom)
+    {
+        m_damage.push_back(VkRect2D{{left, top}, {uint32_t(right - left), uint32_t(bottom - top)}});
+    }
+}
+
+std::vector<VkRect2D> Interop::getDamage() const
+{
+    if (!m_damageTracking || m_transport == InteropTransport::HostCopy)
+    {
+        return {VkRect2D{{0, 0}, m_extent}};
+    }
+    return m_damage;
+}
+
+bool Interop::isSharedImageHostAccessible() const
+{
+    return m_hostAccessible;
+}
+
+Interop::HostImage Interop::getSharedImageHostMapping() const
+{
+    CHECK(m_hostAccessible);
+
+    HostImage image{};
+    image.data = static_cast<const uint8_t*>(m_sharedImageMapping) + m_sharedImageLayout.offset;
+    image.rowPitch = m_sharedImageLayout.rowPitch;
+    image.extent = m_extent;
+    return image;
+}
+
+VkImageLayout Interop::getSharedImageReadLayout() const
+{
+    return m_readLayout;
+}
+
+SharedImageFormat Interop::getSharedImageFormat() const
+{
+    return m_sharedImageFormat;
+}
+
+VkSamplerYcbcrConversion Interop::getSharedImageYcbcrConversion() const
+{
+    return m_ycbcrConversion;
+}
+
+VkFilter Interop::getSharedImageChromaFilter() const
+{
+    return m_chromaFilter;
+}
+
+const std::array<uint8_t, VK_UUID_SIZE>& Interop::getDeviceUUID() const
+{
+    return m_deviceUUID;
+}
+
+ExternalHandle Interop::getGLCompleteHandle() const
 {
     return m_glCompleteSemaphoreHandle;
 }
 
-HANDLE Interop::getVKReadyHandle() const
+ExternalHandle Interop::getVKReadyHandle() const
 {
     return m_vulkanCompleteSemaphoreHandle;
 }
 
-HANDLE Interop::getSharedImageMemoryHandle() const
+uint32_t Interop::getSharedImageMemoryCount() const
+{
+    return ui32Size(m_sharedImageMemories);
+}
+
+ExternalHandle Interop::getSharedImageMemoryHandle(uint32_t index) const
 {
-    return m_sharedImageMemoryHandle;
+    return m_sharedImageMemories[index].handle;
 }
 
-uint64_t Interop::getSharedImageMemorySize() const
+uint64_t Interop::getSharedImageMemorySize(uint32_t index) const
 {
-    return m_sharedImageMemorySize;
+    return m_sharedImageMemories[index].size;
 }
 
 VkSemaphore Interop::getGLCompleteSemaphore() const
@@ -104,49 +511,207 @@ VkImageView Interop::getSharedImageView() const
     return m_sharedImageView;
 }
 
-void Interop::createInteropSemaphores()
+ExternalHandle Interop::getSharedDepthMemoryHandle() const
+{
+    return m_sharedDepthMemory.handle;
+}
+
+uint64_t Interop::getSharedDepthMemorySize() const
 {
-    auto vkGetPhysicalDeviceExternalSemaphorePropertiesKHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetPhysicalDeviceExternalSemaphorePropertiesKHR");
-    auto vkGetPhysicalDeviceExternalSemaphorePropertiesKHR = PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR(vkGetPhysicalDeviceExternalSemaphorePropertiesKHRAddr);
-    CHECK(vkGetPhysicalDeviceExternalSemaphorePropertiesKHR);
+    return m_sharedDepthMemory.size;
+}
 
-    const std::vector<VkExternalSemaphoreHandleTypeFlagBits> flags{
-        VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
-        VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_BIT,
-        VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_KMT_BIT,
-        VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_D3D12_FENCE_BIT,
-        VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT};
+VkImageView Interop::getSharedDepthView() const
+{
+    return m_sharedDepthView;
+}
 
-    VkPhysicalDeviceExternalSemaphoreInfo externalSemaphoreInfo{};
-    externalSemaphoreInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
-    externalSemaphoreInfo.pNext = nullptr;
+bool Interop::isNv12Supported(const Settings& settings)
+{
+    if (settings.readback || settings.transport == InteropTransport::HostCopy)
+    {
+        printf("Interop: NV12 shared image can't be used with readback or the host copy transport\n");
+        return false;
+    }
+    if (!m_context.isDeviceExtensionEnabled(VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME))
+    {
+        printf("Interop: sampler YCbCr conversion is not available\n");
+        return false;
+    }
 
-    VkExternalSemaphoreProperties externalSemaphoreProperties{};
-    externalSemaphoreProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
-    externalSemaphoreProperties.pNext = nullptr;
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, &formatProperties);
+    const VkFormatFeatureFlags features = formatProperties.optimalTilingFeatures;
+    const VkFormatFeatureFlags chromaLocations = VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT | VK_FORMAT_FEATURE_COSITED_CHROMA_SAMPLES_BIT;
+    if (!(features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) || !(features & VK_FORMAT_FEATURE_DISJOINT_BIT) || !(features & chromaLocations))
+    {
+        printf("Interop: NV12 images can't be sampled from disjoint memory\n");
+        return false;
+    }
+    return true;
+}
 
-    bool found = false;
+bool Interop::isHostAccessSupported() const
+{
     VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
-    VkExternalSemaphoreHandleTypeFlagBits compatibleSemaphoreType;
-    for (size_t i = 0; i < flags.size(); ++i)
+
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, m_sharedImageVkFormat, &formatProperties);
+    const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    VkImageFormatProperties imageFormatProperties{};
+    const VkResult result = vkGetPhysicalDeviceImageFormatProperties(physicalDevice, m_sharedImageVkFormat, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR, m_sharedImageUsage, m_sharedImageFlags, &imageFormatProperties);
+
+    if ((formatProperties.linearTilingFeatures & requiredFeatures) != requiredFeatures || result != VK_SUCCESS || //
+        imageFormatProperties.maxExtent.width < m_extent.width || imageFormatProperties.maxExtent.height < m_extent.height)
     {
-        externalSemaphoreInfo.handleType = flags[i];
+        printf("Interop: linear shared image is not supported, it can't be mapped\n");
+        return false;
+    }
+    return true;
+}
+
+bool Interop::isExternalSharingSupported()
+{
+    for (const char* extension : c_interopDeviceExtensions)
+    {
+        if (!m_context.isDeviceExtensionEnabled(extension))
+        {
+            printf("Interop: %s is not available\n", extension);
+            return false;
+        }
+    }
+
+    VkInstance instance = m_context.getInstance();
+    VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+
+    { // Semaphore export
+        auto vkGetPhysicalDeviceExternalSemaphorePropertiesKHRAddr = vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceExternalSemaphorePropertiesKHR");
+        auto vkGetPhysicalDeviceExternalSemaphorePropertiesKHR = PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR(vkGetPhysicalDeviceExternalSemaphorePropertiesKHRAddr);
+        CHECK(vkGetPhysicalDeviceExternalSemaphorePropertiesKHR);
+
+        VkPhysicalDeviceExternalSemaphoreInfo externalSemaphoreInfo{};
+        externalSemaphoreInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
+        externalSemaphoreInfo.handleType = c_externalSemaphoreHandleType;
+
+        VkExternalSemaphoreProperties externalSemaphoreProperties{};
+        externalSemaphoreProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
+
         vkGetPhysicalDeviceExternalSemaphorePropertiesKHR(physicalDevice, &externalSemaphoreInfo, &externalSemaphoreProperties);
-        if (externalSemaphoreProperties.compatibleHandleTypes & flags[i] && //
-            externalSemaphoreProperties.externalSemaphoreFeatures & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT)
+        if (!(externalSemaphoreProperties.compatibleHandleTypes & c_externalSemaphoreHandleType) || //
+            !(externalSemaphoreProperties.externalSemaphoreFeatures & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT))
         {
-            compatibleSemaphoreType = flags[i];
-            found = true;
-            break;
+            printf("Interop: semaphores can't be exported\n");
+            return false;
         }
     }
 
-    CHECK(found);
+    { // Image memory export
+        auto vkGetPhysicalDeviceImageFormatProperties2KHRAddr = vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceImageFormatProperties2KHR");
+        auto vkGetPhysicalDeviceImageFormatProperties2KHR = PFN_vkGetPhysicalDeviceImageFormatProperties2KHR(vkGetPhysicalDeviceImageFormatProperties2KHRAddr);
+        CHECK(vkGetPhysicalDeviceImageFormatProperties2KHR);
+
+        VkPhysicalDeviceExternalImageFormatInfo externalImageFormatInfo{};
+        externalImageFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+        externalImageFormatInfo.handleType = c_externalMemoryHandleType;
+
+        VkPhysicalDeviceImageFormatInfo2 imageFormatInfo{};
+        imageFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+        imageFormatInfo.pNext = &externalImageFormatInfo;
+        imageFormatInfo.format = m_sharedImageVkFormat;
+        imageFormatInfo.type = VK_IMAGE_TYPE_2D;
+        imageFormatInfo.tiling = m_hostAccessible ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
+        imageFormatInfo.usage = m_sharedImageUsage;
+        imageFormatInfo.flags = m_sharedImageFlags;
+
+        VkExternalImageFormatProperties externalImageFormatProperties{};
+        externalImageFormatProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+
+        VkImageFormatProperties2 imageFormatProperties{};
+        imageFormatProperties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+        imageFormatProperties.pNext = &externalImageFormatProperties;
 
+        const VkResult result = vkGetPhysicalDeviceImageFormatProperties2KHR(physicalDevice, &imageFormatInfo, &imageFormatProperties);
+        const VkExternalMemoryFeatureFlags features = externalImageFormatProperties.externalMemoryProperties.externalMemoryFeatures;
+        if (result != VK_SUCCESS || !(features & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT))
+        {
+            printf("Interop: image memory can't be exported\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Interop::isDepthSharingSupported() const
+{
+    if (m_transport != InteropTransport::ExternalMemory)
+    {
+        printf("Interop: depth can only be shared through external memory\n");
+        return false;
+    }
+
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), c_sharedDepthFormat, &formatProperties);
+    const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    auto vkGetPhysicalDeviceImageFormatProperties2KHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetPhysicalDeviceImageFormatProperties2KHR");
+    auto vkGetPhysicalDeviceImageFormatProperties2KHR = PFN_vkGetPhysicalDeviceImageFormatProperties2KHR(vkGetPhysicalDeviceImageFormatProperties2KHRAddr);
+    CHECK(vkGetPhysicalDeviceImageFormatProperties2KHR);
+
+    VkPhysicalDeviceExternalImageFormatInfo externalImageFormatInfo{};
+    externalImageFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+    externalImageFormatInfo.handleType = c_externalMemoryHandleType;
+
+    VkPhysicalDeviceImageFormatInfo2 imageFormatInfo{};
+    imageFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+    imageFormatInfo.pNext = &externalImageFormatInfo;
+    imageFormatInfo.format = c_sharedDepthFormat;
+    imageFormatInfo.type = VK_IMAGE_TYPE_2D;
+    imageFormatInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageFormatInfo.usage = c_sharedDepthUsage;
+
+    VkExternalImageFormatProperties externalImageFormatProperties{};
+    externalImageFormatProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+
+    VkImageFormatProperties2 imageFormatProperties{};
+    imageFormatProperties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+    imageFormatProperties.pNext = &externalImageFormatProperties;
+
+    const VkResult result = vkGetPhysicalDeviceImageFormatProperties2KHR(m_context.getPhysicalDevice(), &imageFormatInfo, &imageFormatProperties);
+    const VkExternalMemoryFeatureFlags features = externalImageFormatProperties.externalMemoryProperties.externalMemoryFeatures;
+    if ((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures || result != VK_SUCCESS ||
+        !(features & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT))
+    {
+        printf("Interop: depth images can't be exported, depth isn't shared\n");
+        return false;
+    }
+    return true;
+}
+
+void Interop::queryDeviceUUID()
+{
+    auto vkGetPhysicalDeviceProperties2KHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetPhysicalDeviceProperties2KHR");
+    auto vkGetPhysicalDeviceProperties2KHR = PFN_vkGetPhysicalDeviceProperties2KHR(vkGetPhysicalDeviceProperties2KHRAddr);
+    CHECK(vkGetPhysicalDeviceProperties2KHR);
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &idProperties;
+
+    vkGetPhysicalDeviceProperties2KHR(m_context.getPhysicalDevice(), &properties);
+    std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), m_deviceUUID.begin());
+}
+
+void Interop::createInteropSemaphores()
+{
     VkExportSemaphoreCreateInfo exportSemaphoreCreateInfo{};
     exportSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
     exportSemaphoreCreateInfo.pNext = nullptr;
-    exportSemaphoreCreateInfo.handleTypes = VkExternalSemaphoreHandleTypeFlags(compatibleSemaphoreType);
+    exportSemaphoreCreateInfo.handleTypes = VkExternalSemaphoreHandleTypeFlags(c_externalSemaphoreHandleType);
 
     VkSemaphoreCreateInfo semaphoreCreateInfo{};
     semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -155,120 +720,481 @@ void Interop::createInteropSemaphores()
     VK_CHECK(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_glCompleteSemaphore));
     VK_CHECK(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_vulkanCompleteSemaphore));
 
-    // VkSemaphoreGetFdInfoKHR for Linux
+#ifdef _WIN32
     VkSemaphoreGetWin32HandleInfoKHR semaphoreGetHandleInfo{};
     semaphoreGetHandleInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_WIN32_HANDLE_INFO_KHR;
-    semaphoreGetHandleInfo.pNext = nullptr;
-    semaphoreGetHandleInfo.semaphore = VK_NULL_HANDLE;
-    semaphoreGetHandleInfo.handleType = compatibleSemaphoreType;
+    semaphoreGetHandleInfo.handleType = c_externalSemaphoreHandleType;
 
-    // vkGetSemaphoreFdKHR for Linux
-    auto vkGetSemaphoreWin32HandleKHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetSemaphoreWin32HandleKHR");
-    auto vkGetSemaphoreWin32HandleKHR = PFN_vkGetSemaphoreWin32HandleKHR(vkGetSemaphoreWin32HandleKHRAddr);
-    CHECK(vkGetSemaphoreWin32HandleKHR);
+    auto vkGetSemaphoreHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetSemaphoreWin32HandleKHR");
+    auto vkGetSemaphoreHandle = PFN_vkGetSemaphoreWin32HandleKHR(vkGetSemaphoreHandleAddr);
+#else
+    VkSemaphoreGetFdInfoKHR semaphoreGetHandleInfo{};
+    semaphoreGetHandleInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+    semaphoreGetHandleInfo.handleType = c_externalSemaphoreHandleType;
+
+    auto vkGetSemaphoreHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetSemaphoreFdKHR");
+    auto vkGetSemaphoreHandle = PFN_vkGetSemaphoreFdKHR(vkGetSemaphoreHandleAddr);
+#endif
+    CHECK(vkGetSemaphoreHandle);
 
     semaphoreGetHandleInfo.semaphore = m_vulkanCompleteSemaphore;
-    VK_CHECK(vkGetSemaphoreWin32HandleKHR(m_device, &semaphoreGetHandleInfo, &m_vulkanCompleteSemaphoreHandle));
+    VK_CHECK(vkGetSemaphoreHandle(m_device, &semaphoreGetHandleInfo, &m_vulkanCompleteSemaphoreHandle));
 
     semaphoreGetHandleInfo.semaphore = m_glCompleteSemaphore;
-    VK_CHECK(vkGetSemaphoreWin32HandleKHR(m_device, &semaphoreGetHandleInfo, &m_glCompleteSemaphoreHandle));
+    VK_CHECK(vkGetSemaphoreHandle(m_device, &semaphoreGetHandleInfo, &m_glCompleteSemaphoreHandle));
 }
 
-void Interop::createInteropTexture()
+void Interop::createYcbcrConversion()
+{
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), m_sharedImageVkFormat, &formatProperties);
+    const VkFormatFeatureFlags features = formatProperties.optimalTilingFeatures;
+    const VkChromaLocation chromaLocation = (features & VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT) ? VK_CHROMA_LOCATION_MIDPOINT : VK_CHROMA_LOCATION_COSITED_EVEN;
+    m_chromaFilter = (features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_YCBCR_CONVERSION_LINEAR_FILTER_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+    // Matches the BT.601 limited range conversion done by rgbaToNv12
+    VkSamplerYcbcrConversionCreateInfo conversionInfo{};
+    conversionInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO;
+    conversionInfo.format = m_sharedImageVkFormat;
+    conversionInfo.ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_601;
+    conversionInfo.ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_NARROW;
+    conversionInfo.components = VkComponentMapping{VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+    conversionInfo.xChromaOffset = chromaLocation;
+    conversionInfo.yChromaOffset = chromaLocation;
+    conversionInfo.chromaFilter = m_chromaFilter;
+    conversionInfo.forceExplicitReconstruction = VK_FALSE;
+
+    auto vkCreateSamplerYcbcrConversionKHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkCreateSamplerYcbcrConversionKHR");
+    auto vkCreateSamplerYcbcrConversionKHR = PFN_vkCreateSamplerYcbcrConversionKHR(vkCreateSamplerYcbcrConversionKHRAddr);
+    CHECK(vkCreateSamplerYcbcrConversionKHR);
+    VK_CHECK(vkCreateSamplerYcbcrConversionKHR(m_device, &conversionInfo, nullptr, &m_ycbcrConversion));
+}
+
+VkMemoryRequirements Interop::getSharedImageMemoryRequirements(uint32_t index) const
 {
-    // VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR for Linux
-    const VkExternalMemoryHandleTypeFlags handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT_KHR;
+    if (!(m_sharedImageFlags & VK_IMAGE_CREATE_DISJOINT_BIT))
+    {
+        VkMemoryRequirements memRequirements{};
+        vkGetImageMemoryRequirements(m_device, m_sharedImage, &memRequirements);
+        return memRequirements;
+    }
+
+    auto vkGetImageMemoryRequirements2KHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetImageMemoryRequirements2KHR");
+    auto vkGetImageMemoryRequirements2KHR = PFN_vkGetImageMemoryRequirements2KHR(vkGetImageMemoryRequirements2KHRAddr);
+    CHECK(vkGetImageMemoryRequirements2KHR);
 
+    VkImagePlaneMemoryRequirementsInfo planeInfo{};
+    planeInfo.sType = VK_STRUCTURE_TYPE_IMAGE_PLANE_MEMORY_REQUIREMENTS_INFO;
+    planeInfo.planeAspect = c_nv12PlaneAspects[index];
+
+    VkImageMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.pNext = &planeInfo;
+    requirementsInfo.image = m_sharedImage;
+
+    VkMemoryRequirements2 memRequirements{};
+    memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetImageMemoryRequirements2KHR(m_device, &requirementsInfo, &memRequirements);
+    return memRequirements.memoryRequirements;
+}
+
+void Interop::createSharedImage()
+{
     { // Create Image
         VkExternalMemoryImageCreateInfo externalMemoryCreateInfo{};
         externalMemoryCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
-        externalMemoryCreateInfo.handleTypes = handleType;
+        externalMemoryCreateInfo.handleTypes = c_externalMemoryHandleType;
 
         VkImageCreateInfo imageCreateInfo{};
         imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageCreateInfo.pNext = &externalMemoryCreateInfo;
+        imageCreateInfo.pNext = m_externalSharingSupported ? &externalMemoryCreateInfo : nullptr;
+        imageCreateInfo.flags = m_sharedImageFlags;
         imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageCreateInfo.format = m_sharedImageVkFormat;
         imageCreateInfo.mipLevels = 1;
         imageCreateInfo.arrayLayers = 1;
         imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageCreateInfo.extent.depth = 1;
-        imageCreateInfo.extent.width = c_windowWidth;
-        imageCreateInfo.extent.height = c_windowHeight;
-        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCreateInfo.extent.width = m_extent.width;
+        imageCreateInfo.extent.height = m_extent.height;
+        imageCreateInfo.tiling = m_hostAccessible ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = m_sharedImageUsage;
         VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_sharedImage));
     }
 
-    { // Allocate and bind memory
-        VkMemoryRequirements memRequirements{};
-        vkGetImageMemoryRequirements(m_device, m_sharedImage, &memRequirements);
+    { // Allocate and bind memory, disjoint images get one allocation per plane
+        const uint32_t memoryCount = m_sharedImageFormat == SharedImageFormat::Nv12 ? ui32Size(c_nv12PlaneAspects) : 1;
+        m_sharedImageMemories.resize(memoryCount, SharedMemory{VK_NULL_HANDLE, 0, c_invalidExternalHandle});
 
         VkExportMemoryAllocateInfo exportAllocInfo{};
         exportAllocInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
         exportAllocInfo.pNext = nullptr;
-        exportAllocInfo.handleTypes = handleType;
+        exportAllocInfo.handleTypes = c_externalMemoryHandleType;
 
-        const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        CHECK(memoryTypeResult.found);
+        VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+        for (SharedMemory& sharedMemory : m_sharedImageMemories)
+        {
+            const VkMemoryRequirements memRequirements = getSharedImageMemoryRequirements(uint32_t(&sharedMemory - m_sharedImageMemories.data()));
 
-        VkMemoryAllocateInfo memAllocInfo{};
-        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAllocInfo.pNext = &exportAllocInfo;
-        memAllocInfo.allocationSize = memRequirements.size;
-        memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
-        m_sharedImageMemorySize = memRequirements.size;
+            MemoryTypeResult memoryTypeResult{};
+            if (m_hostAccessible)
+            {
+                // Cached memory makes the in-place reads considerably faster where available
+                const VkMemoryPropertyFlags coherentProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, coherentProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+                if (!memoryTypeResult.found)
+                {
+                    memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, coherentProperties);
+                }
+            }
+            else
+            {
+                memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            }
+            CHECK(memoryTypeResult.found);
 
-        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &m_sharedImageMemory));
-        VK_CHECK(vkBindImageMemory(m_device, m_sharedImage, m_sharedImageMemory, 0));
+            VkMemoryAllocateInfo memAllocInfo{};
+            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            memAllocInfo.pNext = m_externalSharingSupported ? &exportAllocInfo : nullptr;
+            memAllocInfo.allocationSize = memRequirements.size;
+            memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+            sharedMemory.size = memRequirements.size;
+
+            VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &sharedMemory.memory));
+        }
+
+        if (m_sharedImageFlags & VK_IMAGE_CREATE_DISJOINT_BIT)
+        {
+            auto vkBindImageMemory2KHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkBindImageMemory2KHR");
+            auto vkBindImageMemory2KHR = PFN_vkBindImageMemory2KHR(vkBindImageMemory2KHRAddr);
+            CHECK(vkBindImageMemory2KHR);
+
+            std::array<VkBindImagePlaneMemoryInfo, c_nv12PlaneAspects.size()> planeInfos{};
+            std::array<VkBindImageMemoryInfo, c_nv12PlaneAspects.size()> bindInfos{};
+            for (size_t i = 0; i < bindInfos.size(); ++i)
+            {
+                planeInfos[i].sType = VK_STRUCTURE_TYPE_BIND_IMAGE_PLANE_MEMORY_INFO;
+                planeInfos[i].planeAspect = c_nv12PlaneAspects[i];
+
+                bindInfos[i].sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO;
+                bindInfos[i].pNext = &planeInfos[i];
+                bindInfos[i].image = m_sharedImage;
+                bindInfos[i].memory = m_sharedImageMemories[i].memory;
+                bindInfos[i].memoryOffset = 0;
+            }
+            VK_CHECK(vkBindImageMemory2KHR(m_device, ui32Size(bindInfos), bindInfos.data()));
+        }
+        else
+        {
+            VK_CHECK(vkBindImageMemory(m_device, m_sharedImage, m_sharedImageMemories[0].memory, 0));
+        }
+
+        if (m_hostAccessible)
+        {
+            const VkImageSubresource subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
+            vkGetImageSubresourceLayout(m_device, m_sharedImage, &subresource, &m_sharedImageLayout);
+            VK_CHECK(vkMapMemory(m_device, m_sharedImageMemories[0].memory, 0, VK_WHOLE_SIZE, 0, &m_sharedImageMapping));
+            printf("Interop: linear shared image, row pitch %llu bytes\n", static_cast<unsigned long long>(m_sharedImageLayout.rowPitch));
+        }
     }
 
-    { // Get memory handle
-        // vkGetMemoryFdKHR for Linux
-        auto vkGetMemoryWin32HandleKHRAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetMemoryWin32HandleKHR");
-        auto vkGetMemoryWin32HandleKHR = PFN_vkGetMemoryWin32HandleKHR(vkGetMemoryWin32HandleKHRAddr);
-        CHECK(vkGetMemoryWin32HandleKHR);
+    if (m_externalSharingSupported)
+    { // Get memory handles
+#ifdef _WIN32
+        auto vkGetMemoryHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetMemoryWin32HandleKHR");
+        auto vkGetMemoryHandle = PFN_vkGetMemoryWin32HandleKHR(vkGetMemoryHandleAddr);
+
+        VkMemoryGetWin32HandleInfoKHR memoryGetHandleInfo{};
+        memoryGetHandleInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR;
+#else
+        auto vkGetMemoryHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetMemoryFdKHR");
+        auto vkGetMemoryHandle = PFN_vkGetMemoryFdKHR(vkGetMemoryHandleAddr);
+
+        VkMemoryGetFdInfoKHR memoryGetHandleInfo{};
+        memoryGetHandleInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+#endif
+        CHECK(vkGetMemoryHandle);
 
-        VkMemoryGetWin32HandleInfoKHR memoryFdInfo{};
-        memoryFdInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR;
-        memoryFdInfo.pNext = nullptr;
-        memoryFdInfo.memory = m_sharedImageMemory;
-        memoryFdInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT;
-        VK_CHECK(vkGetMemoryWin32HandleKHR(m_device, &memoryFdInfo, &m_sharedImageMemoryHandle));
+        for (SharedMemory& sharedMemory : m_sharedImageMemories)
+        {
+            memoryGetHandleInfo.memory = sharedMemory.memory;
+            memoryGetHandleInfo.handleType = c_externalMemoryHandleType;
+            VK_CHECK(vkGetMemoryHandle(m_device, &memoryGetHandleInfo, &sharedMemory.handle));
+        }
     }
 
     { // Create image view
+        VkSamplerYcbcrConversionInfo conversionInfo{};
+        conversionInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO;
+        conversionInfo.conversion = m_ycbcrConversion;
+
         VkImageViewCreateInfo viewCreateInfo{};
         viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCreateInfo.pNext = m_ycbcrConversion != VK_NULL_HANDLE ? &conversionInfo : nullptr;
         viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewCreateInfo.image = m_sharedImage;
-        viewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewCreateInfo.format = m_sharedImageVkFormat;
         viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
         vkCreateImageView(m_device, &viewCreateInfo, nullptr, &m_sharedImageView);
     }
 
+    if (m_depthSharing)
+    {
+        createSharedDepthImage();
+    }
+}
+
+void Interop::createSharedDepthImage()
+{
+    VkExternalMemoryImageCreateInfo externalMemoryCreateInfo{};
+    externalMemoryCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    externalMemoryCreateInfo.handleTypes = c_externalMemoryHandleType;
+
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.pNext = &externalMemoryCreateInfo;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = c_sharedDepthFormat;
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.extent = VkExtent3D{m_extent.width, m_extent.height, 1};
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = c_sharedDepthUsage;
+    VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_sharedDepthImage));
+
+    VkMemoryRequirements memRequirements{};
+    vkGetImageMemoryRequirements(m_device, m_sharedDepthImage, &memRequirements);
+    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CHECK(memoryTypeResult.found);
+
+    VkExportMemoryAllocateInfo exportAllocInfo{};
+    exportAllocInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+    exportAllocInfo.handleTypes = c_externalMemoryHandleType;
+
+    VkMemoryAllocateInfo memAllocInfo{};
+    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memAllocInfo.pNext = &exportAllocInfo;
+    memAllocInfo.allocationSize = memRequirements.size;
+    memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+    m_sharedDepthMemory.size = memRequirements.size;
+
+    VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &m_sharedDepthMemory.memory));
+    VK_CHECK(vkBindImageMemory(m_device, m_sharedDepthImage, m_sharedDepthMemory.memory, 0));
+
+#ifdef _WIN32
+    auto vkGetMemoryHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetMemoryWin32HandleKHR");
+    auto vkGetMemoryHandle = PFN_vkGetMemoryWin32HandleKHR(vkGetMemoryHandleAddr);
+
+    VkMemoryGetWin32HandleInfoKHR memoryGetHandleInfo{};
+    memoryGetHandleInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR;
+#else
+    auto vkGetMemoryHandleAddr = vkGetInstanceProcAddr(m_context.getInstance(), "vkGetMemoryFdKHR");
+    auto vkGetMemoryHandle = PFN_vkGetMemoryFdKHR(vkGetMemoryHandleAddr);
+
+    VkMemoryGetFdInfoKHR memoryGetHandleInfo{};
+    memoryGetHandleInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+#endif
+    CHECK(vkGetMemoryHandle);
+    memoryGetHandleInfo.memory = m_sharedDepthMemory.memory;
+    memoryGetHandleInfo.handleType = c_externalMemoryHandleType;
+    VK_CHECK(vkGetMemoryHandle(m_device, &memoryGetHandleInfo, &m_sharedDepthMemory.handle));
+
+    VkImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.image = m_sharedDepthImage;
+    viewCreateInfo.format = c_sharedDepthFormat;
+    viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+    VK_CHECK(vkCreateImageView(m_device, &viewCreateInfo, nullptr, &m_sharedDepthView));
+}
+
+void Interop::updateRenderExtent()
+{
+    // The shared image is allocated at full size so the scale changes without reallocating anything
+    m_renderExtent.width = std::clamp(uint32_t(float(m_extent.width) * m_renderScale + 0.5f), 1u, m_extent.width);
+    m_renderExtent.height = std::clamp(uint32_t(float(m_extent.height) * m_renderScale + 0.5f), 1u, m_extent.height);
+}
+
+void Interop::retireSharedImage()
+{
+    VkDevice device = m_device;
+    VkImage image = m_sharedImage;
+    VkImageView view = m_sharedImageView;
+    std::vector<SharedMemory> memories = m_sharedImageMemories;
+    VkImage depthImage = m_sharedDepthImage;
+    VkImageView depthView = m_sharedDepthView;
+    VkDeviceMemory depthMemory = m_sharedDepthMemory.memory;
+    m_context.deferDestroy([device, image, view, memories, depthImage, depthView, depthMemory]() {
+        vkDestroyImageView(device, view, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        for (const SharedMemory& memory : memories)
+        {
+            vkFreeMemory(device, memory.memory, nullptr);
+        }
+        vkDestroyImageView(device, depthView, nullptr);
+        vkDestroyImage(device, depthImage, nullptr);
+        vkFreeMemory(device, depthMemory, nullptr);
+    });
+    m_sharedImageMemories.clear();
+    m_sharedDepthImage = VK_NULL_HANDLE;
+    m_sharedDepthView = VK_NULL_HANDLE;
+    m_sharedDepthMemory = SharedMemory{VK_NULL_HANDLE, 0, c_invalidExternalHandle};
+}
+
+void Interop::createInteropTexture()
+{
+    createSharedImage();
+
     { // Image layout transform
+        // GL owns the shared image while it writes, every frame acquires it from the external queue family
+        const bool external = m_transport == InteropTransport::ExternalMemory;
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.srcQueueFamilyIndex = external ? m_context.getGraphicsQueueFamily() : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = external ? VK_QUEUE_FAMILY_EXTERNAL : VK_QUEUE_FAMILY_IGNORED;
         barrier.image = m_sharedImage;
         barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = m_writeAccess;
         barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        barrier.newLayout = m_writeLayout;
         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         barrier.subresourceRange.levelCount = 1;
         barrier.subresourceRange.layerCount = 1;
 
+        std::vector<VkImageMemoryBarrier> barriers{barrier};
+        VkPipelineStageFlags destinationStage = m_writeStage;
+        if (m_depthSharing)
+        {
+            barrier.image = m_sharedDepthImage;
+            barrier.dstAccessMask = c_sharedDepthWriteState.access;
+            barrier.newLayout = c_sharedDepthWriteState.layout;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            barriers.push_back(barrier);
+            destinationStage |= c_sharedDepthWriteState.stages;
+        }
         const VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        const VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
         const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
 
-        vkCmdPipelineBarrier(command.commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        vkCmdPipelineBarrier(command.commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, ui32Size(barriers), barriers.data());
 
         endSingleTimeCommands(m_context.getGraphicsQueue(), command, m_vulkanCompleteSemaphore);
 
         m_stateIsGLWrite = true;
     }
 }
+
+void Interop::createHostTransport()
+{
+    VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    const uint64_t frameSize = getHostFrameSize();
+
+    m_hostSlots.resize(c_hostTransportDepth);
+    for (HostSlot& slot : m_hostSlots)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = frameSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, nullptr, &slot.buffer));
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, slot.buffer, &memRequirements);
+
+        const VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        const MemoryTypeResult memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+        CHECK(memoryTypeResult.found);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+        VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &slot.memory));
+        VK_CHECK(vkBindBufferMemory(m_device, slot.buffer, slot.memory, 0));
+        VK_CHECK(vkMapMemory(m_device, slot.memory, 0, frameSize, 0, &slot.data));
+
+        slot.state = HostSlotState::Free;
+        slot.sequence = 0;
+        slot.frameIndex = 0;
+    }
+
+    { // Cleared and kept in shader read layout until the first frame arrives
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_sharedImage;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+
+        vkCmdPipelineBarrier(command.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        const VkClearColorValue clearColor{};
+        vkCmdClearColorImage(command.commandBuffer, m_sharedImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &barrier.subresourceRange);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = m_readLayout;
+        vkCmdPipelineBarrier(command.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        endSingleTimeCommands(m_context.getGraphicsQueue(), command, VK_NULL_HANDLE);
+
+        m_stateIsGLWrite = false;
+    }
+}
+
+void Interop::addHostUploadPass(FrameGraph& graph, FrameGraph::Resource image)
+{
+    // Only the newest finished frame is uploaded, older ones are dropped
+    int newest = -1;
+    for (size_t i = 0; i < m_hostSlots.size(); ++i)
+    {
+        const HostSlot& slot = m_hostSlots[i];
+        if (slot.state == HostSlotState::Written && (newest == -1 || slot.sequence > m_hostSlots[newest].sequence))
+        {
+            newest = static_cast<int>(i);
+        }
+    }
+    for (size_t i = 0; i < m_hostSlots.size(); ++i)
+    {
+        HostSlot& slot = m_hostSlots[i];
+        if (slot.state == HostSlotState::Written && static_cast<int>(i) != newest)
+        {
+            slot.state = HostSlotState::Free;
+            ++m_hostFramesDropped;
+        }
+    }
+
+    if (newest == -1)
+    {
+        // Nothing new from GL, the previous upload is still valid
+        return;
+    }
+
+    HostSlot& slot = m_hostSlots[newest];
+    slot.state = HostSlotState::InFlight;
+    slot.frameIndex = m_frameIndex;
+    ++m_hostFramesUploaded;
+
+    VkImage sharedImage = m_sharedImage;
+    VkBuffer buffer = slot.buffer;
+    const VkExtent2D extent = m_extent;
+    const FrameGraph::Pass pass = graph.addPass("Host upload", [sharedImage, buffer, extent](VkCommandBuffer cb) {
+        VkBufferImageCopy region{};
+        region.imageSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = VkExtent3D{extent.width, extent.height, 1};
+        vkCmdCopyBufferToImage(cb, buffer, sharedImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    });
+    // The copy replaces the whole image
+    graph.write(pass, image, {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL}, true);
+}
@@ -1,41 +1,203 @@
 #pragma once
 
 #include "Context.hpp"
+#include "FrameGraph.hpp"
+#include "InteropEndpoint.hpp"
+#include "Settings.hpp"
 #include <vulkan/vulkan.h>
-#include <windows.h>
+#include <array>
+#include <vector>
 
-class Interop final
+class Interop final : public InteropEndpoint
 {
 public:
-    Interop(Context& context);
+    struct HostImage
+    {
+        const uint8_t* data;
+        uint64_t rowPitch;
+        VkExtent2D extent;
+    };
+
+    Interop(Context& context, const Settings& settings);
     ~Interop();
 
-    void transformSharedImageForGLWrite(VkCommandBuffer cb);
-    void transformSharedImageForVKRead(VkCommandBuffer cb);
+    InteropTransport getTransport() const override;
+    // Called by the GL side before the first frame when it can't import the shared image
+    void fallbackToHostCopy(const char* reason) override;
+
+    void beginFrame(uint32_t frameIndex);
+    // Imports the shared image into the frame's graph in the state GL left it in, with host copies the upload is
+    // the first pass. The frame's passes read it with getSharedImageReadAccess(). exportSharedImage() hands it
+    // back to GL once the passes are executed. With external memory the image is acquired from and released to
+    // VK_QUEUE_FAMILY_EXTERNAL around the frame.
+    FrameGraph::Resource importSharedImage(FrameGraph& graph);
+    void exportSharedImage(FrameGraph& graph, FrameGraph::Resource image);
+    FrameGraph::Access getSharedImageReadAccess(VkPipelineStageFlags stages) const;
+    // With shared depth GL also renders into a depth image of the shared image's size. It is acquired and released
+    // together with the shared image and covered by the same semaphores, it's imported after the shared image and
+    // exported before it. A resize replaces both.
+    bool isDepthSharing() const override;
+    FrameGraph::Resource importSharedDepth(FrameGraph& graph);
+    void exportSharedDepth(FrameGraph& graph, FrameGraph::Resource depth);
+    // Whether the graph derives the same shared image barriers as in the previous frame, which isn't the case with
+    // host copies or while a resize is pending. A frame that submits them again from a cached command buffer only
+    // advances the state with reuseSharedImageBarriers().
+    bool canReuseSharedImageBarriers() const;
+    void reuseSharedImageBarriers();
+    void addFrameSemaphores(Context::WaitAndSignalInfo& waitAndSignalInfo, VkPipelineStageFlags waitStage) const;
+
+    // GL publishes every frame it writes into the shared image, host copies are published when they are handed
+    // over. A Vulkan frame without a new generation composes the previous content again, it takes over the
+    // handoff to GL from the frame before instead of waiting for GL.
+    void publishContent() override;
+    uint64_t getContentGeneration() const;
+
+    // Host copy transport, frames are tightly packed RGBA8. Returns nullptr if every slot is in use by Vulkan.
+    void* acquireHostWriteSlot() override;
+    void submitHostWriteSlot() override;
+    uint64_t getHostFrameSize() const override;
+
+    void printStatistics(double seconds, uint64_t frames);
+
+    // The shared image follows the requested size unless its size is fixed by readback, a frame source or the
+    // host copy transport. The new image replaces the old one in the next exportSharedImage(),
+    // the GL side has to import it again once the generation changes.
+    bool isResizable() const;
+    void requestResize(VkExtent2D extent);
+    uint64_t getSharedImageGeneration() const override;
+    VkExtent2D getSharedImageExtent() const override;
+
+    // With render scaling GL only renders the top left part of the shared image, Vulkan upscales it. A new scale
+    // takes effect with the next frame GL renders, getRenderExtent() is the part written by the current frame.
+    bool isRenderScaling() const;
+    void setRenderScale(float scale);
+    float getRenderScale() const;
+    VkExtent2D getRenderExtent() const override;
 
-    HANDLE getGLCompleteHandle() const;
-    HANDLE getVKReadyHandle() const;
-    HANDLE getSharedImageMemoryHandle() const;
-    uint64_t getSharedImageMemorySize() const;
+    // With damage tracking GL reports the parts of the shared image it changed, the rest keeps its previous
+    // content. getDamage() is what the current frame changed, the list starts over in exportSharedImage().
+    // Without tracking, and with host copies that arrive a few frames late, every frame changes the whole image.
+    bool isDamageTracking() const override;
+    void addDamage(const VkRect2D& rect) override;
+    std::vector<VkRect2D> getDamage() const;
+
+    // Linear, host-visible shared image. It can be read in place once the frame that read it on Vulkan
+    // with VK_PIPELINE_STAGE_HOST_BIT has completed and until GL renders again.
+    bool isSharedImageHostAccessible() const override;
+    HostImage getSharedImageHostMapping() const;
+    VkImageLayout getSharedImageReadLayout() const;
+
+    // NV12 images have one memory allocation per plane, sampled through the YCbCr conversion
+    SharedImageFormat getSharedImageFormat() const override;
+    VkSamplerYcbcrConversion getSharedImageYcbcrConversion() const;
+    VkFilter getSharedImageChromaFilter() const;
+
+    const std::array<uint8_t, VK_UUID_SIZE>& getDeviceUUID() const override;
+    ExternalHandle getGLCompleteHandle() const override;
+    ExternalHandle getVKReadyHandle() const override;
+    uint32_t getSharedImageMemoryCount() const override;
+    ExternalHandle getSharedImageMemoryHandle(uint32_t index = 0) const override;
+    uint64_t getSharedImageMemorySize(uint32_t index = 0) const override;
     VkSemaphore getGLCompleteSemaphore() const;
     VkSemaphore getVKReadySemaphore() const;
     VkImageView getSharedImageView() const;
+    ExternalHandle getSharedDepthMemoryHandle() const override;
+    uint64_t getSharedDepthMemorySize() const override;
+    VkImageView getSharedDepthView() const;
 
 private:
+    enum class HostSlotState
+    {
+        Free,
+        Writing,
+        Written,
+        InFlight
+    };
+
+    struct HostSlot
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        void* data;
+        HostSlotState state;
+        uint64_t sequence;
+        uint32_t frameIndex;
+    };
+
+    struct SharedMemory
+    {
+        VkDeviceMemory memory;
+        uint64_t size;
+        ExternalHandle handle;
+    };
+
+    bool isNv12Supported(const Settings& settings);
+    bool isHostAccessSupported() const;
+    bool isExternalSharingSupported();
+    bool isDepthSharingSupported() const;
+    void queryDeviceUUID();
     void createInteropSemaphores();
+    void createYcbcrConversion();
+    VkMemoryRequirements getSharedImageMemoryRequirements(uint32_t index) const;
+    void createSharedImage();
+    void createSharedDepthImage();
+    void updateRenderExtent();
+    // State changes of the import and export, apart from the barriers
+    void markVKRead();
+    void markGLWrite();
+    void retireSharedImage();
     void createInteropTexture();
+    void createHostTransport();
+    void addHostUploadPass(FrameGraph& graph, FrameGraph::Resource image);
 
     Context& m_context;
     VkDevice m_device;
+    InteropTransport m_transport;
+    bool m_externalSharingSupported;
+    bool m_hostAccessible;
+    bool m_resizable;
+    VkExtent2D m_extent{uint32_t(c_windowWidth), uint32_t(c_windowHeight)};
+    VkExtent2D m_requestedExtent{uint32_t(c_windowWidth), uint32_t(c_windowHeight)};
+    uint64_t m_generation = 0;
+    bool m_renderScaling;
+    float m_renderScale;
+    VkExtent2D m_renderExtent{};
+    bool m_damageTracking;
+    bool m_depthSharing = false;
+    std::vector<VkRect2D> m_damage;
+    SharedImageFormat m_sharedImageFormat;
+    VkFormat m_sharedImageVkFormat;
+    VkImageCreateFlags m_sharedImageFlags;
+    VkImageUsageFlags m_sharedImageUsage;
+    VkImageLayout m_readLayout;
+    VkImageLayout m_writeLayout;
+    VkAccessFlags m_writeAccess;
+    VkPipelineStageFlags m_writeStage;
+    std::array<uint8_t, VK_UUID_SIZE> m_deviceUUID{};
 
-    VkSemaphore m_glCompleteSemaphore;
-    VkSemaphore m_vulkanCompleteSemaphore;
-    HANDLE m_glCompleteSemaphoreHandle;
-    HANDLE m_vulkanCompleteSemaphoreHandle;
+    VkSemaphore m_glCompleteSemaphore = VK_NULL_HANDLE;
+    VkSemaphore m_vulkanCompleteSemaphore = VK_NULL_HANDLE;
+    ExternalHandle m_glCompleteSemaphoreHandle = c_invalidExternalHandle;
+    ExternalHandle m_vulkanCompleteSemaphoreHandle = c_invalidExternalHandle;
     VkImage m_sharedImage;
-    uint64_t m_sharedImageMemorySize;
-    VkDeviceMemory m_sharedImageMemory;
-    HANDLE m_sharedImageMemoryHandle;
+    std::vector<SharedMemory> m_sharedImageMemories;
     VkImageView m_sharedImageView;
+    VkImage m_sharedDepthImage = VK_NULL_HANDLE;
+    SharedMemory m_sharedDepthMemory{VK_NULL_HANDLE, 0, c_invalidExternalHandle};
+    VkImageView m_sharedDepthView = VK_NULL_HANDLE;
+    VkSamplerYcbcrConversion m_ycbcrConversion = VK_NULL_HANDLE;
+    VkFilter m_chromaFilter = VK_FILTER_LINEAR;
+    void* m_sharedImageMapping = nullptr;
+    VkSubresourceLayout m_sharedImageLayout{};
     bool m_stateIsGLWrite;
+    uint64_t m_contentGeneration = 0;
+    uint64_t m_consumedGeneration = 0;
+    bool m_frameHasNewContent = false;
+
+    std::vector<HostSlot> m_hostSlots;
+    int m_hostWriteSlot = -1;
+    uint64_t m_hostSequence = 0;
+    uint32_t m_frameIndex = 0;
+    uint64_t m_hostFramesUploaded = 0;
+    uint64_t m_hostFramesDropped = 0;
 };
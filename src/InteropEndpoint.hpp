@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Settings.hpp"
+#include "VulkanUtils.hpp"
+#include <array>
+
+// What the GL producer sees of the shared image. Interop implements it when GL runs in the same process,
+// RemoteInterop when the handles arrive over a socket from a consumer process.
+class InteropEndpoint
+{
+public:
+    virtual ~InteropEndpoint() = default;
+
+    virtual InteropTransport getTransport() const = 0;
+    // Called by the GL side before the first frame when it can't import the shared image
+    virtual void fallbackToHostCopy(const char* reason) = 0;
+
+    // The GL side imports the shared image again once the generation changes
+    virtual uint64_t getSharedImageGeneration() const = 0;
+    virtual VkExtent2D getSharedImageExtent() const = 0;
+    virtual VkExtent2D getRenderExtent() const = 0;
+    virtual SharedImageFormat getSharedImageFormat() const = 0;
+    virtual bool isSharedImageHostAccessible() const = 0;
+    virtual bool isDamageTracking() const = 0;
+    virtual void addDamage(const VkRect2D& rect) = 0;
+    // Every frame GL writes into the shared image is published after its semaphore signal
+    virtual void publishContent() = 0;
+
+    // Host copy transport
+    virtual void* acquireHostWriteSlot() = 0;
+    virtual void submitHostWriteSlot() = 0;
+    virtual uint64_t getHostFrameSize() const = 0;
+
+    // External memory transport, GL takes ownership of the handles it imports
+    virtual const std::array<uint8_t, VK_UUID_SIZE>& getDeviceUUID() const = 0;
+    virtual ExternalHandle getGLCompleteHandle() const = 0;
+    virtual ExternalHandle getVKReadyHandle() const = 0;
+    virtual uint32_t getSharedImageMemoryCount() const = 0;
+    virtual ExternalHandle getSharedImageMemoryHandle(uint32_t index = 0) const = 0;
+    virtual uint64_t getSharedImageMemorySize(uint32_t index = 0) const = 0;
+    virtual bool isDepthSharing() const = 0;
+    virtual ExternalHandle getSharedDepthMemoryHandle() const = 0;
+    virtual uint64_t getSharedDepthMemorySize() const = 0;
+};
+
+// What the Vulkan consumer sees of the GL producer, GLRenderer in the same process or RemoteProducer
+class FrameProducer
+{
+public:
+    virtual ~FrameProducer() = default;
+
+    // Only renders and hands a frame over to Vulkan when the content changed, returns false to stop
+    virtual bool render() = 0;
+    virtual void toggleAnimation() = 0;
+    virtual void printStatistics(double seconds) = 0;
+    // Newest measured GPU time of a frame, a few frames old, 0 until the first one is available
+    virtual double getGpuMilliseconds() const = 0;
+    // Grows with every measured frame, getGpuMilliseconds() only has a new value when this changed
+    virtual uint64_t getGpuSampleCount() const = 0;
+};
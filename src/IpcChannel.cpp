@@ -0,0 +1,185 @@
+#include "IpcChannel.hpp"
+#include "Utils.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+sockaddr_un getAddress(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    CHECK(path.size() < sizeof(address.sun_path));
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+} // namespace
+
+std::unique_ptr<IpcChannel> IpcChannel::listen(const std::string& path)
+{
+    // Sequenced packets keep message boundaries and report a closed connection like a stream
+    const int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    CHECK(listener >= 0);
+    const sockaddr_un address = getAddress(path);
+    // A socket file left over by a consumer that didn't exit cleanly, anything else at the path is kept and
+    // makes the bind fail
+    struct stat status{};
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path.c_str());
+    }
+    CHECK(bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+    CHECK(::listen(listener, 1) == 0);
+
+    printf("IPC: waiting for a producer on %s\n", path.c_str());
+    const int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    CHECK(connection >= 0);
+    close(listener);
+    unlink(path.c_str());
+    return std::unique_ptr<IpcChannel>(new IpcChannel(connection));
+}
+
+std::unique_ptr<IpcChannel> IpcChannel::connect(const std::string& path)
+{
+    const int connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    CHECK(connection >= 0);
+    const sockaddr_un address = getAddress(path);
+    if (::connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        printf("IPC: no consumer is listening on %s\n", path.c_str());
+        CHECK(false);
+    }
+    printf("IPC: connected to the consumer on %s\n", path.c_str());
+    return std::unique_ptr<IpcChannel>(new IpcChannel(connection));
+}
+
+IpcChannel::IpcChannel(int socket) :
+    m_socket(socket)
+{
+}
+
+IpcChannel::~IpcChannel()
+{
+    close(m_socket);
+}
+
+bool IpcChannel::send(const IpcMessage& message, const std::vector<ExternalHandle>& handles)
+{
+    CHECK(handles.size() <= c_maxIpcHandles);
+
+    iovec data{};
+    data.iov_base = const_cast<IpcMessage*>(&message);
+    data.iov_len = sizeof(message);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * c_maxIpcHandles)]{};
+    msghdr header{};
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+    if (!handles.empty())
+    {
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(sizeof(int) * handles.size());
+        cmsghdr* rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int) * handles.size());
+        std::memcpy(CMSG_DATA(rights), handles.data(), sizeof(int) * handles.size());
+    }
+
+    ssize_t size = 0;
+    do
+    {
+        size = sendmsg(m_socket, &header, MSG_NOSIGNAL);
+    } while (size < 0 && errno == EINTR);
+    return size_t(size) == sizeof(message);
+}
+
+bool IpcChannel::receive(IpcMessage& message, std::vector<ExternalHandle>& handles)
+{
+    handles.clear();
+
+    iovec data{};
+    data.iov_base = &message;
+    data.iov_len = sizeof(message);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * c_maxIpcHandles)]{};
+    msghdr header{};
+    header.msg_iov = &data;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    const ssize_t size = recvmsg(m_socket, &header, MSG_CMSG_CLOEXEC);
+    if (size <= 0)
+    {
+        return false;
+    }
+    CHECK(size_t(size) == sizeof(message) && !(header.msg_flags & (MSG_TRUNC | MSG_CTRUNC)));
+
+    for (cmsghdr* rights = CMSG_FIRSTHDR(&header); rights; rights = CMSG_NXTHDR(&header, rights))
+    {
+        if (rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS)
+        {
+            const size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const size_t first = handles.size();
+            handles.resize(first + count);
+            std::memcpy(handles.data() + first, CMSG_DATA(rights), sizeof(int) * count);
+        }
+    }
+    return true;
+}
+
+bool IpcChannel::isConnected() const
+{
+    pollfd state{};
+    state.fd = m_socket;
+    state.events = POLLIN;
+    // The socket is closed along with a process that crashed, a pending message keeps it readable without a hangup
+    return poll(&state, 1, 0) >= 0 && !(state.revents & (POLLHUP | POLLERR));
+}
+#else
+std::unique_ptr<IpcChannel> IpcChannel::listen(const std::string&)
+{
+    printf("IPC: producer processes need Unix domain sockets\n");
+    CHECK(false);
+    return nullptr;
+}
+
+std::unique_ptr<IpcChannel> IpcChannel::connect(const std::string&)
+{
+    printf("IPC: producer processes need Unix domain sockets\n");
+    CHECK(false);
+    return nullptr;
+}
+
+IpcChannel::IpcChannel(int socket) :
+    m_socket(socket)
+{
+}
+
+IpcChannel::~IpcChannel()
+{
+}
+
+bool IpcChannel::send(const IpcMessage&, const std::vector<ExternalHandle>&)
+{
+    return false;
+}
+
+bool IpcChannel::receive(IpcMessage&, std::vector<ExternalHandle>&)
+{
+    return false;
+}
+
+bool IpcChannel::isConnected() const
+{
+    return false;
+}
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Settings.hpp"
+#include "VulkanUtils.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class IpcMessageType : uint32_t
+{
+    // Consumer to producer: device, format and the handles of the frame queue, the semaphores and the shared images
+    Setup,
+    // Consumer to producer: the shared images were replaced, new memory handles
+    Resize
+};
+
+// Frame queue, semaphores, two NV12 planes and the shared depth
+const uint32_t c_maxIpcHandles = 6;
+
+// Fixed size so that a message is a single datagram. Frames themselves go through the FrameQueue.
+struct IpcMessage
+{
+    IpcMessageType type;
+
+    VkExtent2D extent;
+    VkExtent2D renderExtent;
+    uint64_t generation;
+    uint32_t memoryCount;
+    uint64_t memorySizes[2];
+    uint64_t depthMemorySize;
+    // Only read from Setup
+    SharedImageFormat format;
+    uint32_t hostAccessible;
+    uint32_t damageTracking;
+    uint32_t depthSharing;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+};
+
+// Connection between a Vulkan consumer and a GL producer process over a Unix domain sequenced packet socket.
+// Handles travel with a message as SCM_RIGHTS, the receiver gets its own descriptors for them. Only available
+// on POSIX systems.
+class IpcChannel final
+{
+public:
+    // Waits for one producer to connect, the socket file is removed again once it did
+    static std::unique_ptr<IpcChannel> listen(const std::string& path);
+    static std::unique_ptr<IpcChannel> connect(const std::string& path);
+    ~IpcChannel();
+
+    // The sender keeps its own handles. Returns false if the message couldn't be sent, the other side is gone then.
+    bool send(const IpcMessage& message, const std::vector<ExternalHandle>& handles = {});
+    // Blocks until a message arrives, returns false once the other side closed the connection
+    bool receive(IpcMessage& message, std::vector<ExternalHandle>& handles);
+    // Doesn't block, false once the other side closed the connection or exited
+    bool isConnected() const;
+
+private:
+    explicit IpcChannel(int socket);
+
+    int m_socket;
+};
@@ -0,0 +1,759 @@
+#include "PixelConversion.hpp"
+#include "Utils.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(PIXEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+struct PixelKernels
+{
+    void (*swizzle)(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+    void (*premultiply)(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+    void (*lumaRow)(const uint8_t* rgba, uint8_t* y, size_t width);
+    void (*chromaRow)(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* uv, size_t width);
+    void (*nv12Row)(const uint8_t* y, const uint8_t* uv, uint8_t* rgba, size_t width);
+};
+
+uint8_t clampToByte(int value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+uint8_t div255(uint32_t value)
+{
+    value += 128;
+    return static_cast<uint8_t>((value + (value >> 8)) >> 8);
+}
+
+// Scalar
+
+void swizzleScalar(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        const uint8_t r = src[i * 4 + 0];
+        const uint8_t b = src[i * 4 + 2];
+        dst[i * 4 + 0] = b;
+        dst[i * 4 + 1] = src[i * 4 + 1];
+        dst[i * 4 + 2] = r;
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+void premultiplyScalar(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        const uint32_t a = src[i * 4 + 3];
+        dst[i * 4 + 0] = div255(src[i * 4 + 0] * a);
+        dst[i * 4 + 1] = div255(src[i * 4 + 1] * a);
+        dst[i * 4 + 2] = div255(src[i * 4 + 2] * a);
+        dst[i * 4 + 3] = static_cast<uint8_t>(a);
+    }
+}
+
+void lumaRowScalar(const uint8_t* rgba, uint8_t* y, size_t width)
+{
+    for (size_t i = 0; i < width; ++i)
+    {
+        const int r = rgba[i * 4 + 0];
+        const int g = rgba[i * 4 + 1];
+        const int b = rgba[i * 4 + 2];
+        y[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+}
+
+void chromaRowScalar(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* uv, size_t width)
+{
+    for (size_t i = 0; i < width / 2; ++i)
+    {
+        const uint8_t* p0 = rgba0 + i * 8;
+        const uint8_t* p1 = rgba1 + i * 8;
+        const int r = (p0[0] + p0[4] + p1[0] + p1[4] + 2) >> 2;
+        const int g = (p0[1] + p0[5] + p1[1] + p1[5] + 2) >> 2;
+        const int b = (p0[2] + p0[6] + p1[2] + p1[6] + 2) >> 2;
+        uv[i * 2 + 0] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        uv[i * 2 + 1] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+void nv12RowScalar(const uint8_t* y, const uint8_t* uv, uint8_t* rgba, size_t width)
+{
+    for (size_t i = 0; i < width; ++i)
+    {
+        const int c = y[i] - 16;
+        const int d = uv[(i / 2) * 2 + 0] - 128;
+        const int e = uv[(i / 2) * 2 + 1] - 128;
+        rgba[i * 4 + 0] = clampToByte((298 * c + 409 * e + 128) >> 8);
+        rgba[i * 4 + 1] = clampToByte((298 * c - 100 * d - 208 * e + 128) >> 8);
+        rgba[i * 4 + 2] = clampToByte((298 * c + 516 * d + 128) >> 8);
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+const PixelKernels c_scalarKernels{swizzleScalar, premultiplyScalar, lumaRowScalar, chromaRowScalar, nv12RowScalar};
+
+#ifdef PIXEL_X86
+
+// SSE4.1
+
+TARGET_SSE41 void swizzleSse41(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 4 <= pixelCount; i += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(p, mask));
+    }
+    swizzleScalar(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+TARGET_SSE41 __m128i premultiplyHalfSse41(__m128i pixels16, __m128i alphaMask)
+{
+    const __m128i alpha = _mm_shuffle_epi8(pixels16, alphaMask);
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(pixels16, alpha), _mm_set1_epi16(128));
+    x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    return x;
+}
+
+TARGET_SSE41 void premultiplySse41(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+    const __m128i alphaChannel = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    size_t i = 0;
+    for (; i + 4 <= pixelCount; i += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        const __m128i lo = premultiplyHalfSse41(_mm_unpacklo_epi8(p, zero), alphaMask);
+        const __m128i hi = premultiplyHalfSse41(_mm_unpackhi_epi8(p, zero), alphaMask);
+        const __m128i result = _mm_blendv_epi8(_mm_packus_epi16(lo, hi), p, alphaChannel);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+    }
+    premultiplyScalar(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+// Four pixels to four 32-bit lanes of "66R + 129G + 25B" style weighted sums
+TARGET_SSE41 __m128i weightedSumSse41(__m128i pixels, __m128i weights)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+    return _mm_hadd_epi32(lo, hi);
+}
+
+TARGET_SSE41 __m128i lumaSse41(__m128i pixels)
+{
+    const __m128i weights = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    const __m128i sum = weightedSumSse41(pixels, weights);
+    return _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+}
+
+TARGET_SSE41 void lumaRowSse41(const uint8_t* rgba, uint8_t* y, size_t width)
+{
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        const __m128i* p = reinterpret_cast<const __m128i*>(rgba + i * 4);
+        const __m128i y0 = lumaSse41(_mm_loadu_si128(p + 0));
+        const __m128i y1 = lumaSse41(_mm_loadu_si128(p + 1));
+        const __m128i y2 = lumaSse41(_mm_loadu_si128(p + 2));
+        const __m128i y3 = lumaSse41(_mm_loadu_si128(p + 3));
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), packed);
+    }
+    lumaRowScalar(rgba + i * 4, y + i, width - i);
+}
+
+// Four pixels of two rows to two 2x2 averaged pixels as 16-bit channels
+TARGET_SSE41 __m128i averageQuadsSse41(__m128i row0, __m128i row1)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sumLo = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+    const __m128i sumHi = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+    const __m128i pairLo = _mm_add_epi16(sumLo, _mm_srli_si128(sumLo, 8));
+    const __m128i pairHi = _mm_add_epi16(sumHi, _mm_srli_si128(sumHi, 8));
+    const __m128i sum = _mm_unpacklo_epi64(pairLo, pairHi);
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+TARGET_SSE41 __m128i chromaSse41(__m128i average0, __m128i average1, __m128i weights)
+{
+    const __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(average0, weights), _mm_madd_epi16(average1, weights));
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(128));
+}
+
+TARGET_SSE41 void chromaRowSse41(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* uv, size_t width)
+{
+    const __m128i uWeights = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    const __m128i vWeights = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    size_t i = 0;
+    for (; i + 8 <= width; i += 8)
+    {
+        const __m128i* p0 = reinterpret_cast<const __m128i*>(rgba0 + i * 4);
+        const __m128i* p1 = reinterpret_cast<const __m128i*>(rgba1 + i * 4);
+        const __m128i average0 = averageQuadsSse41(_mm_loadu_si128(p0 + 0), _mm_loadu_si128(p1 + 0));
+        const __m128i average1 = averageQuadsSse41(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1));
+        const __m128i u = chromaSse41(average0, average1, uWeights);
+        const __m128i v = chromaSse41(average0, average1, vWeights);
+        const __m128i uv16 = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(uv + i), _mm_packus_epi16(uv16, uv16));
+    }
+    chromaRowScalar(rgba0 + i * 4, rgba1 + i * 4, uv + i, width - i);
+}
+
+TARGET_SSE41 __m128i yuvToRgbaSse41(__m128i c, __m128i d, __m128i e)
+{
+    const __m128i luma = _mm_add_epi32(_mm_mullo_epi32(c, _mm_set1_epi32(298)), _mm_set1_epi32(128));
+    __m128i r = _mm_add_epi32(luma, _mm_mullo_epi32(e, _mm_set1_epi32(409)));
+    __m128i g = _mm_sub_epi32(luma, _mm_add_epi32(_mm_mullo_epi32(d, _mm_set1_epi32(100)), _mm_mullo_epi32(e, _mm_set1_epi32(208))));
+    __m128i b = _mm_add_epi32(luma, _mm_mullo_epi32(d, _mm_set1_epi32(516)));
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi32(255);
+    r = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(r, 8), zero), max);
+    g = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(g, 8), zero), max);
+    b = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(b, 8), zero), max);
+
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 8));
+    const __m128i ba = _mm_or_si128(_mm_slli_epi32(b, 16), _mm_set1_epi32(static_cast<int>(0xFF000000)));
+    return _mm_or_si128(rg, ba);
+}
+
+TARGET_SSE41 void nv12RowSse41(const uint8_t* y, const uint8_t* uv, uint8_t* rgba, size_t width)
+{
+    const __m128i uMask = _mm_setr_epi8(0, -1, -1, -1, 0, -1, -1, -1, 2, -1, -1, -1, 2, -1, -1, -1);
+    const __m128i vMask = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 3, -1, -1, -1, 3, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 4 <= width; i += 4)
+    {
+        int32_t yBytes;
+        int32_t uvBytes;
+        memcpy(&yBytes, y + i, sizeof(yBytes));
+        memcpy(&uvBytes, uv + i, sizeof(uvBytes));
+        const __m128i uvVector = _mm_cvtsi32_si128(uvBytes);
+        const __m128i c = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(yBytes)), _mm_set1_epi32(16));
+        const __m128i d = _mm_sub_epi32(_mm_shuffle_epi8(uvVector, uMask), _mm_set1_epi32(128));
+        const __m128i e = _mm_sub_epi32(_mm_shuffle_epi8(uvVector, vMask), _mm_set1_epi32(128));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), yuvToRgbaSse41(c, d, e));
+    }
+    nv12RowScalar(y + i, uv + i, rgba + i * 4, width - i);
+}
+
+const PixelKernels c_sse41Kernels{swizzleSse41, premultiplySse41, lumaRowSse41, chromaRowSse41, nv12RowSse41};
+
+// AVX2
+
+TARGET_AVX2 void swizzleAvx2(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, //
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= pixelCount; i += 8)
+    {
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(p, mask));
+    }
+    swizzleSse41(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+TARGET_AVX2 __m256i premultiplyHalfAvx2(__m256i pixels16, __m256i alphaMask)
+{
+    const __m256i alpha = _mm256_shuffle_epi8(pixels16, alphaMask);
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(pixels16, alpha), _mm256_set1_epi16(128));
+    x = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    return x;
+}
+
+TARGET_AVX2 void premultiplyAvx2(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15, //
+                                               6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+    const __m256i alphaChannel = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    size_t i = 0;
+    for (; i + 8 <= pixelCount; i += 8)
+    {
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        // Unpack and pack both work within 128-bit lanes so the pixel order is preserved
+        const __m256i lo = premultiplyHalfAvx2(_mm256_unpacklo_epi8(p, zero), alphaMask);
+        const __m256i hi = premultiplyHalfAvx2(_mm256_unpackhi_epi8(p, zero), alphaMask);
+        const __m256i result = _mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), p, alphaChannel);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), result);
+    }
+    premultiplySse41(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+TARGET_AVX2 __m256i lumaAvx2(__m256i pixels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0);
+    const __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+    const __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+    const __m256i sum = _mm256_hadd_epi32(lo, hi);
+    return _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8), _mm256_set1_epi32(16));
+}
+
+TARGET_AVX2 void lumaRowAvx2(const uint8_t* rgba, uint8_t* y, size_t width)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= width; i += 32)
+    {
+        const __m256i* p = reinterpret_cast<const __m256i*>(rgba + i * 4);
+        const __m256i y0 = lumaAvx2(_mm256_loadu_si256(p + 0));
+        const __m256i y1 = lumaAvx2(_mm256_loadu_si256(p + 1));
+        const __m256i y2 = lumaAvx2(_mm256_loadu_si256(p + 2));
+        const __m256i y3 = lumaAvx2(_mm256_loadu_si256(p + 3));
+        const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    lumaRowSse41(rgba + i * 4, y + i, width - i);
+}
+
+TARGET_AVX2 void nv12RowAvx2(const uint8_t* y, const uint8_t* uv, uint8_t* rgba, size_t width)
+{
+    const __m128i uMask = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i vMask = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 8 <= width; i += 8)
+    {
+        const __m128i yBytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i));
+        const __m128i uvBytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(uv + i));
+        const __m256i c = _mm256_sub_epi32(_mm256_cvtepu8_epi32(yBytes), _mm256_set1_epi32(16));
+        const __m256i d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_shuffle_epi8(uvBytes, uMask)), _mm256_set1_epi32(128));
+        const __m256i e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_shuffle_epi8(uvBytes, vMask)), _mm256_set1_epi32(128));
+
+        const __m256i luma = _mm256_add_epi32(_mm256_mullo_epi32(c, _mm256_set1_epi32(298)), _mm256_set1_epi32(128));
+        __m256i r = _mm256_add_epi32(luma, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+        __m256i g = _mm256_sub_epi32(luma, _mm256_add_epi32(_mm256_mullo_epi32(d, _mm256_set1_epi32(100)), _mm256_mullo_epi32(e, _mm256_set1_epi32(208))));
+        __m256i b = _mm256_add_epi32(luma, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i max = _mm256_set1_epi32(255);
+        r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero), max);
+        g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero), max);
+        b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero), max);
+
+        const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 8));
+        const __m256i ba = _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32(static_cast<int>(0xFF000000)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), _mm256_or_si256(rg, ba));
+    }
+    nv12RowSse41(y + i, uv + i, rgba + i * 4, width - i);
+}
+
+// Chroma is bound by the 2x2 averaging shuffles, the SSE4.1 version is as fast in practice
+const PixelKernels c_avx2Kernels{swizzleAvx2, premultiplyAvx2, lumaRowAvx2, chromaRowSse41, nv12RowAvx2};
+
+bool cpuSupports(PixelKernelSet kernelSet)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    return kernelSet == PixelKernelSet::Sse41 ? sse41 : (kernelSet == PixelKernelSet::Avx2 && avx2);
+}
+
+#endif // PIXEL_X86
+
+#ifdef PIXEL_NEON
+
+void swizzleNeon(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16)
+    {
+        uint8x16x4_t p = vld4q_u8(src + i * 4);
+        const uint8x16_t r = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = r;
+        vst4q_u8(dst + i * 4, p);
+    }
+    swizzleScalar(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+// Exact rounded division by 255 of 16-bit products, same as div255
+uint8x16_t multiplyNeon(uint8x16_t color, uint8x16_t alpha)
+{
+    const uint16x8_t lo = vmull_u8(vget_low_u8(color), vget_low_u8(alpha));
+    const uint16x8_t hi = vmull_u8(vget_high_u8(color), vget_high_u8(alpha));
+    return vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+}
+
+void premultiplyNeon(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16)
+    {
+        uint8x16x4_t p = vld4q_u8(src + i * 4);
+        p.val[0] = multiplyNeon(p.val[0], p.val[3]);
+        p.val[1] = multiplyNeon(p.val[1], p.val[3]);
+        p.val[2] = multiplyNeon(p.val[2], p.val[3]);
+        vst4q_u8(dst + i * 4, p);
+    }
+    premultiplyScalar(src + i * 4, dst + i * 4, pixelCount - i);
+}
+
+uint8x8_t lumaNeon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t sum = vmull_u8(r, vdup_n_u8(66));
+    sum = vmlal_u8(sum, g, vdup_n_u8(129));
+    sum = vmlal_u8(sum, b, vdup_n_u8(25));
+    return vadd_u8(vrshrn_n_u16(sum, 8), vdup_n_u8(16));
+}
+
+void lumaRowNeon(const uint8_t* rgba, uint8_t* y, size_t width)
+{
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        const uint8x16x4_t p = vld4q_u8(rgba + i * 4);
+        const uint8x8_t lo = lumaNeon(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2]));
+        const uint8x8_t hi = lumaNeon(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]));
+        vst1q_u8(y + i, vcombine_u8(lo, hi));
+    }
+    lumaRowScalar(rgba + i * 4, y + i, width - i);
+}
+
+uint8x8_t chromaNeon(int16x8_t r, int16x8_t g, int16x8_t b, int16_t wr, int16_t wg, int16_t wb)
+{
+    int16x8_t sum = vmulq_n_s16(r, wr);
+    sum = vmlaq_n_s16(sum, g, wg);
+    sum = vmlaq_n_s16(sum, b, wb);
+    return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, 8), vdupq_n_s16(128)));
+}
+
+void chromaRowNeon(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* uv, size_t width)
+{
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        const uint8x16x4_t p0 = vld4q_u8(rgba0 + i * 4);
+        const uint8x16x4_t p1 = vld4q_u8(rgba1 + i * 4);
+        const int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]), 2));
+        const int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+        const int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+        uint8x8x2_t result;
+        result.val[0] = chromaNeon(r, g, b, -38, -74, 112);
+        result.val[1] = chromaNeon(r, g, b, 112, -94, -18);
+        vst2_u8(uv + i, result);
+    }
+    chromaRowScalar(rgba0 + i * 4, rgba1 + i * 4, uv + i, width - i);
+}
+
+uint16x4_t yuvChannelNeon(int16x4_t c, int16x4_t d, int16_t wd, int16x4_t e, int16_t we)
+{
+    int32x4_t sum = vmull_n_s16(c, 298);
+    sum = vmlal_n_s16(sum, d, wd);
+    sum = vmlal_n_s16(sum, e, we);
+    return vqmovun_s32(vrshrq_n_s32(sum, 8));
+}
+
+uint8x8_t yuvChannelNeon(int16x8_t c, int16x8_t d, int16_t wd, int16x8_t e, int16_t we)
+{
+    const uint16x4_t lo = yuvChannelNeon(vget_low_s16(c), vget_low_s16(d), wd, vget_low_s16(e), we);
+    const uint16x4_t hi = yuvChannelNeon(vget_high_s16(c), vget_high_s16(d), wd, vget_high_s16(e), we);
+    return vqmovn_u16(vcombine_u16(lo, hi));
+}
+
+void nv12RowNeon(const uint8_t* y, const uint8_t* uv, uint8_t* rgba, size_t width)
+{
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        const uint8x16_t yBytes = vld1q_u8(y + i);
+        const uint8x8x2_t uvBytes = vld2_u8(uv + i);
+        const uint8x8x2_t u = vzip_u8(uvBytes.val[0], uvBytes.val[0]);
+        const uint8x8x2_t v = vzip_u8(uvBytes.val[1], uvBytes.val[1]);
+
+        for (int half = 0; half < 2; ++half)
+        {
+            const uint8x8_t yHalf = half == 0 ? vget_low_u8(yBytes) : vget_high_u8(yBytes);
+            const int16x8_t c = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(yHalf)), vdupq_n_s16(16));
+            const int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u.val[half])), vdupq_n_s16(128));
+            const int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v.val[half])), vdupq_n_s16(128));
+
+            uint8x8x4_t p;
+            p.val[0] = yuvChannelNeon(c, d, 0, e, 409);
+            p.val[1] = yuvChannelNeon(c, d, -100, e, -208);
+            p.val[2] = yuvChannelNeon(c, d, 516, e, 0);
+            p.val[3] = vdup_n_u8(255);
+            vst4_u8(rgba + (i + half * 8) * 4, p);
+        }
+    }
+    nv12RowScalar(y + i, uv + i, rgba + i * 4, width - i);
+}
+
+const PixelKernels c_neonKernels{swizzleNeon, premultiplyNeon, lumaRowNeon, chromaRowNeon, nv12RowNeon};
+
+#endif // PIXEL_NEON
+
+const PixelKernels& getKernels(PixelKernelSet kernelSet)
+{
+    switch (kernelSet)
+    {
+#ifdef PIXEL_X86
+    case PixelKernelSet::Sse41: return c_sse41Kernels;
+    case PixelKernelSet::Avx2: return c_avx2Kernels;
+#endif
+#ifdef PIXEL_NEON
+    case PixelKernelSet::Neon: return c_neonKernels;
+#endif
+    default: return c_scalarKernels;
+    }
+}
+
+PixelKernelSet selectBestKernelSet()
+{
+    for (PixelKernelSet kernelSet : {PixelKernelSet::Avx2, PixelKernelSet::Sse41, PixelKernelSet::Neon})
+    {
+        if (isPixelKernelSetSupported(kernelSet))
+        {
+            return kernelSet;
+        }
+    }
+    return PixelKernelSet::Scalar;
+}
+
+PixelKernelSet& activeKernelSet()
+{
+    static PixelKernelSet kernelSet = selectBestKernelSet();
+    return kernelSet;
+}
+
+const PixelKernels& activeKernels()
+{
+    return getKernels(activeKernelSet());
+}
+
+using SrgbTable = std::array<uint8_t, 256>;
+
+SrgbTable createSrgbTable(bool encode)
+{
+    SrgbTable table;
+    for (int i = 0; i < 256; ++i)
+    {
+        const double value = i / 255.0;
+        double converted;
+        if (encode)
+        {
+            converted = value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+        }
+        else
+        {
+            converted = value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+        }
+        table[i] = static_cast<uint8_t>(std::lround(converted * 255.0));
+    }
+    return table;
+}
+
+// A table lookup beats arithmetic and gathers for 8-bit data, so sRGB is the same for all variants
+void applyTable(const SrgbTable& table, const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        dst[i * 4 + 0] = table[src[i * 4 + 0]];
+        dst[i * 4 + 1] = table[src[i * 4 + 1]];
+        dst[i * 4 + 2] = table[src[i * 4 + 2]];
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+} // namespace
+
+PixelKernelSet getPixelKernelSet()
+{
+    return activeKernelSet();
+}
+
+const char* getPixelKernelSetName(PixelKernelSet kernelSet)
+{
+    switch (kernelSet)
+    {
+    case PixelKernelSet::Sse41: return "SSE4.1";
+    case PixelKernelSet::Avx2: return "AVX2";
+    case PixelKernelSet::Neon: return "NEON";
+    default: return "Scalar";
+    }
+}
+
+bool isPixelKernelSetSupported(PixelKernelSet kernelSet)
+{
+    switch (kernelSet)
+    {
+    case PixelKernelSet::Scalar: return true;
+#ifdef PIXEL_X86
+    case PixelKernelSet::Sse41:
+    case PixelKernelSet::Avx2: return cpuSupports(kernelSet);
+#endif
+#ifdef PIXEL_NEON
+    case PixelKernelSet::Neon: return true;
+#endif
+    default: return false;
+    }
+}
+
+void setPixelKernelSet(PixelKernelSet kernelSet)
+{
+    CHECK(isPixelKernelSetSupported(kernelSet));
+    activeKernelSet() = kernelSet;
+}
+
+void swizzleRgbaBgra(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    activeKernels().swizzle(src, dst, pixelCount);
+}
+
+void premultiplyAlpha(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    activeKernels().premultiply(src, dst, pixelCount);
+}
+
+void linearToSrgb(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    static const SrgbTable table = createSrgbTable(true);
+    applyTable(table, src, dst, pixelCount);
+}
+
+void srgbToLinear(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    static const SrgbTable table = createSrgbTable(false);
+    applyTable(table, src, dst, pixelCount);
+}
+
+void rgbaToNv12(const uint8_t* src, size_t srcPitch, uint32_t width, uint32_t height, uint8_t* dstY, size_t yPitch, uint8_t* dstUV, size_t uvPitch)
+{
+    CHECK(width % 2 == 0 && height % 2 == 0);
+
+    const PixelKernels& kernels = activeKernels();
+    for (uint32_t row = 0; row < height; row += 2)
+    {
+        const uint8_t* row0 = src + row * srcPitch;
+        const uint8_t* row1 = row0 + srcPitch;
+        kernels.lumaRow(row0, dstY + row * yPitch, width);
+        kernels.lumaRow(row1, dstY + (row + 1) * yPitch, width);
+        kernels.chromaRow(row0, row1, dstUV + (row / 2) * uvPitch, width);
+    }
+}
+
+void nv12ToRgba(const uint8_t* srcY, size_t yPitch, const uint8_t* srcUV, size_t uvPitch, uint32_t width, uint32_t height, uint8_t* dst, size_t dstPitch)
+{
+    CHECK(width % 2 == 0 && height % 2 == 0);
+
+    const PixelKernels& kernels = activeKernels();
+    for (uint32_t row = 0; row < height; ++row)
+    {
+        kernels.nv12Row(srcY + row * yPitch, srcUV + (row / 2) * uvPitch, dst + row * dstPitch, width);
+    }
+}
+
+void runPixelConversionBenchmark()
+{
+    const uint32_t width = c_windowWidth;
+    const uint32_t height = c_windowHeight;
+    const size_t pixelCount = size_t(width) * height;
+    const int iterations = 50;
+
+    std::vector<uint8_t> rgba(pixelCount * 4);
+    std::vector<uint8_t> output(pixelCount * 4);
+    std::vector<uint8_t> nv12(pixelCount * 3 / 2);
+    for (size_t i = 0; i < rgba.size(); ++i)
+    {
+        rgba[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+    }
+
+    // Scalar results of every kernel in the order they are measured
+    std::vector<std::vector<uint8_t>> references;
+    size_t kernelIndex = 0;
+    bool scalar = true;
+
+    auto measure = [&](const char* name, size_t bytes, const std::vector<uint8_t>& result, auto&& kernel) {
+        kernel();
+        Timer timer;
+        for (int i = 0; i < iterations; ++i)
+        {
+            kernel();
+        }
+        const double seconds = timer.elapsedSeconds();
+        printf("  %-16s %7.2f GB/s\n", name, double(bytes) * iterations / seconds / 1e9);
+
+        // Every variant has to match the scalar one, checked before the next kernel overwrites the result
+        if (scalar)
+        {
+            references.push_back(result);
+        }
+        else if (result != references[kernelIndex])
+        {
+            printf("  %s output differs from the scalar variant\n", name);
+        }
+        ++kernelIndex;
+    };
+
+    const PixelKernelSet originalKernelSet = getPixelKernelSet();
+    printf("Pixel conversion benchmark, %ux%u RGBA8, selected variant: %s\n", width, height, getPixelKernelSetName(originalKernelSet));
+
+    for (PixelKernelSet kernelSet : {PixelKernelSet::Scalar, PixelKernelSet::Sse41, PixelKernelSet::Avx2, PixelKernelSet::Neon})
+    {
+        if (!isPixelKernelSetSupported(kernelSet))
+        {
+            continue;
+        }
+        setPixelKernelSet(kernelSet);
+        printf("%s\n", getPixelKernelSetName(kernelSet));
+        scalar = kernelSet == PixelKernelSet::Scalar;
+        kernelIndex = 0;
+
+        const size_t rgbaBytes = rgba.size();
+        measure("swizzle", rgbaBytes, output, [&] { swizzleRgbaBgra(rgba.data(), output.data(), pixelCount); });
+        measure("premultiply", rgbaBytes, output, [&] { premultiplyAlpha(rgba.data(), output.data(), pixelCount); });
+        measure("linear to sRGB", rgbaBytes, output, [&] { linearToSrgb(rgba.data(), output.data(), pixelCount); });
+        measure("RGBA to NV12", rgbaBytes, nv12, [&] { rgbaToNv12(rgba.data(), width * 4, width, height, nv12.data(), width, nv12.data() + pixelCount, width); });
+        if (!scalar)
+        {
+            // Converts the scalar NV12, a difference in the RGBA to NV12 kernel isn't reported twice
+            nv12 = references[kernelIndex - 1];
+        }
+        measure("NV12 to RGBA", rgbaBytes, output, [&] { nv12ToRgba(nv12.data(), width, nv12.data() + pixelCount, width, width, height, output.data(), width * 4); });
+    }
+
+    setPixelKernelSet(originalKernelSet);
+}
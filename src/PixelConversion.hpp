@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// CPU-side pixel conversions for capture, upload and fallback paths. The variant is picked at runtime
+// from what the CPU supports, all variants produce bit-identical results.
+
+enum class PixelKernelSet
+{
+    Scalar,
+    Sse41,
+    Avx2,
+    Neon
+};
+
+PixelKernelSet getPixelKernelSet();
+const char* getPixelKernelSetName(PixelKernelSet kernelSet);
+bool isPixelKernelSetSupported(PixelKernelSet kernelSet);
+void setPixelKernelSet(PixelKernelSet kernelSet);
+
+// RGBA8 <-> BGRA8, src and dst may be the same
+void swizzleRgbaBgra(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+// RGBA8 color channels multiplied by alpha, src and dst may be the same
+void premultiplyAlpha(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+// Color channels of RGBA8 between linear and sRGB encoding, alpha is kept
+void linearToSrgb(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+void srgbToLinear(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+// BT.601 limited range, width and height have to be even. Pitches are in bytes.
+void rgbaToNv12(const uint8_t* src, size_t srcPitch, uint32_t width, uint32_t height, uint8_t* dstY, size_t yPitch, uint8_t* dstUV, size_t uvPitch);
+void nv12ToRgba(const uint8_t* srcY, size_t yPitch, const uint8_t* srcUV, size_t uvPitch, uint32_t width, uint32_t height, uint8_t* dst, size_t dstPitch);
+
+// Prints GB/s of each kernel for every supported variant
+void runPixelConversionBenchmark();
@@ -0,0 +1,479 @@
+#include "Readback.hpp"
+#include "VulkanUtils.hpp"
+#include "PixelConversion.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <cstring>
+
+namespace
+{
+struct PushConstants
+{
+    int32_t regionOffset[2];
+    int32_t regionExtent[2];
+    int32_t outputExtent[2];
+    uint32_t wordsPerRow;
+    uint32_t format;
+    uint32_t filter;
+};
+
+const uint32_t c_workgroupSize = 8;
+
+uint32_t getPixelsPerWord(ReadbackFormat format)
+{
+    switch (format)
+    {
+    case ReadbackFormat::Rgb565: return 2;
+    case ReadbackFormat::Gray8: return 4;
+    default: return 1;
+    }
+}
+
+const char* getFormatName(ReadbackFormat format)
+{
+    switch (format)
+    {
+    case ReadbackFormat::Rgb565: return "RGB565";
+    case ReadbackFormat::Gray8: return "Gray8";
+    case ReadbackFormat::Bgra8: return "BGRA8";
+    case ReadbackFormat::Nv12: return "NV12";
+    default: return "RGBA8";
+    }
+}
+
+// Stands in for a consumer so both readback methods touch every pixel
+uint64_t checksum(const Readback::Frame& frame)
+{
+    const bool rgba = frame.format == ReadbackFormat::Rgba8 || frame.format == ReadbackFormat::Bgra8;
+    const uint64_t rowBytes = rgba ? uint64_t(frame.extent.width) * 4 : frame.rowPitch;
+    const uint64_t rows = frame.size / frame.rowPitch;
+    const uint8_t* data = static_cast<const uint8_t*>(frame.data);
+
+    uint64_t sum = 0;
+    for (uint64_t y = 0; y < rows; ++y)
+    {
+        const uint8_t* row = data + y * frame.rowPitch;
+        for (uint64_t x = 0; x + sizeof(uint32_t) <= rowBytes; x += sizeof(uint32_t))
+        {
+            uint32_t word;
+            memcpy(&word, row + x, sizeof(word));
+            sum += word;
+        }
+    }
+    return sum;
+}
+} // namespace
+
+Readback::Readback(Context& context, Interop& interop, const Settings& settings) :
+    m_context(context),
+    m_interop(interop),
+    m_device(context.getDevice())
+{
+    // The shared image keeps its size while readback is enabled
+    const VkExtent2D imageExtent = interop.getSharedImageExtent();
+    m_region.offset = {settings.readbackRegionX, settings.readbackRegionY};
+    m_region.extent.width = settings.readbackRegionWidth > 0 ? settings.readbackRegionWidth : imageExtent.width - settings.readbackRegionX;
+    m_region.extent.height = settings.readbackRegionHeight > 0 ? settings.readbackRegionHeight : imageExtent.height - settings.readbackRegionY;
+    CHECK(m_region.offset.x + m_region.extent.width <= imageExtent.width);
+    CHECK(m_region.offset.y + m_region.extent.height <= imageExtent.height);
+
+    m_inPlace = settings.readbackMethod == ReadbackMethod::Mapped && interop.isSharedImageHostAccessible();
+    if (settings.readbackMethod == ReadbackMethod::Mapped && !m_inPlace)
+    {
+        printf("Readback: shared image is not host accessible, using compute readback\n");
+    }
+
+    m_format = settings.readbackFormat;
+    m_filter = settings.readbackFilter;
+    if (m_inPlace)
+    {
+        // Mapped pixels are used as they are, without scaling or packing on the GPU
+        m_outputExtent = m_region.extent;
+        if (m_format == ReadbackFormat::Rgb565 || m_format == ReadbackFormat::Gray8)
+        {
+            printf("Readback: %s is not supported by mapped readback\n", getFormatName(m_format));
+        }
+        CHECK(m_format != ReadbackFormat::Rgb565 && m_format != ReadbackFormat::Gray8);
+    }
+    else
+    {
+        m_outputExtent = {static_cast<uint32_t>(settings.readbackWidth), static_cast<uint32_t>(settings.readbackHeight)};
+    }
+
+    const bool convertedOnHost = m_format == ReadbackFormat::Bgra8 || m_format == ReadbackFormat::Nv12;
+    m_gpuFormat = convertedOnHost ? ReadbackFormat::Rgba8 : m_format;
+
+    const uint32_t pixelsPerWord = getPixelsPerWord(m_gpuFormat);
+    m_wordsPerRow = (m_outputExtent.width + pixelsPerWord - 1) / pixelsPerWord;
+    m_bufferSize = uint64_t(m_wordsPerRow) * sizeof(uint32_t) * m_outputExtent.height;
+
+    if (m_format == ReadbackFormat::Bgra8)
+    {
+        m_hostBuffer.resize(m_bufferSize);
+    }
+    else if (m_format == ReadbackFormat::Nv12)
+    {
+        CHECK(m_outputExtent.width % 2 == 0 && m_outputExtent.height % 2 == 0);
+        m_hostBuffer.resize(size_t(m_outputExtent.width) * m_outputExtent.height * 3 / 2);
+    }
+
+    if (!m_inPlace)
+    {
+        createSampler();
+        createDescriptorSetLayout();
+        createPipeline();
+        createBuffers();
+        createDescriptorPool();
+        createDescriptorSets();
+    }
+
+    const uint64_t fullFrameSize = uint64_t(imageExtent.width) * imageExtent.height * 4;
+    printf("Readback: %s, region %ux%u+%d+%d to %ux%u %s, %llu bytes per frame (%.1f%% of a full frame), %s pixel kernels\n",
+           m_inPlace ? "mapped" : "compute",
+           m_region.extent.width,
+           m_region.extent.height,
+           m_region.offset.x,
+           m_region.offset.y,
+           m_outputExtent.width,
+           m_outputExtent.height,
+           getFormatName(m_format),
+           static_cast<unsigned long long>(m_bufferSize),
+           100.0 * double(m_bufferSize) / double(fullFrameSize),
+           getPixelKernelSetName(getPixelKernelSet()));
+}
+
+Readback::~Readback()
+{
+    vkDeviceWaitIdle(m_device);
+
+    const double frames = m_frameCount > 0 ? double(m_frameCount) : 1.0;
+    printf("Readback: %llu frames, %.1f MB transferred, %.3f ms waiting and %.3f ms reading per frame\n",
+           static_cast<unsigned long long>(m_frameCount),
+           double(m_frameCount * m_bufferSize) / (1024.0 * 1024.0),
+           m_waitMilliseconds / frames,
+           m_readMilliseconds / frames);
+    if (!m_callback)
+    {
+        // Printed so that the compiler can't drop the reads, and to compare the two methods on the same content
+        printf("Readback: checksum %016llx\n", static_cast<unsigned long long>(m_checksum));
+    }
+
+    for (const Slot& slot : m_slots)
+    {
+        vkUnmapMemory(m_device, slot.memory);
+        vkDestroyBuffer(m_device, slot.buffer, nullptr);
+        vkFreeMemory(m_device, slot.memory, nullptr);
+    }
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+    vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+void Readback::setCallback(Callback callback)
+{
+    m_callback = callback;
+}
+
+bool Readback::isInPlace() const
+{
+    return m_inPlace;
+}
+
+void Readback::addPass(FrameGraph& graph, FrameGraph::Resource sharedImage, uint32_t slot)
+{
+    if (m_inPlace)
+    {
+        // The host reads the mapped shared image once the frame is complete, the pass only declares the read
+        const FrameGraph::Pass pass = graph.addPass("Readback", nullptr);
+        graph.read(pass, sharedImage, m_interop.getSharedImageReadAccess(VK_PIPELINE_STAGE_HOST_BIT));
+        graph.setSideEffects(pass);
+        return;
+    }
+
+    PushConstants pushConstants{};
+    pushConstants.regionOffset[0] = m_region.offset.x;
+    pushConstants.regionOffset[1] = m_region.offset.y;
+    pushConstants.regionExtent[0] = static_cast<int32_t>(m_region.extent.width);
+    pushConstants.regionExtent[1] = static_cast<int32_t>(m_region.extent.height);
+    pushConstants.outputExtent[0] = static_cast<int32_t>(m_outputExtent.width);
+    pushConstants.outputExtent[1] = static_cast<int32_t>(m_outputExtent.height);
+    pushConstants.wordsPerRow = m_wordsPerRow;
+    pushConstants.format = static_cast<uint32_t>(m_gpuFormat);
+    pushConstants.filter = static_cast<uint32_t>(m_filter);
+
+    VkDescriptorSet descriptorSet = m_slots[slot].descriptorSet;
+    const FrameGraph::Pass pass = graph.addPass("Readback", [this, descriptorSet, pushConstants](VkCommandBuffer cb) {
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+        const uint32_t groupCountX = (m_wordsPerRow + c_workgroupSize - 1) / c_workgroupSize;
+        const uint32_t groupCountY = (m_outputExtent.height + c_workgroupSize - 1) / c_workgroupSize;
+        vkCmdDispatch(cb, groupCountX, groupCountY, 1);
+    });
+
+    // The host read the buffer before the slot is recorded again, the export makes the new content visible to it
+    const FrameGraph::Access hostRead{VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED};
+    const FrameGraph::Resource buffer = graph.importBuffer(m_slots[slot].buffer, hostRead);
+    graph.read(pass, sharedImage, m_interop.getSharedImageReadAccess(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+    graph.write(pass, buffer, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED}, true);
+    graph.exportResource(buffer, hostRead);
+
+    m_slots[slot].pending = true;
+}
+
+void Readback::markReused(uint32_t slot)
+{
+    m_slots[slot].pending = !m_inPlace;
+}
+
+void Readback::collect(uint32_t slot)
+{
+    if (m_inPlace)
+    {
+        return;
+    }
+
+    Slot& s = m_slots[slot];
+    if (!s.pending)
+    {
+        return;
+    }
+    s.pending = false;
+    ++m_frameCount;
+
+    const Timer timer;
+    deliver(static_cast<const uint8_t*>(s.data), m_wordsPerRow * sizeof(uint32_t));
+    m_readMilliseconds += timer.elapsedMilliseconds();
+}
+
+void Readback::collectInPlace()
+{
+    CHECK(m_inPlace);
+
+    Timer timer;
+    m_context.waitForSubmittedFrame();
+    m_waitMilliseconds += timer.elapsedMilliseconds();
+    timer.reset();
+
+    const Interop::HostImage image = m_interop.getSharedImageHostMapping();
+    const uint8_t* rgba = image.data + m_region.offset.y * image.rowPitch + m_region.offset.x * 4;
+    deliver(rgba, static_cast<uint32_t>(image.rowPitch));
+    ++m_frameCount;
+    m_readMilliseconds += timer.elapsedMilliseconds();
+}
+
+void Readback::deliver(const uint8_t* rgba, uint32_t rowPitch)
+{
+    Frame frame{};
+    frame.data = rgba;
+    frame.size = uint64_t(rowPitch) * m_outputExtent.height;
+    frame.rowPitch = rowPitch;
+    frame.extent = m_outputExtent;
+    frame.format = m_format;
+
+    if (m_format == ReadbackFormat::Bgra8)
+    {
+        const uint32_t tightPitch = m_outputExtent.width * 4;
+        for (uint32_t y = 0; y < m_outputExtent.height; ++y)
+        {
+            swizzleRgbaBgra(rgba + size_t(y) * rowPitch, m_hostBuffer.data() + size_t(y) * tightPitch, m_outputExtent.width);
+        }
+        frame.data = m_hostBuffer.data();
+        frame.size = uint64_t(tightPitch) * m_outputExtent.height;
+        frame.rowPitch = tightPitch;
+    }
+    else if (m_format == ReadbackFormat::Nv12)
+    {
+        uint8_t* y = m_hostBuffer.data();
+        uint8_t* uv = y + size_t(m_outputExtent.width) * m_outputExtent.height;
+        rgbaToNv12(rgba, rowPitch, m_outputExtent.width, m_outputExtent.height, y, m_outputExtent.width, uv, m_outputExtent.width);
+        frame.data = m_hostBuffer.data();
+        frame.size = m_hostBuffer.size();
+        frame.rowPitch = m_outputExtent.width;
+    }
+
+    if (m_callback)
+    {
+        m_callback(frame);
+    }
+    else
+    {
+        m_checksum += checksum(frame);
+    }
+}
+
+void Readback::createSampler()
+{
+    VkSamplerCreateInfo samplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VK_CHECK(vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_sampler));
+}
+
+void Readback::createDescriptorSetLayout()
+{
+    VkDescriptorSetLayoutBinding imageLayoutBinding{};
+    imageLayoutBinding.binding = 0;
+    imageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    imageLayoutBinding.descriptorCount = 1;
+    imageLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding bufferLayoutBinding{};
+    bufferLayoutBinding.binding = 1;
+    bufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bufferLayoutBinding.descriptorCount = 1;
+    bufferLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    const std::vector<VkDescriptorSetLayoutBinding> bindings{imageLayoutBinding, bufferLayoutBinding};
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+}
+
+void Readback::createPipeline()
+{
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+
+    VkShaderModule shaderModule = createShaderModule(m_device, "shaders/readback.comp.spv");
+
+    VkPipelineShaderStageCreateInfo shaderStageInfo{};
+    shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderStageInfo.module = shaderModule;
+    shaderStageInfo.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = shaderStageInfo;
+    pipelineInfo.layout = m_pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+
+    vkDestroyShaderModule(m_device, shaderModule, nullptr);
+}
+
+void Readback::createBuffers()
+{
+    VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    const VkMemoryPropertyFlags coherentProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    m_slots.resize(m_context.getFrameCount());
+    for (Slot& slot : m_slots)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = m_bufferSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, nullptr, &slot.buffer));
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, slot.buffer, &memRequirements);
+
+        // Cached memory makes host reads considerably faster where available
+        MemoryTypeResult memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, coherentProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        if (!memoryTypeResult.found)
+        {
+            memoryTypeResult = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, coherentProperties);
+        }
+        CHECK(memoryTypeResult.found);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+        VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &slot.memory));
+        VK_CHECK(vkBindBufferMemory(m_device, slot.buffer, slot.memory, 0));
+        VK_CHECK(vkMapMemory(m_device, slot.memory, 0, m_bufferSize, 0, &slot.data));
+
+        slot.pending = false;
+    }
+}
+
+void Readback::createDescriptorPool()
+{
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = ui32Size(m_slots);
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = ui32Size(m_slots);
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = ui32Size(poolSizes);
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = ui32Size(m_slots);
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+}
+
+void Readback::createDescriptorSets()
+{
+    for (Slot& slot : m_slots)
+    {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+        VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, &slot.descriptorSet));
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = m_interop.getSharedImageReadLayout();
+        imageInfo.imageView = m_interop.getSharedImageView();
+        imageInfo.sampler = m_sampler;
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = slot.descriptorSet;
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pImageInfo = &imageInfo;
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = slot.buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = m_bufferSize;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = slot.descriptorSet;
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Context.hpp"
+#include "FrameGraph.hpp"
+#include "Interop.hpp"
+#include "Settings.hpp"
+#include <vector>
+#include <functional>
+
+class Readback final
+{
+public:
+    // NV12 frames have the Y plane followed by the interleaved UV plane, both with rowPitch
+    struct Frame
+    {
+        const void* data;
+        uint64_t size;
+        uint32_t rowPitch;
+        VkExtent2D extent;
+        ReadbackFormat format;
+    };
+
+    using Callback = std::function<void(const Frame&)>;
+
+    Readback(Context& context, Interop& interop, const Settings& settings);
+    ~Readback();
+
+    void setCallback(Callback callback);
+    bool isInPlace() const;
+    // Adds the pass reading the shared image into the slot's buffer, or the host read of the mapped image
+    void addPass(FrameGraph& graph, FrameGraph::Resource sharedImage, uint32_t slot);
+    // The slot's commands are submitted again in a command buffer recorded earlier
+    void markReused(uint32_t slot);
+    // The previous submission using the slot has to be complete
+    void collect(uint32_t slot);
+    // Waits for the frame just submitted and reads the mapped shared image before GL writes it again
+    void collectInPlace();
+
+private:
+    struct Slot
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        void* data;
+        VkDescriptorSet descriptorSet;
+        bool pending;
+    };
+
+    void createSampler();
+    void createDescriptorSetLayout();
+    void createPipeline();
+    void createBuffers();
+    void createDescriptorPool();
+    void createDescriptorSets();
+    void deliver(const uint8_t* rgba, uint32_t rowPitch);
+
+    Context& m_context;
+    Interop& m_interop;
+    VkDevice m_device;
+
+    bool m_inPlace;
+    VkRect2D m_region;
+    VkExtent2D m_outputExtent;
+    ReadbackFormat m_format;
+    ReadbackFormat m_gpuFormat;
+    ReadbackFilter m_filter;
+    uint32_t m_wordsPerRow;
+    uint64_t m_bufferSize;
+
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> m_slots;
+    std::vector<uint8_t> m_hostBuffer;
+    Callback m_callback;
+    uint64_t m_frameCount = 0;
+    uint64_t m_checksum = 0;
+    double m_waitMilliseconds = 0.0;
+    double m_readMilliseconds = 0.0;
+};
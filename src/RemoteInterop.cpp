@@ -0,0 +1,377 @@
+#include "RemoteInterop.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace
+{
+void closeHandle(ExternalHandle handle)
+{
+#ifdef _WIN32
+    CloseHandle(handle);
+#else
+    close(handle);
+#endif
+}
+} // namespace
+
+RemoteProducer::RemoteProducer(Interop& interop, const std::string& socketPath) :
+    m_interop(interop)
+{
+    if (m_interop.getTransport() != InteropTransport::ExternalMemory)
+    {
+        printf("IPC: a producer process needs the external memory transport\n");
+        CHECK(false);
+    }
+    m_channel = IpcChannel::listen(socketPath);
+    m_queue = std::make_unique<FrameQueue>(*m_channel);
+    if (!sendSharedImage(IpcMessageType::Setup))
+    {
+        printf("IPC: the producer disconnected\n");
+        m_connected = false;
+    }
+}
+
+RemoteProducer::~RemoteProducer()
+{
+    if (m_connected)
+    {
+        FrameRequest request{};
+        request.frame = ++m_frame;
+        request.teardown = true;
+        m_queue->pushRequest(request);
+    }
+}
+
+bool RemoteProducer::render()
+{
+    if (!m_connected)
+    {
+        return false;
+    }
+
+    // Vulkan replaced the shared image after a resize, the producer imports it before rendering again
+    if (m_sentGeneration != m_interop.getSharedImageGeneration() && !sendSharedImage(IpcMessageType::Resize))
+    {
+        printf("IPC: the producer disconnected\n");
+        m_connected = false;
+        return false;
+    }
+
+    FrameRequest request{};
+    request.frame = ++m_frame;
+    request.generation = m_sentGeneration;
+    request.renderExtent = m_interop.getRenderExtent();
+    request.toggleAnimation = m_toggleAnimation;
+    request.sentNanoseconds = getSteadyNanoseconds();
+    m_toggleAnimation = false;
+
+    FrameReply reply{};
+    if (!m_queue->pushRequest(request) || !m_queue->popReply(reply))
+    {
+        printf("IPC: the producer disconnected\n");
+        m_connected = false;
+        return false;
+    }
+    CHECK(reply.frame == request.frame);
+    ++m_roundTrips;
+    m_roundTripNanoseconds += getSteadyNanoseconds() - request.sentNanoseconds;
+    m_pickupNanoseconds += reply.receivedNanoseconds - request.sentNanoseconds;
+
+    m_gpuMilliseconds = reply.gpuMilliseconds;
+    m_gpuSampleCount = reply.gpuSampleCount;
+    if (reply.published)
+    {
+        for (uint32_t i = 0; i < std::min(reply.damageCount, c_maxIpcDamageRects); ++i)
+        {
+            m_interop.addDamage(reply.damage[i]);
+        }
+        m_interop.publishContent();
+    }
+    return reply.running != 0;
+}
+
+void RemoteProducer::toggleAnimation()
+{
+    // Sent with the next frame
+    m_toggleAnimation = !m_toggleAnimation;
+}
+
+void RemoteProducer::printStatistics(double)
+{
+    const FrameQueue::WaitStatistics waits = m_queue->takeWaitStatistics();
+    if (m_roundTrips > 0)
+    {
+        // One request at a time, a reply takes a whole GL frame and usually outlasts the spin
+        printf("IPC: %.1f us per frame round trip, %.1f us until the producer picked it up, %.1f%% of waits for a reply slept in the kernel (one frame in flight)\n",
+               double(m_roundTripNanoseconds) / 1000.0 / double(m_roundTrips), double(m_pickupNanoseconds) / 1000.0 / double(m_roundTrips),
+               waits.waits > 0 ? double(waits.sleeps) * 100.0 / double(waits.waits) : 0.0);
+        m_roundTrips = 0;
+        m_roundTripNanoseconds = 0;
+        m_pickupNanoseconds = 0;
+    }
+}
+
+double RemoteProducer::getGpuMilliseconds() const
+{
+    return m_gpuMilliseconds;
+}
+
+uint64_t RemoteProducer::getGpuSampleCount() const
+{
+    return m_gpuSampleCount;
+}
+
+bool RemoteProducer::sendSharedImage(IpcMessageType type)
+{
+    IpcMessage message{};
+    message.type = type;
+    message.extent = m_interop.getSharedImageExtent();
+    message.renderExtent = m_interop.getRenderExtent();
+    message.generation = m_interop.getSharedImageGeneration();
+    message.memoryCount = m_interop.getSharedImageMemoryCount();
+    message.format = m_interop.getSharedImageFormat();
+    message.hostAccessible = m_interop.isSharedImageHostAccessible();
+    message.damageTracking = m_interop.isDamageTracking();
+    message.depthSharing = m_interop.isDepthSharing();
+    std::memcpy(message.deviceUUID, m_interop.getDeviceUUID().data(), VK_UUID_SIZE);
+
+    std::vector<ExternalHandle> handles;
+    if (type == IpcMessageType::Setup)
+    {
+        handles.push_back(m_queue->getHandle());
+        handles.push_back(m_interop.getVKReadyHandle());
+        handles.push_back(m_interop.getGLCompleteHandle());
+    }
+    for (uint32_t i = 0; i < message.memoryCount; ++i)
+    {
+        message.memorySizes[i] = m_interop.getSharedImageMemorySize(i);
+        handles.push_back(m_interop.getSharedImageMemoryHandle(i));
+    }
+    if (message.depthSharing)
+    {
+        message.depthMemorySize = m_interop.getSharedDepthMemorySize();
+        handles.push_back(m_interop.getSharedDepthMemoryHandle());
+    }
+    const bool sent = m_channel->send(message, handles);
+    m_sentGeneration = message.generation;
+
+    // The producer received its own copies and takes ownership of them instead of an in-process GL, the queue
+    // keeps its handle. Without a producer nobody imports them.
+    for (size_t i = type == IpcMessageType::Setup ? 1 : 0; i < handles.size(); ++i)
+    {
+        closeHandle(handles[i]);
+    }
+    return sent;
+}
+
+RemoteInterop::RemoteInterop(const std::string& socketPath) :
+    m_channel(IpcChannel::connect(socketPath))
+{
+    IpcMessage message{};
+    std::vector<ExternalHandle> handles;
+    CHECK(m_channel->receive(message, handles) && message.type == IpcMessageType::Setup && handles.size() >= 3);
+    m_queue = std::make_unique<FrameQueue>(*m_channel, handles[0]);
+
+    m_format = message.format;
+    m_hostAccessible = message.hostAccessible != 0;
+    m_damageTracking = message.damageTracking != 0;
+    m_depthSharing = message.depthSharing != 0;
+    std::memcpy(m_deviceUUID.data(), message.deviceUUID, VK_UUID_SIZE);
+    m_vkReadyHandle = handles[1];
+    m_glCompleteHandle = handles[2];
+    handles.erase(handles.begin(), handles.begin() + 3);
+    takeSharedImage(message, handles);
+    printf("IPC: shared image %ux%u\n", m_extent.width, m_extent.height);
+}
+
+bool RemoteInterop::receiveRender(bool& toggleAnimation)
+{
+    if (!m_queue->popRequest(m_request))
+    {
+        printf("IPC: the consumer disconnected\n");
+        return false;
+    }
+    m_receivedNanoseconds = getSteadyNanoseconds();
+    if (m_request.teardown)
+    {
+        printf("IPC: the consumer finished\n");
+        return false;
+    }
+
+    // The consumer sent the new shared image before the request, only a resize touches the socket
+    while (m_generation != m_request.generation)
+    {
+        IpcMessage message{};
+        std::vector<ExternalHandle> handles;
+        if (!m_channel->receive(message, handles))
+        {
+            printf("IPC: the consumer disconnected\n");
+            return false;
+        }
+        CHECK(message.type == IpcMessageType::Resize);
+        takeSharedImage(message, handles);
+    }
+
+    m_renderExtent = m_request.renderExtent;
+    toggleAnimation = m_request.toggleAnimation != 0;
+    m_damage.clear();
+    m_published = false;
+    return true;
+}
+
+void RemoteInterop::sendRendered(bool running, double gpuMilliseconds, uint64_t gpuSampleCount)
+{
+    FrameReply reply{};
+    reply.frame = m_request.frame;
+    reply.running = running;
+    reply.published = m_published;
+    reply.gpuMilliseconds = gpuMilliseconds;
+    reply.gpuSampleCount = gpuSampleCount;
+    reply.receivedNanoseconds = m_receivedNanoseconds;
+    if (m_damage.size() <= c_maxIpcDamageRects)
+    {
+        reply.damageCount = ui32Size(m_damage);
+        std::copy(m_damage.begin(), m_damage.end(), reply.damage);
+    }
+    else
+    {
+        // Too many to send, the frame is treated as changing all of the shared image
+        reply.damageCount = 1;
+        reply.damage[0] = {{0, 0}, m_extent};
+    }
+    // A consumer that went away is noticed by the next request
+    m_queue->pushReply(reply);
+}
+
+InteropTransport RemoteInterop::getTransport() const
+{
+    return InteropTransport::ExternalMemory;
+}
+
+void RemoteInterop::fallbackToHostCopy(const char* reason)
+{
+    // The consumer can't switch transports any more, and host copies don't leave its process
+    printf("IPC: %s, a producer process needs the external memory transport\n", reason);
+    CHECK(false);
+}
+
+uint64_t RemoteInterop::getSharedImageGeneration() const
+{
+    return m_generation;
+}
+
+VkExtent2D RemoteInterop::getSharedImageExtent() const
+{
+    return m_extent;
+}
+
+VkExtent2D RemoteInterop::getRenderExtent() const
+{
+    return m_renderExtent;
+}
+
+SharedImageFormat RemoteInterop::getSharedImageFormat() const
+{
+    return m_format;
+}
+
+bool RemoteInterop::isSharedImageHostAccessible() const
+{
+    return m_hostAccessible;
+}
+
+bool RemoteInterop::isDamageTracking() const
+{
+    return m_damageTracking;
+}
+
+void RemoteInterop::addDamage(const VkRect2D& rect)
+{
+    m_damage.push_back(rect);
+}
+
+void RemoteInterop::publishContent()
+{
+    m_published = true;
+}
+
+void* RemoteInterop::acquireHostWriteSlot()
+{
+    CHECK(false);
+    return nullptr;
+}
+
+void RemoteInterop::submitHostWriteSlot()
+{
+    CHECK(false);
+}
+
+uint64_t RemoteInterop::getHostFrameSize() const
+{
+    CHECK(false);
+    return 0;
+}
+
+const std::array<uint8_t, VK_UUID_SIZE>& RemoteInterop::getDeviceUUID() const
+{
+    return m_deviceUUID;
+}
+
+ExternalHandle RemoteInterop::getGLCompleteHandle() const
+{
+    return m_glCompleteHandle;
+}
+
+ExternalHandle RemoteInterop::getVKReadyHandle() const
+{
+    return m_vkReadyHandle;
+}
+
+uint32_t RemoteInterop::getSharedImageMemoryCount() const
+{
+    return ui32Size(m_memoryHandles);
+}
+
+ExternalHandle RemoteInterop::getSharedImageMemoryHandle(uint32_t index) const
+{
+    return m_memoryHandles[index];
+}
+
+uint64_t RemoteInterop::getSharedImageMemorySize(uint32_t index) const
+{
+    return m_memorySizes[index];
+}
+
+bool RemoteInterop::isDepthSharing() const
+{
+    return m_depthSharing;
+}
+
+ExternalHandle RemoteInterop::getSharedDepthMemoryHandle() const
+{
+    return m_depthHandle;
+}
+
+uint64_t RemoteInterop::getSharedDepthMemorySize() const
+{
+    return m_depthMemorySize;
+}
+
+void RemoteInterop::takeSharedImage(const IpcMessage& message, const std::vector<ExternalHandle>& handles)
+{
+    CHECK(handles.size() == message.memoryCount + (m_depthSharing ? 1 : 0));
+    m_generation = message.generation;
+    m_extent = message.extent;
+    m_renderExtent = message.renderExtent;
+    m_memoryHandles.assign(handles.begin(), handles.begin() + message.memoryCount);
+    m_memorySizes.assign(message.memorySizes, message.memorySizes + message.memoryCount);
+    if (m_depthSharing)
+    {
+        m_depthHandle = handles.back();
+        m_depthMemorySize = message.depthMemorySize;
+    }
+}
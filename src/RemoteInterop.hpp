@@ -0,0 +1,116 @@
+#pragma once
+
+#include "FrameQueue.hpp"
+#include "Interop.hpp"
+#include "InteropEndpoint.hpp"
+#include "IpcChannel.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// The two ends of a GL producer running in its own process. The consumer exports the shared image and the
+// semaphores as usual and sends their handles, the producer imports them like an in-process GLRenderer would.
+// Every frame is a request and its answer through the FrameQueue: the consumer only lets GL render after it
+// submitted the signal of the ready semaphore and only waits for the complete semaphore after GL flushed its
+// signal, the same order as with both in one process. Only the external memory transport can be shared, host
+// copies stay in one process.
+
+// Consumer side, stands in for GLRenderer in the Vulkan process
+class RemoteProducer final : public FrameProducer
+{
+public:
+    // Blocks until a producer connects to the socket
+    RemoteProducer(Interop& interop, const std::string& socketPath);
+    ~RemoteProducer();
+
+    bool render() override;
+    void toggleAnimation() override;
+    // Round trips of the frame queue, the producer prints GL's statistics itself
+    void printStatistics(double seconds) override;
+    double getGpuMilliseconds() const override;
+    uint64_t getGpuSampleCount() const override;
+
+private:
+    // Returns false once the producer is gone
+    bool sendSharedImage(IpcMessageType type);
+
+    Interop& m_interop;
+    std::unique_ptr<IpcChannel> m_channel;
+    std::unique_ptr<FrameQueue> m_queue;
+    uint64_t m_sentGeneration = 0;
+    uint64_t m_frame = 0;
+    bool m_toggleAnimation = false;
+    bool m_connected = true;
+    double m_gpuMilliseconds = 0.0;
+    uint64_t m_gpuSampleCount = 0;
+    uint64_t m_roundTrips = 0;
+    uint64_t m_roundTripNanoseconds = 0;
+    uint64_t m_pickupNanoseconds = 0;
+};
+
+// Producer side, what GLRenderer renders into in the GL process
+class RemoteInterop final : public InteropEndpoint
+{
+public:
+    // Connects to a waiting consumer and receives the shared image
+    explicit RemoteInterop(const std::string& socketPath);
+
+    // Waits for the consumer's next frame, a new shared image is taken over on the way. Returns false once the
+    // consumer tears the connection down.
+    bool receiveRender(bool& toggleAnimation);
+    // Answers the frame with the damage and whether GL published new content
+    void sendRendered(bool running, double gpuMilliseconds, uint64_t gpuSampleCount);
+
+    InteropTransport getTransport() const override;
+    void fallbackToHostCopy(const char* reason) override;
+
+    uint64_t getSharedImageGeneration() const override;
+    VkExtent2D getSharedImageExtent() const override;
+    VkExtent2D getRenderExtent() const override;
+    SharedImageFormat getSharedImageFormat() const override;
+    bool isSharedImageHostAccessible() const override;
+    bool isDamageTracking() const override;
+    void addDamage(const VkRect2D& rect) override;
+    void publishContent() override;
+
+    void* acquireHostWriteSlot() override;
+    void submitHostWriteSlot() override;
+    uint64_t getHostFrameSize() const override;
+
+    const std::array<uint8_t, VK_UUID_SIZE>& getDeviceUUID() const override;
+    ExternalHandle getGLCompleteHandle() const override;
+    ExternalHandle getVKReadyHandle() const override;
+    uint32_t getSharedImageMemoryCount() const override;
+    ExternalHandle getSharedImageMemoryHandle(uint32_t index = 0) const override;
+    uint64_t getSharedImageMemorySize(uint32_t index = 0) const override;
+    bool isDepthSharing() const override;
+    ExternalHandle getSharedDepthMemoryHandle() const override;
+    uint64_t getSharedDepthMemorySize() const override;
+
+private:
+    // GL imports the handles of a Setup or Resize message before the next frame and takes ownership of them
+    void takeSharedImage(const IpcMessage& message, const std::vector<ExternalHandle>& handles);
+
+    std::unique_ptr<IpcChannel> m_channel;
+    std::unique_ptr<FrameQueue> m_queue;
+    FrameRequest m_request{};
+    uint64_t m_receivedNanoseconds = 0;
+    SharedImageFormat m_format = SharedImageFormat::Rgba8;
+    bool m_hostAccessible = false;
+    bool m_damageTracking = false;
+    bool m_depthSharing = false;
+    std::array<uint8_t, VK_UUID_SIZE> m_deviceUUID{};
+    ExternalHandle m_glCompleteHandle = c_invalidExternalHandle;
+    ExternalHandle m_vkReadyHandle = c_invalidExternalHandle;
+
+    uint64_t m_generation = 0;
+    VkExtent2D m_extent{};
+    VkExtent2D m_renderExtent{};
+    std::vector<ExternalHandle> m_memoryHandles;
+    std::vector<uint64_t> m_memorySizes;
+    ExternalHandle m_depthHandle = c_invalidExternalHandle;
+    uint64_t m_depthMemorySize = 0;
+
+    std::vector<VkRect2D> m_damage;
+    bool m_published = false;
+};
@@ -0,0 +1,147 @@
+#include "ResolutionController.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Changes aim below the budget so that small fluctuations don't immediately cause the next change
+const double c_targetLoad = 0.85;
+// Hysteresis band, the scale is held while the average frame time stays between the thresholds
+const double c_upperThreshold = 0.95;
+const double c_lowerThreshold = 0.7;
+// A single frame this far over the budget is acted on without waiting for the average
+const double c_spikeThreshold = 1.25;
+const double c_smoothing = 0.1;
+// GPU times are read a few frames after submission, frames rendered at the old scale are skipped
+const uint32_t c_settleFrames = 8;
+const uint32_t c_increaseDelayFrames = 60;
+const float c_maxIncrease = 0.05f;
+const float c_minChange = 0.01f;
+} // namespace
+
+ResolutionController::ResolutionController(Interop& interop, const Settings& settings) :
+    m_interop(interop),
+    m_budget(settings.targetFrameMilliseconds),
+    m_settleFrames(c_settleFrames)
+{
+    CHECK(interop.isRenderScaling() && m_budget > 0.0);
+    printf("Resolution: %.2f ms GPU budget per frame, starting at %.0f%% scale\n", m_budget, m_interop.getRenderScale() * 100.0f);
+}
+
+void ResolutionController::update(double glMilliseconds, double vkMilliseconds)
+{
+    const float scale = m_interop.getRenderScale();
+    const double frameMilliseconds = glMilliseconds + vkMilliseconds;
+    ++m_frames;
+    m_scaleSum += scale;
+    if (frameMilliseconds > m_budget)
+    {
+        ++m_framesOverBudget;
+    }
+
+    // Nothing measured yet, or the implementation can't measure one of the APIs
+    if (glMilliseconds <= 0.0 || vkMilliseconds <= 0.0)
+    {
+        return;
+    }
+
+    if (m_settleFrames > 0)
+    {
+        // The averages start over from the first samples at the new scale
+        --m_settleFrames;
+        m_glAverage = glMilliseconds;
+        m_vkAverage = vkMilliseconds;
+        return;
+    }
+
+    const bool spike = frameMilliseconds > m_budget * c_spikeThreshold;
+    if (spike)
+    {
+        m_glAverage = glMilliseconds;
+        m_vkAverage = vkMilliseconds;
+    }
+    else
+    {
+        m_glAverage += (glMilliseconds - m_glAverage) * c_smoothing;
+        m_vkAverage += (vkMilliseconds - m_vkAverage) * c_smoothing;
+    }
+    const double average = m_glAverage + m_vkAverage;
+
+    if (spike || average > m_budget * c_upperThreshold)
+    {
+        m_underBudgetFrames = 0;
+        if (scale > c_minRenderScale)
+        {
+            changeScale(std::min(getScaleForBudget(scale), scale - c_minChange), spike ? "spike" : "over budget", average);
+        }
+        return;
+    }
+
+    if (average >= m_budget * c_lowerThreshold || scale >= 1.0f)
+    {
+        m_underBudgetFrames = 0;
+        return;
+    }
+
+    // Going up is slow so that a scene that only briefly got cheaper doesn't make the scale oscillate
+    if (++m_underBudgetFrames >= c_increaseDelayFrames)
+    {
+        m_underBudgetFrames = 0;
+        changeScale(std::min(getScaleForBudget(scale), scale + c_maxIncrease), "under budget", average);
+    }
+}
+
+void ResolutionController::printStatistics()
+{
+    if (m_frames == 0)
+    {
+        return;
+    }
+
+    printf("Resolution: %.0f%% average scale, %llu of %llu timed frames over the %.2f ms budget, %llu scale changes\n",
+           m_scaleSum * 100.0 / double(m_frames),
+           static_cast<unsigned long long>(m_framesOverBudget),
+           static_cast<unsigned long long>(m_frames),
+           m_budget,
+           static_cast<unsigned long long>(m_scaleChanges));
+
+    m_frames = 0;
+    m_framesOverBudget = 0;
+    m_scaleChanges = 0;
+    m_scaleSum = 0.0;
+}
+
+float ResolutionController::getScaleForBudget(float scale) const
+{
+    // GL time follows the pixel count, the square of the scale
+    const double glBudget = m_budget * c_targetLoad - m_vkAverage;
+    if (glBudget <= 0.0)
+    {
+        return c_minRenderScale;
+    }
+    return float(scale * std::sqrt(glBudget / m_glAverage));
+}
+
+void ResolutionController::changeScale(float scale, const char* reason, double frameMilliseconds)
+{
+    const float previous = m_interop.getRenderScale();
+    scale = std::clamp(scale, c_minRenderScale, 1.0f);
+    if (std::abs(scale - previous) < c_minChange)
+    {
+        return;
+    }
+
+    m_interop.setRenderScale(scale);
+    printf("Resolution: %.0f%% -> %.0f%%, %s at %.2f ms GPU (GL %.2f + Vulkan %.2f) for a %.2f ms budget\n",
+           previous * 100.0f,
+           scale * 100.0f,
+           reason,
+           frameMilliseconds,
+           m_glAverage,
+           m_vkAverage,
+           m_budget);
+
+    ++m_scaleChanges;
+    m_settleFrames = c_settleFrames;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Interop.hpp"
+#include "Settings.hpp"
+
+// Steers the render scale so that the GPU time of a frame stays within a budget. GL time is assumed to
+// follow the number of rendered pixels while the Vulkan side costs the same at any scale. Overruns lower
+// the scale right away, the scale only goes up again after the frame time has stayed well below the budget.
+class ResolutionController final
+{
+public:
+    ResolutionController(Interop& interop, const Settings& settings);
+
+    // Called once per new pair of measured GPU times, which lag a few frames behind
+    void update(double glMilliseconds, double vkMilliseconds);
+    void printStatistics();
+
+private:
+    float getScaleForBudget(float scale) const;
+    void changeScale(float scale, const char* reason, double frameMilliseconds);
+
+    Interop& m_interop;
+    double m_budget;
+
+    double m_glAverage = 0.0;
+    double m_vkAverage = 0.0;
+    // Samples measured before a scale change are skipped
+    uint32_t m_settleFrames;
+    uint32_t m_underBudgetFrames = 0;
+
+    uint64_t m_frames = 0;
+    uint64_t m_framesOverBudget = 0;
+    uint64_t m_scaleChanges = 0;
+    double m_scaleSum = 0.0;
+};
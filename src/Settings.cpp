@@ -0,0 +1,309 @@
+#include "Settings.hpp"
+#include "Utils.hpp"
+
+#include <string>
+
+namespace
+{
+void parseSize(const std::string& value, int& width, int& height)
+{
+    const int parsed = sscanf(value.c_str(), "%dx%d", &width, &height);
+    CHECK(parsed == 2 && width > 0 && height > 0);
+}
+
+void parseRect(const std::string& value, int& x, int& y, int& width, int& height)
+{
+    const int parsed = sscanf(value.c_str(), "%d,%d,%d,%d", &x, &y, &width, &height);
+    CHECK(parsed == 4 && x >= 0 && y >= 0 && width > 0 && height > 0);
+}
+
+InteropTransport parseTransport(const std::string& value)
+{
+    if (value == "auto")
+    {
+        return InteropTransport::Auto;
+    }
+    if (value == "external")
+    {
+        return InteropTransport::ExternalMemory;
+    }
+    CHECK(value == "host");
+    return InteropTransport::HostCopy;
+}
+
+SharedImageFormat parseSharedImageFormat(const std::string& value)
+{
+    if (value == "rgba8")
+    {
+        return SharedImageFormat::Rgba8;
+    }
+    CHECK(value == "nv12");
+    return SharedImageFormat::Nv12;
+}
+
+PresentMode parsePresentMode(const std::string& value)
+{
+    if (value == "mailbox")
+    {
+        return PresentMode::Mailbox;
+    }
+    if (value == "fifo")
+    {
+        return PresentMode::Fifo;
+    }
+    if (value == "fifo-relaxed")
+    {
+        return PresentMode::FifoRelaxed;
+    }
+    CHECK(value == "immediate");
+    return PresentMode::Immediate;
+}
+
+UpscaleFilter parseUpscaleFilter(const std::string& value)
+{
+    if (value == "none")
+    {
+        return UpscaleFilter::None;
+    }
+    if (value == "bilinear")
+    {
+        return UpscaleFilter::Bilinear;
+    }
+    CHECK(value == "easu");
+    return UpscaleFilter::Easu;
+}
+
+ReadbackMethod parseReadbackMethod(const std::string& value)
+{
+    if (value == "compute")
+    {
+        return ReadbackMethod::Compute;
+    }
+    CHECK(value == "mapped");
+    return ReadbackMethod::Mapped;
+}
+
+ReadbackFormat parseReadbackFormat(const std::string& value)
+{
+    if (value == "rgba8")
+    {
+        return ReadbackFormat::Rgba8;
+    }
+    if (value == "rgb565")
+    {
+        return ReadbackFormat::Rgb565;
+    }
+    if (value == "bgra8")
+    {
+        return ReadbackFormat::Bgra8;
+    }
+    if (value == "nv12")
+    {
+        return ReadbackFormat::Nv12;
+    }
+    CHECK(value == "gray8");
+    return ReadbackFormat::Gray8;
+}
+
+ReadbackFilter parseReadbackFilter(const std::string& value)
+{
+    if (value == "box")
+    {
+        return ReadbackFilter::Box;
+    }
+    CHECK(value == "lanczos");
+    return ReadbackFilter::Lanczos;
+}
+} // namespace
+
+Settings parseSettings(int argc, char* argv[])
+{
+    Settings settings;
+#ifdef GLVK_EGL
+    settings.surfacelessGL = true;
+#endif
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t separator = argument.find('=');
+        const std::string key = argument.substr(0, separator);
+        const std::string value = separator != std::string::npos ? argument.substr(separator + 1) : "";
+
+        if (key == "--help")
+        {
+            printUsage();
+            exit(0);
+        }
+        else if (key == "--bench-pixels")
+        {
+            settings.benchmarkPixelConversion = true;
+        }
+        else if (key == "--transport")
+        {
+            settings.transport = parseTransport(value);
+        }
+        else if (key == "--present-mode")
+        {
+            settings.presentMode = parsePresentMode(value);
+        }
+        else if (key == "--low-latency")
+        {
+            settings.lowLatency = true;
+        }
+        else if (key == "--outputs")
+        {
+            settings.outputCount = uint32_t(atoi(value.c_str()));
+            CHECK(settings.outputCount >= 1);
+        }
+        else if (key == "--headless")
+        {
+            settings.headless = true;
+        }
+        else if (key == "--frames")
+        {
+            settings.frameLimit = strtoull(value.c_str(), nullptr, 10);
+            CHECK(settings.frameLimit > 0);
+        }
+        else if (key == "--gl-mirror")
+        {
+            settings.glMirror = true;
+            settings.surfacelessGL = false;
+        }
+        else if (key == "--shared-format")
+        {
+            settings.sharedImageFormat = parseSharedImageFormat(value);
+        }
+        else if (key == "--source")
+        {
+            CHECK(!value.empty());
+            settings.source = value;
+        }
+        else if (key == "--render-scale")
+        {
+            settings.renderScaling = true;
+            settings.renderScale = float(atof(value.c_str()));
+            CHECK(settings.renderScale >= c_minRenderScale && settings.renderScale <= 1.0f);
+        }
+        else if (key == "--upscaler")
+        {
+            settings.upscaleFilter = parseUpscaleFilter(value);
+        }
+        else if (key == "--sharpness")
+        {
+            settings.sharpness = float(atof(value.c_str()));
+            CHECK(settings.sharpness >= 0.0f);
+        }
+        else if (key == "--target-frame-time")
+        {
+            settings.renderScaling = true;
+            settings.targetFrameMilliseconds = atof(value.c_str());
+            CHECK(settings.targetFrameMilliseconds > 0.0);
+        }
+        else if (key == "--idle")
+        {
+            settings.idle = true;
+        }
+        else if (key == "--damage")
+        {
+            settings.damageTracking = true;
+        }
+        else if (key == "--cache-commands")
+        {
+            settings.cacheCommandBuffers = true;
+        }
+        else if (key == "--sync2")
+        {
+            settings.synchronization2 = true;
+        }
+        else if (key == "--passthrough")
+        {
+            settings.passthrough = true;
+        }
+        else if (key == "--depth")
+        {
+            settings.depth = true;
+        }
+        else if (key == "--shared-depth")
+        {
+            settings.sharedDepth = true;
+        }
+        else if (key == "--consumer" || key == "--producer")
+        {
+            CHECK(!value.empty());
+            settings.ipcRole = key == "--consumer" ? IpcRole::Consumer : IpcRole::Producer;
+            settings.ipcSocket = value;
+        }
+        else if (key == "--record-threads")
+        {
+            settings.recordThreads = uint32_t(atoi(value.c_str()));
+        }
+        else if (key == "--readback")
+        {
+            settings.readback = true;
+        }
+        else if (key == "--readback-method")
+        {
+            settings.readbackMethod = parseReadbackMethod(value);
+        }
+        else if (key == "--readback-region")
+        {
+            parseRect(value, settings.readbackRegionX, settings.readbackRegionY, settings.readbackRegionWidth, settings.readbackRegionHeight);
+        }
+        else if (key == "--readback-size")
+        {
+            parseSize(value, settings.readbackWidth, settings.readbackHeight);
+        }
+        else if (key == "--readback-format")
+        {
+            settings.readbackFormat = parseReadbackFormat(value);
+        }
+        else if (key == "--readback-filter")
+        {
+            settings.readbackFilter = parseReadbackFilter(value);
+        }
+        else
+        {
+            printf("Unknown argument: %s\n", argument.c_str());
+            printUsage();
+            exit(1);
+        }
+    }
+
+    return settings;
+}
+
+void printUsage()
+{
+    printf("Usage: glvk-interop [options]\n");
+    printf("  --bench-pixels               Benchmark the CPU pixel conversion kernels and exit\n");
+    printf("  --transport=TRANSPORT        auto, external or host (default: auto)\n");
+    printf("  --present-mode=MODE          mailbox, fifo, fifo-relaxed or immediate, falls back when unsupported (default: mailbox)\n");
+    printf("  --low-latency                Keep at most one frame queued for presentation, needs VK_KHR_present_wait\n");
+    printf("  --outputs=N                  Show the frame in N windows or headless surfaces, presented together (default: 1)\n");
+    printf("  --headless                   Present to a headless surface instead of a window, pair with --frames\n");
+    printf("  --frames=N                   Exit after N presented frames\n");
+    printf("  --gl-mirror                  Show the GL output in a window of its own, for debugging\n");
+    printf("  --shared-format=FORMAT       rgba8 or nv12, nv12 needs external memory and no readback (default: rgba8)\n");
+    printf("  --source=SOURCE              Stream frames into the shared image, pattern, a .y4m file or a raw RGBA8 file\n");
+    printf("  --render-scale=SCALE         Render GL at %.2f to 1 of the shared image size and upscale on Vulkan, rgba8 without source or readback only\n", c_minRenderScale);
+    printf("  --upscaler=UPSCALER          easu, bilinear or none (default: easu), - and = change the scale, U the upscaler at runtime\n");
+    printf("  --sharpness=STOPS            Sharpening after EASU, 0 is the sharpest (default: 0.2)\n");
+    printf("  --target-frame-time=MS       Adjust the render scale to keep the GPU time of a frame within MS\n");
+    printf("  --idle                       Wait for events instead of spinning while nothing changes, P pauses the animation\n");
+    printf("  --damage                     Redraw only the changed parts of a mostly static scene, rgba8 without source or render scaling only\n");
+    printf("  --cache-commands             Reuse recorded command buffers until a resize, scale or descriptor change, not with --damage\n");
+    printf("  --record-threads=N           Record the draws of the outputs on N worker threads (default: 0)\n");
+    printf("  --sync2                      Record the frame barriers with VK_KHR_synchronization2 when supported\n");
+    printf("  --passthrough                Blit the shared image to the swapchain without drawing, rgba8 without --damage only\n");
+    printf("  --depth                      Draw the outputs with a transient depth attachment in the smallest depth format\n");
+    printf("  --shared-depth               Share GL's depth with Vulkan draws, rgba8 with external memory, without scaling or --damage\n");
+    printf("  --consumer=SOCKET            Run Vulkan only and wait for a GL producer process on the Unix socket SOCKET\n");
+    printf("  --producer=SOCKET            Run GL only and render for the consumer process on SOCKET, external memory only\n");
+    printf("  --readback                   Read the shared image back to host memory every frame\n");
+    printf("  --readback-method=METHOD     compute or mapped, mapped reads a linear shared image in place (default: compute)\n");
+    printf("  --readback-region=X,Y,W,H    Region of the shared image to read back (default: whole image)\n");
+    printf("  --readback-size=WxH          Size of the downscaled readback (default: 400x300)\n");
+    printf("  --readback-format=FORMAT     rgba8, rgb565, gray8, bgra8 or nv12 (default: rgba8)\n");
+    printf("  --readback-filter=FILTER     box or lanczos (default: box)\n");
+}
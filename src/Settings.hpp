@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class ReadbackFormat : uint32_t
+{
+    Rgba8 = 0,
+    Rgb565 = 1,
+    Gray8 = 2,
+    // Read back as RGBA8 and converted on the CPU
+    Bgra8,
+    Nv12
+};
+
+enum class ReadbackFilter : uint32_t
+{
+    Box = 0,
+    Lanczos = 1
+};
+
+enum class ReadbackMethod
+{
+    // Downscaled by a compute pass into a host buffer
+    Compute,
+    // Read in place from a linear, host-visible shared image
+    Mapped
+};
+
+enum class SharedImageFormat
+{
+    Rgba8,
+    // Two planes written separately by GL, converted to RGB by the Vulkan sampler
+    Nv12
+};
+
+enum class UpscaleFilter : uint32_t
+{
+    Bilinear = 0,
+    // Edge adaptive spatial upscaling followed by contrast adaptive sharpening
+    Easu = 1,
+    // No compute pass, the fragment shader samples the rendered part of the shared image
+    None
+};
+
+enum class PresentMode
+{
+    // Never blocks and never tears, the newest frame replaces a queued one
+    Mailbox,
+    Fifo,
+    // Like FIFO, but a late frame is shown right away and may tear
+    FifoRelaxed,
+    Immediate
+};
+
+enum class InteropTransport
+{
+    // Zero-copy when both APIs support it, host copy otherwise
+    Auto,
+    ExternalMemory,
+    HostCopy
+};
+
+enum class IpcRole
+{
+    // GL and Vulkan in one process
+    None,
+    // Vulkan side, waits for a producer process on the socket
+    Consumer,
+    // GL side, renders into the shared image of a consumer process
+    Producer
+};
+
+const float c_minRenderScale = 0.25f;
+
+struct Settings
+{
+    bool benchmarkPixelConversion = false;
+    InteropTransport transport = InteropTransport::Auto;
+    // Preferred mode, unsupported modes fall back to the closest supported one and finally FIFO
+    PresentMode presentMode = PresentMode::Mailbox;
+    // Waits with VK_KHR_present_wait until at most one frame is queued for presentation
+    bool lowLatency = false;
+    // Windows or headless surfaces showing the same frame, each with its own swapchain
+    uint32_t outputCount = 1;
+    // Presents to a VK_EXT_headless_surface instead of a window, for machines without a display
+    bool headless = false;
+    uint64_t frameLimit = 0; // 0 = run until the window is closed
+    // GL renders through a surfaceless EGL context without any window, only in builds with GLVK_EGL
+    bool surfacelessGL = false;
+    // Shows the shared image in a visible GL window, needs a GLFW window even in GLVK_EGL builds
+    bool glMirror = false;
+    SharedImageFormat sharedImageFormat = SharedImageFormat::Rgba8;
+    // Frames streamed into the shared image instead of the GL clear, see createFrameSource()
+    std::string source;
+
+    // GL renders into part of the shared image and Vulkan upscales it, the scale can be changed at runtime
+    bool renderScaling = false;
+    float renderScale = 1.0f;
+    UpscaleFilter upscaleFilter = UpscaleFilter::Easu;
+    float sharpness = 0.2f; // Stops below maximum sharpening
+    // Budget for the GPU time of a frame, GL and Vulkan together, the render scale is adjusted to meet it
+    double targetFrameMilliseconds = 0.0; // 0 = fixed scale
+
+    // Sleep until something changes instead of spinning while neither GL nor Vulkan has anything new to show
+    bool idle = false;
+    // GL renders a mostly static scene and reports what it changed, Vulkan only redraws and presents that part
+    bool damageTracking = false;
+    // Each frame slot's command buffer is recorded once and submitted again until something it depends on changes
+    bool cacheCommandBuffers = false;
+    // Worker threads recording the draws of the outputs into secondary command buffers
+    uint32_t recordThreads = 0; // 0 = everything is recorded on the main thread
+    // Frame barriers are recorded with VK_KHR_synchronization2, each with its own stages
+    bool synchronization2 = false;
+    // The shared image is copied or blitted into the swapchain images instead of drawn, without composition
+    bool passthrough = false;
+    // The outputs draw with a depth attachment, transient and in lazily allocated memory where available
+    bool depth = false;
+    // GL renders depth into a second shared image, the composition writes it to the Vulkan depth attachment
+    bool sharedDepth = false;
+    // GL runs in a separate process, connected over a Unix domain socket at ipcSocket
+    IpcRole ipcRole = IpcRole::None;
+    std::string ipcSocket;
+
+    // GPU-side downscaled readback of the shared image
+    bool readback = false;
+    ReadbackMethod readbackMethod = ReadbackMethod::Compute;
+    int readbackRegionX = 0;
+    int readbackRegionY = 0;
+    int readbackRegionWidth = 0; // 0 = whole shared image
+    int readbackRegionHeight = 0;
+    int readbackWidth = 400;
+    int readbackHeight = 300;
+    ReadbackFormat readbackFormat = ReadbackFormat::Rgba8;
+    ReadbackFilter readbackFilter = ReadbackFilter::Box;
+};
+
+Settings parseSettings(int argc, char* argv[]);
+void printUsage();
@@ -0,0 +1,455 @@
+#include "Upscaler.hpp"
+#include "VulkanUtils.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <cmath>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+namespace
+{
+struct UpscalePushConstants
+{
+    int32_t inputExtent[2];
+    int32_t outputExtent[2];
+    uint32_t filter;
+};
+
+struct SharpenPushConstants
+{
+    int32_t extent[2];
+    float sharpness;
+};
+
+const uint32_t c_workgroupSize = 8;
+const VkFormat c_outputFormat = VK_FORMAT_R8G8B8A8_UNORM;
+const float c_renderScaleStep = 0.05f;
+
+const char* getFilterName(UpscaleFilter filter)
+{
+    return filter == UpscaleFilter::Easu ? "EASU + RCAS" : "bilinear";
+}
+
+// Earlier frames sample or blit the output and compute reads the intermediate image, the images are overwritten after them
+const FrameGraph::Access c_previousReadState{
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+const FrameGraph::Access c_computeWrite{VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL};
+const FrameGraph::Access c_computeRead{VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL};
+} // namespace
+
+Upscaler::Upscaler(Context& context, Interop& interop, const Settings& settings) :
+    m_context(context),
+    m_interop(interop),
+    m_device(context.getDevice()),
+    m_filter(settings.upscaleFilter),
+    // RCAS sharpness is given in stops, 0 is the strongest
+    m_sharpness(std::exp2(-settings.sharpness)),
+    m_timer(context, context.getFrameCount())
+{
+    CHECK(interop.isRenderScaling() && m_filter != UpscaleFilter::None);
+
+    createSampler();
+    createDescriptorSetLayouts();
+    createPipelines();
+    createDescriptorPool();
+    createImages();
+    createDescriptorSets();
+
+    m_context.addKeyHandler([this](int key) { handleKey(key); });
+
+    const VkExtent2D renderExtent = m_interop.getRenderExtent();
+    printf("Upscaler: %s from %ux%u to %ux%u\n", getFilterName(m_filter), renderExtent.width, renderExtent.height, m_extent.width, m_extent.height);
+}
+
+Upscaler::~Upscaler()
+{
+    vkDeviceWaitIdle(m_device);
+
+    for (const Image& image : {m_intermediate, m_output})
+    {
+        vkDestroyImageView(m_device, image.view, nullptr);
+        vkDestroyImage(m_device, image.image, nullptr);
+        vkFreeMemory(m_device, image.memory, nullptr);
+    }
+
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+    vkDestroyPipeline(m_device, m_sharpenPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_upscalePipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_sharpenPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(m_device, m_upscalePipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_sharpenSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_upscaleSetLayout, nullptr);
+    vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+void Upscaler::beginFrame(uint32_t slot)
+{
+    double milliseconds = 0.0;
+    if (m_timer.collect(slot, milliseconds))
+    {
+        m_gpuMilliseconds += milliseconds;
+        ++m_timedFrames;
+    }
+
+    if (m_generation != m_interop.getSharedImageGeneration())
+    {
+        // The output follows the shared image size, frames in flight still read the old one
+        retireImages();
+        createImages();
+    }
+
+    if (m_slots[slot].generation != m_generation)
+    {
+        updateDescriptorSets(m_slots[slot]);
+    }
+}
+
+FrameGraph::Resource Upscaler::addPasses(FrameGraph& graph, FrameGraph::Resource input, uint32_t slot)
+{
+    const Slot& s = m_slots[slot];
+    const VkExtent2D inputExtent = m_interop.getRenderExtent();
+    const bool sharpen = m_filter == UpscaleFilter::Easu;
+
+    const FrameGraph::Resource output = graph.importImage(m_output.image, VK_IMAGE_ASPECT_COLOR_BIT, c_previousReadState);
+    const FrameGraph::Resource intermediate =
+        sharpen ? graph.importImage(m_intermediate.image, VK_IMAGE_ASPECT_COLOR_BIT, c_previousReadState) : output;
+
+    const uint32_t groupCountX = (m_extent.width + c_workgroupSize - 1) / c_workgroupSize;
+    const uint32_t groupCountY = (m_extent.height + c_workgroupSize - 1) / c_workgroupSize;
+
+    UpscalePushConstants upscaleConstants{};
+    upscaleConstants.inputExtent[0] = static_cast<int32_t>(inputExtent.width);
+    upscaleConstants.inputExtent[1] = static_cast<int32_t>(inputExtent.height);
+    upscaleConstants.outputExtent[0] = static_cast<int32_t>(m_extent.width);
+    upscaleConstants.outputExtent[1] = static_cast<int32_t>(m_extent.height);
+    upscaleConstants.filter = static_cast<uint32_t>(m_filter);
+
+    VkDescriptorSet upscaleSet = sharpen ? s.upscaleToIntermediateSet : s.upscaleToOutputSet;
+    const FrameGraph::Pass upscale = graph.addPass("Upscale", [this, slot, sharpen, upscaleSet, upscaleConstants, groupCountX, groupCountY](VkCommandBuffer cb) {
+        m_timer.begin(cb, slot, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_upscalePipeline);
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_upscalePipelineLayout, 0, 1, &upscaleSet, 0, nullptr);
+        vkCmdPushConstants(cb, m_upscalePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscalePushConstants), &upscaleConstants);
+        vkCmdDispatch(cb, groupCountX, groupCountY, 1);
+        if (!sharpen)
+        {
+            m_timer.end(cb, slot, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+    });
+    graph.read(upscale, input, m_interop.getSharedImageReadAccess(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+    graph.write(upscale, intermediate, c_computeWrite, true);
+
+    if (sharpen)
+    {
+        SharpenPushConstants sharpenConstants{};
+        sharpenConstants.extent[0] = static_cast<int32_t>(m_extent.width);
+        sharpenConstants.extent[1] = static_cast<int32_t>(m_extent.height);
+        sharpenConstants.sharpness = m_sharpness;
+
+        VkDescriptorSet sharpenSet = s.sharpenSet;
+        const FrameGraph::Pass rcas = graph.addPass("Sharpen", [this, slot, sharpenSet, sharpenConstants, groupCountX, groupCountY](VkCommandBuffer cb) {
+            vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_sharpenPipeline);
+            vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, m_sharpenPipelineLayout, 0, 1, &sharpenSet, 0, nullptr);
+            vkCmdPushConstants(cb, m_sharpenPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SharpenPushConstants), &sharpenConstants);
+            vkCmdDispatch(cb, groupCountX, groupCountY, 1);
+            m_timer.end(cb, slot, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        });
+        graph.read(rcas, intermediate, c_computeRead);
+        graph.write(rcas, output, c_computeWrite, true);
+    }
+
+    return output;
+}
+
+void Upscaler::markReused(uint32_t slot)
+{
+    m_timer.markReused(slot);
+}
+
+VkImageView Upscaler::getOutputView() const
+{
+    return m_output.view;
+}
+
+UpscaleFilter Upscaler::getFilter() const
+{
+    return m_filter;
+}
+
+void Upscaler::printStatistics()
+{
+    const VkExtent2D renderExtent = m_interop.getRenderExtent();
+    printf("Upscaler %s: %.0f%% scale, %ux%u to %ux%u", getFilterName(m_filter), m_interop.getRenderScale() * 100.0f, renderExtent.width, renderExtent.height,
+           m_extent.width, m_extent.height);
+    if (m_timedFrames > 0)
+    {
+        printf(", %.3f ms GPU per frame", m_gpuMilliseconds / double(m_timedFrames));
+    }
+    printf("\n");
+
+    m_gpuMilliseconds = 0.0;
+    m_timedFrames = 0;
+}
+
+void Upscaler::handleKey(int key)
+{
+    if (key == GLFW_KEY_MINUS || key == GLFW_KEY_EQUAL)
+    {
+        const float step = key == GLFW_KEY_MINUS ? -c_renderScaleStep : c_renderScaleStep;
+        m_interop.setRenderScale(m_interop.getRenderScale() + step);
+        printf("Upscaler: render scale %.0f%%\n", m_interop.getRenderScale() * 100.0f);
+    }
+    else if (key == GLFW_KEY_U)
+    {
+        m_filter = m_filter == UpscaleFilter::Easu ? UpscaleFilter::Bilinear : UpscaleFilter::Easu;
+        printf("Upscaler: %s\n", getFilterName(m_filter));
+    }
+}
+
+void Upscaler::createSampler()
+{
+    // Texels are fetched, the sampler is only needed for the combined image sampler descriptor
+    VkSamplerCreateInfo samplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VK_CHECK(vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_sampler));
+}
+
+void Upscaler::createDescriptorSetLayouts()
+{
+    VkDescriptorSetLayoutBinding inputBinding{};
+    inputBinding.binding = 0;
+    inputBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    inputBinding.descriptorCount = 1;
+    inputBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutBinding outputBinding{};
+    outputBinding.binding = 1;
+    outputBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    outputBinding.descriptorCount = 1;
+    outputBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings{inputBinding, outputBinding};
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = ui32Size(bindings);
+    layoutInfo.pBindings = bindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_upscaleSetLayout));
+
+    // Sharpening reads the intermediate image as a storage image
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_sharpenSetLayout));
+}
+
+void Upscaler::createPipelines()
+{
+    struct PipelineInfo
+    {
+        VkDescriptorSetLayout setLayout;
+        uint32_t pushConstantSize;
+        const char* shader;
+        VkPipelineLayout* layout;
+        VkPipeline* pipeline;
+    };
+
+    const std::array<PipelineInfo, 2> pipelines{
+        PipelineInfo{m_upscaleSetLayout, sizeof(UpscalePushConstants), "shaders/upscale.comp.spv", &m_upscalePipelineLayout, &m_upscalePipeline},
+        PipelineInfo{m_sharpenSetLayout, sizeof(SharpenPushConstants), "shaders/sharpen.comp.spv", &m_sharpenPipelineLayout, &m_sharpenPipeline}};
+
+    for (const PipelineInfo& info : pipelines)
+    {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = info.pushConstantSize;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &info.setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, info.layout));
+
+        VkShaderModule shaderModule = createShaderModule(m_device, info.shader);
+
+        VkPipelineShaderStageCreateInfo shaderStageInfo{};
+        shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        shaderStageInfo.module = shaderModule;
+        shaderStageInfo.pName = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStageInfo;
+        pipelineInfo.layout = *info.layout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        VK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, info.pipeline));
+
+        vkDestroyShaderModule(m_device, shaderModule, nullptr);
+    }
+}
+
+void Upscaler::createDescriptorPool()
+{
+    m_slots.resize(m_context.getFrameCount());
+
+    // Per slot two upscale sets with a sampler and a storage image each, and the sharpen set with two storage images
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = ui32Size(m_slots) * 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = ui32Size(m_slots) * 4;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = ui32Size(poolSizes);
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = ui32Size(m_slots) * 3;
+
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+}
+
+void Upscaler::createDescriptorSets()
+{
+    for (Slot& slot : m_slots)
+    {
+        const std::array<VkDescriptorSetLayout, 3> layouts{m_upscaleSetLayout, m_upscaleSetLayout, m_sharpenSetLayout};
+        std::array<VkDescriptorSet, 3> sets{};
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = ui32Size(layouts);
+        allocInfo.pSetLayouts = layouts.data();
+
+        VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, sets.data()));
+
+        slot.upscaleToIntermediateSet = sets[0];
+        slot.upscaleToOutputSet = sets[1];
+        slot.sharpenSet = sets[2];
+        updateDescriptorSets(slot);
+    }
+}
+
+Upscaler::Image Upscaler::createImage() const
+{
+    Image image{};
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = m_extent.width;
+    imageInfo.extent.height = m_extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = c_outputFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Passthrough blits the output into the swapchain
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VK_CHECK(vkCreateImage(m_device, &imageInfo, nullptr, &image.image));
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_device, image.image, &memRequirements);
+
+    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CHECK(memoryTypeResult.found);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+    VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &image.memory));
+    VK_CHECK(vkBindImageMemory(m_device, image.image, image.memory, 0));
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = c_outputFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VK_CHECK(vkCreateImageView(m_device, &viewInfo, nullptr, &image.view));
+    return image;
+}
+
+void Upscaler::createImages()
+{
+    m_extent = m_interop.getSharedImageExtent();
+    m_generation = m_interop.getSharedImageGeneration();
+    m_intermediate = createImage();
+    m_output = createImage();
+}
+
+void Upscaler::retireImages()
+{
+    VkDevice device = m_device;
+    const std::array<Image, 2> images{m_intermediate, m_output};
+    m_context.deferDestroy([device, images]() {
+        for (const Image& image : images)
+        {
+            vkDestroyImageView(device, image.view, nullptr);
+            vkDestroyImage(device, image.image, nullptr);
+            vkFreeMemory(device, image.memory, nullptr);
+        }
+    });
+}
+
+void Upscaler::updateDescriptorSets(Slot& slot)
+{
+    VkDescriptorImageInfo sharedImageInfo{};
+    sharedImageInfo.imageLayout = m_interop.getSharedImageReadLayout();
+    sharedImageInfo.imageView = m_interop.getSharedImageView();
+    sharedImageInfo.sampler = m_sampler;
+
+    VkDescriptorImageInfo intermediateInfo{};
+    intermediateInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    intermediateInfo.imageView = m_intermediate.view;
+
+    VkDescriptorImageInfo outputInfo{};
+    outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    outputInfo.imageView = m_output.view;
+
+    auto getWrite = [](VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo) {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = binding;
+        write.dstArrayElement = 0;
+        write.descriptorType = type;
+        write.descriptorCount = 1;
+        write.pImageInfo = imageInfo;
+        return write;
+    };
+
+    const std::array<VkWriteDescriptorSet, 6> descriptorWrites{
+        getWrite(slot.upscaleToIntermediateSet, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sharedImageInfo),
+        getWrite(slot.upscaleToIntermediateSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &intermediateInfo),
+        getWrite(slot.upscaleToOutputSet, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sharedImageInfo),
+        getWrite(slot.upscaleToOutputSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &outputInfo),
+        getWrite(slot.sharpenSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &intermediateInfo),
+        getWrite(slot.sharpenSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &outputInfo)};
+
+    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+    slot.generation = m_generation;
+}
+
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Context.hpp"
+#include "FrameGraph.hpp"
+#include "GpuTimer.hpp"
+#include "Interop.hpp"
+#include "Settings.hpp"
+#include <vector>
+
+// Upscales the part of the shared image GL rendered to the full shared image size with compute passes,
+// EASU followed by RCAS sharpening or a plain bilinear filter. The output is sampled in place of the shared image.
+class Upscaler final
+{
+public:
+    Upscaler(Context& context, Interop& interop, const Settings& settings);
+    ~Upscaler();
+
+    // The slot's previous submission has to be complete, recreates the output after the shared image was replaced
+    void beginFrame(uint32_t slot);
+    // Adds the compute passes that read the shared image, returns the output that later passes sample in
+    // shader read only layout
+    FrameGraph::Resource addPasses(FrameGraph& graph, FrameGraph::Resource input, uint32_t slot);
+    // The slot's commands are submitted again, they stay valid until the filter or the shared image changes
+    void markReused(uint32_t slot);
+    // Written by the frame recorded last
+    VkImageView getOutputView() const;
+    UpscaleFilter getFilter() const;
+    void printStatistics();
+
+private:
+    struct Slot
+    {
+        // Upscale pass into the intermediate image for sharpening or straight into the output
+        VkDescriptorSet upscaleToIntermediateSet;
+        VkDescriptorSet upscaleToOutputSet;
+        VkDescriptorSet sharpenSet;
+        uint64_t generation;
+    };
+
+    struct Image
+    {
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+    };
+
+    void handleKey(int key);
+    void createSampler();
+    void createDescriptorSetLayouts();
+    void createPipelines();
+    void createDescriptorPool();
+    void createDescriptorSets();
+    Image createImage() const;
+    void createImages();
+    void retireImages();
+    void updateDescriptorSets(Slot& slot);
+
+    Context& m_context;
+    Interop& m_interop;
+    VkDevice m_device;
+    UpscaleFilter m_filter;
+    float m_sharpness;
+
+    VkExtent2D m_extent{};
+    uint64_t m_generation = 0;
+    Image m_intermediate{};
+    Image m_output{};
+
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_upscaleSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_sharpenSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_upscalePipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_sharpenPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_upscalePipeline = VK_NULL_HANDLE;
+    VkPipeline m_sharpenPipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<Slot> m_slots;
+
+    GpuTimer m_timer;
+    double m_gpuMilliseconds = 0.0;
+    uint64_t m_timedFrames = 0;
+};
@@ -1 +1,21 @@
-#include "Utils.hpp"
\ No newline at end of file
+#include "Utils.hpp"
+
+Timer::Timer() :
+    m_start(std::chrono::steady_clock::now())
+{
+}
+
+void Timer::reset()
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+double Timer::elapsedSeconds() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+double Timer::elapsedMilliseconds() const
+{
+    return elapsedSeconds() * 1000.0;
+}
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstdio>
+#include <chrono>
 
 const int c_windowWidth = 1600;
 const int c_windowHeight = 1200;
@@ -21,4 +22,17 @@ template<typename T>
 uint32_t ui32Size(const T& container)
 {
     return static_cast<uint32_t>(container.size());
-}
\ No newline at end of file
+}
+
+class Timer
+{
+public:
+    Timer();
+
+    void reset();
+    double elapsedSeconds() const;
+    double elapsedMilliseconds() const;
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -1,7 +1,10 @@
 #include "VKRenderer.hpp"
 #include "VulkanUtils.hpp"
 #include "Utils.hpp"
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <limits>
 
 namespace
 {
@@ -15,131 +18,708 @@ const std::array<Vertex, 3> c_vertexData{
 const std::array<uint32_t, 3> c_indexData{0, 1, 2};
 
 const std::array<float, 4> c_colorData{0.2f, 0.4f, 0.7f, 1.0f};
+
+const VkClearColorValue c_backgroundColor{{0.0f, 0.0f, 0.2f, 1.0f}};
+// Depth-only formats that can be attachments, smallest first. Nothing reads depth back, so no stencil is needed.
+const std::array<VkFormat, 3> c_depthFormats{VK_FORMAT_D16_UNORM, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D32_SFLOAT};
+// Format of the shared image and the upscaler output that passthrough copies from
+const VkFormat c_passthroughSourceFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+struct PushConstants
+{
+    float uvScale[2];
+    float uvMax[2];
+};
+
+const uint32_t c_damageTileSize = 32;
+// Longest sleep while idle, frames GL finishes without a window event are picked up after it
+const double c_idleTimeout = 0.1;
+
+// The triangle maps texture coordinates to clip space linearly, a rectangle of the shared image lands within the
+// bounding box of its mapped corners and the triangle's bounds
+bool mapDamageToWindow(const VkRect2D& rect, VkExtent2D imageExtent, VkExtent2D windowExtent, VkRect2D& windowRect)
+{
+    const Vertex& a = c_vertexData[0];
+    const Vertex& b = c_vertexData[1];
+    const Vertex& c = c_vertexData[2];
+    const float du1 = b[3] - a[3];
+    const float dv1 = b[4] - a[4];
+    const float du2 = c[3] - a[3];
+    const float dv2 = c[4] - a[4];
+    const float determinant = du1 * dv2 - du2 * dv1;
+
+    // Bilinear filtering spreads every texel into its neighbours
+    const int32_t imageWidth = int32_t(imageExtent.width);
+    const int32_t imageHeight = int32_t(imageExtent.height);
+    const float u0 = float(std::max(rect.offset.x - 1, 0)) / float(imageWidth);
+    const float v0 = float(std::max(rect.offset.y - 1, 0)) / float(imageHeight);
+    const float u1 = float(std::min(rect.offset.x + int32_t(rect.extent.width) + 1, imageWidth)) / float(imageWidth);
+    const float v1 = float(std::min(rect.offset.y + int32_t(rect.extent.height) + 1, imageHeight)) / float(imageHeight);
+    const std::array<std::array<float, 2>, 4> corners{{{u0, v0}, {u1, v0}, {u0, v1}, {u1, v1}}};
+
+    float left = std::numeric_limits<float>::max();
+    float top = std::numeric_limits<float>::max();
+    float right = std::numeric_limits<float>::lowest();
+    float bottom = std::numeric_limits<float>::lowest();
+    for (const std::array<float, 2>& corner : corners)
+    {
+        // Weights of the second and third vertex for this texture coordinate
+        const float s = ((corner[0] - a[3]) * dv2 - (corner[1] - a[4]) * du2) / determinant;
+        const float t = (du1 * (corner[1] - a[4]) - dv1 * (corner[0] - a[3])) / determinant;
+        const float x = a[0] + s * (b[0] - a[0]) + t * (c[0] - a[0]);
+        const float y = a[1] + s * (b[1] - a[1]) + t * (c[1] - a[1]);
+        left = std::min(left, x);
+        top = std::min(top, y);
+        right = std::max(right, x);
+        bottom = std::max(bottom, y);
+    }
+    left = std::max(left, std::min({a[0], b[0], c[0]}));
+    top = std::max(top, std::min({a[1], b[1], c[1]}));
+    right = std::min(right, std::max({a[0], b[0], c[0]}));
+    bottom = std::min(bottom, std::max({a[1], b[1], c[1]}));
+
+    // Clip space to pixels, y points down in Vulkan
+    const int32_t windowWidth = int32_t(windowExtent.width);
+    const int32_t windowHeight = int32_t(windowExtent.height);
+    const int32_t x0 = std::max(int32_t(std::floor((left * 0.5f + 0.5f) * float(windowWidth))), 0);
+    const int32_t y0 = std::max(int32_t(std::floor((top * 0.5f + 0.5f) * float(windowHeight))), 0);
+    const int32_t x1 = std::min(int32_t(std::ceil((right * 0.5f + 0.5f) * float(windowWidth))), windowWidth);
+    const int32_t y1 = std::min(int32_t(std::ceil((bottom * 0.5f + 0.5f) * float(windowHeight))), windowHeight);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return false;
+    }
+    windowRect = VkRect2D{{x0, y0}, {uint32_t(x1 - x0), uint32_t(y1 - y0)}};
+    return true;
+}
+
+// Redraws are done in whole tiles, a few larger rectangles are cheaper to clear, draw and present than many exact ones
+std::vector<VkRect2D> getDamageTiles(const std::vector<VkRect2D>& rects, VkExtent2D extent)
+{
+    const uint32_t columns = (extent.width + c_damageTileSize - 1) / c_damageTileSize;
+    const uint32_t rows = (extent.height + c_damageTileSize - 1) / c_damageTileSize;
+    std::vector<bool> damaged(size_t(columns) * rows, false);
+    for (const VkRect2D& rect : rects)
+    {
+        const uint32_t firstColumn = uint32_t(rect.offset.x) / c_damageTileSize;
+        const uint32_t lastColumn = (uint32_t(rect.offset.x) + rect.extent.width - 1) / c_damageTileSize;
+        const uint32_t firstRow = uint32_t(rect.offset.y) / c_damageTileSize;
+        const uint32_t lastRow = (uint32_t(rect.offset.y) + rect.extent.height - 1) / c_damageTileSize;
+        for (uint32_t row = firstRow; row <= lastRow; ++row)
+        {
+            for (uint32_t column = firstColumn; column <= lastColumn; ++column)
+            {
+                damaged[size_t(row) * columns + column] = true;
+            }
+        }
+    }
+
+    // Runs of damaged tiles in a row, a run that repeats one of the row above extends it downwards
+    std::vector<VkRect2D> tiles;
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        const uint32_t y = row * c_damageTileSize;
+        const uint32_t height = std::min(c_damageTileSize, extent.height - y);
+        uint32_t column = 0;
+        while (column < columns)
+        {
+            if (!damaged[size_t(row) * columns + column])
+            {
+                ++column;
+                continue;
+            }
+            const uint32_t x = column * c_damageTileSize;
+            while (column < columns && damaged[size_t(row) * columns + column])
+            {
+                ++column;
+            }
+            const uint32_t width = std::min(column * c_damageTileSize, extent.width) - x;
+
+            const auto above = std::find_if(tiles.begin(), tiles.end(), [x, y, width](const VkRect2D& tile) {
+                return tile.offset.x == int32_t(x) && tile.extent.width == width && tile.offset.y + int32_t(tile.extent.height) == int32_t(y);
+            });
+            if (above != tiles.end())
+            {
+                above->extent.height += height;
+            }
+            else
+            {
+                tiles.push_back(VkRect2D{{int32_t(x), int32_t(y)}, {width, height}});
+            }
+        }
+    }
+    return tiles;
+}
+
+VkRect2D getBoundingRect(const std::vector<VkRect2D>& rects)
+{
+    int32_t left = std::numeric_limits<int32_t>::max();
+    int32_t top = std::numeric_limits<int32_t>::max();
+    int32_t right = 0;
+    int32_t bottom = 0;
+    for (const VkRect2D& rect : rects)
+    {
+        left = std::min(left, rect.offset.x);
+        top = std::min(top, rect.offset.y);
+        right = std::max(right, rect.offset.x + int32_t(rect.extent.width));
+        bottom = std::max(bottom, rect.offset.y + int32_t(rect.extent.height));
+    }
+    return VkRect2D{{left, top}, {uint32_t(right - left), uint32_t(bottom - top)}};
+}
 } // namespace
 
-VKRenderer::VKRenderer(Context& context, Interop& interop) :
+VKRenderer::VKRenderer(Context& context, Interop& interop, const Settings& settings) :
     m_context(context),
     m_interop(interop),
-    m_device(context.getDevice())
+    m_device(context.getDevice()),
+    m_frameTimer(context, context.getFrameCount()),
+    m_idle(settings.idle),
+    m_cacheCommandBuffers(settings.cacheCommandBuffers),
+    m_passthrough(settings.passthrough),
+    m_depth(settings.depth || interop.isDepthSharing()),
+    m_sharedDepth(interop.isDepthSharing()),
+    m_outputs(context.getOutputCount()),
+    m_recordedCommands(context.getFrameCount())
 {
-    createRenderPass();
-    createDepthImage();
-    createImageViews();
-    createFramebuffers();
+    // Damage tracking redraws different tiles every frame
+    CHECK(!m_cacheCommandBuffers || !interop.isDamageTracking());
+    // Passthrough always copies the whole image and can't convert NV12
+    CHECK(!m_passthrough || (!interop.isDamageTracking() && settings.sharedImageFormat == SharedImageFormat::Rgba8));
+    if (m_passthrough && !isPassthroughSupported(settings))
+    {
+        printf("Passthrough needs blits from RGBA8 to the surface format, drawing the shared image instead\n");
+        m_passthrough = false;
+    }
+    if (m_depth)
+    {
+        m_depthFormat = findDepthFormat();
+    }
+
+    createRenderPasses();
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        createSwapchainResources(i);
+    }
+    createSampler();
     createDescriptorSetLayout();
     createGraphicsPipeline();
-    createSampler();
     createDescriptorPool();
     createDescriptorSet();
     createUniformBuffer();
-    updateDescriptorSet();
+    if (interop.isRenderScaling() && settings.upscaleFilter != UpscaleFilter::None)
+    {
+        m_upscaler = std::make_unique<Upscaler>(context, interop, settings);
+    }
+    for (uint32_t i = 0; i < ui32Size(m_descriptorSets); ++i)
+    {
+        updateDescriptorSet(i);
+    }
     createVertexAndIndexBuffer();
     allocateCommandBuffers();
+    if (settings.recordThreads > 0)
+    {
+        m_recorder = std::make_unique<CommandRecorder>(context, settings.recordThreads);
+    }
+
+    if (settings.readback)
+    {
+        m_readback = std::make_unique<Readback>(context, interop, settings);
+    }
 }
 
 VKRenderer::~VKRenderer()
 {
     vkDeviceWaitIdle(m_device);
 
+    m_recorder.reset();
+    m_upscaler.reset();
     vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
     vkFreeMemory(m_device, m_indexBufferMemory, nullptr);
     vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
     vkFreeMemory(m_device, m_vertexBufferMemory, nullptr);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
+    vkUnmapMemory(m_device, m_uniformBufferMemory);
     vkFreeMemory(m_device, m_uniformBufferMemory, nullptr);
     vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
     vkDestroySampler(m_device, m_sampler, nullptr);
+    vkDestroySampler(m_device, m_depthSampler, nullptr);
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_overlayPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+
+    for (const Output& output : m_outputs)
+    {
+        for (const VkFramebuffer& framebuffer : output.framebuffers)
+        {
+            vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        }
+
+        for (const VkImageView& imageView : output.imageViews)
+        {
+            vkDestroyImageView(m_device, imageView, nullptr);
+        }
+    }
+
     vkDestroyImageView(m_device, m_depthImageView, nullptr);
+    vkDestroyImage(m_device, m_depthImage, nullptr);
+    vkFreeMemory(m_device, m_depthImageMemory, nullptr);
+
+    vkDestroyRenderPass(m_device, m_loadRenderPass, nullptr);
+    vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+}
 
-    for (const VkFramebuffer& framebuffer : m_framebuffers)
+bool VKRenderer::render()
+{
+    bool running = m_context.update();
+    if (!running)
     {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        return false;
     }
 
-    for (const VkImageView& imageView : m_swapchainImageViews)
+    ++m_frames;
+    m_frameDrawn = isFrameNeeded();
+    if (!m_frameDrawn)
     {
-        vkDestroyImageView(m_device, imageView, nullptr);
+        ++m_skippedFrames;
+        if (m_idle)
+        {
+            m_context.waitForEvents(c_idleTimeout);
+        }
+        return true;
     }
+    m_drawnContentGeneration = m_interop.getContentGeneration();
+    m_drawnRenderScale = m_interop.getRenderScale();
+    m_drawnUpscaleFilter = m_upscaler ? m_upscaler->getFilter() : UpscaleFilter::None;
 
-    if (m_depthImage != VK_NULL_HANDLE)
+    const uint32_t frameIndex = m_context.acquireNextFrame();
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        if (m_outputs[i].swapchainGeneration != m_context.getSwapchainGeneration(i))
+        {
+            recreateSwapchainResources(i);
+        }
+    }
+    m_interop.beginFrame(frameIndex);
+    double gpuMilliseconds = 0.0;
+    if (m_frameTimer.collect(frameIndex, gpuMilliseconds))
+    {
+        m_lastGpuMilliseconds = gpuMilliseconds;
+        ++m_gpuSampleCount;
+        m_gpuMilliseconds += gpuMilliseconds;
+        ++m_timedFrames;
+    }
+    if (m_upscaler)
+    {
+        m_upscaler->beginFrame(frameIndex);
+    }
+    if (m_descriptorSetGenerations[frameIndex] != m_interop.getSharedImageGeneration())
     {
-        vkDestroyImage(m_device, m_depthImage, nullptr);
+        updateDescriptorSet(frameIndex);
     }
 
-    if (m_depthImageMemory != VK_NULL_HANDLE)
+    if (m_readback)
     {
-        vkFreeMemory(m_device, m_depthImageMemory, nullptr);
+        m_readback->collect(frameIndex);
     }
 
-    vkDestroyRenderPass(m_device, m_renderPass, nullptr);
-}
+    // The frame timer starts where the shared image is first read, the upscaler and passthrough read it instead of the
+    // fragment shader
+    VkPipelineStageFlagBits sharedImageStage = m_passthrough ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    sharedImageStage = m_upscaler ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : sharedImageStage;
+    VkCommandBuffer cb = m_commandBuffers[frameIndex];
+    const Timer recordTimer;
+    ++m_frame;
+    if (canReuseCommandBuffer(frameIndex))
+    {
+        // The commands are the same as last time, only the state their recording changes is advanced
+        m_frameTimer.markReused(frameIndex);
+        m_interop.reuseSharedImageBarriers();
+        if (m_upscaler)
+        {
+            m_upscaler->markReused(frameIndex);
+        }
+        if (m_readback)
+        {
+            m_readback->markReused(frameIndex);
+        }
+        ++m_reusedCommandBuffers;
+    }
+    else
+    {
+        recordCommandBuffer(cb, frameIndex, sharedImageStage);
+    }
+    m_recordMilliseconds += recordTimer.elapsedMilliseconds();
+    ++m_drawnFrames;
 
-bool VKRenderer::render()
-{
-    bool running = m_context.update();
-    if (!running)
+    Context::WaitAndSignalInfo waitAndSignalInfo{};
+    m_interop.addFrameSemaphores(waitAndSignalInfo, m_recordedCommands[frameIndex].waitStages);
+
+    m_context.submitCommandBuffers({cb}, waitAndSignalInfo);
+
+    if (m_readback && m_readback->isInPlace())
     {
-        return false;
+        m_readback->collectInPlace();
     }
 
-    const uint32_t imageIndex = m_context.acquireNextSwapchainImage();
+    return true;
+}
 
+void VKRenderer::recordCommandBuffer(VkCommandBuffer cb, uint32_t frameIndex, VkPipelineStageFlagBits sharedImageStage)
+{
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    // The slot's fence has been waited, a cached buffer is never pending twice
+    beginInfo.flags = m_cacheCommandBuffers ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     beginInfo.pInheritanceInfo = nullptr;
 
+    // The pool keeps the memory of the previous recording for the next one
+    vkResetCommandBuffer(cb, 0);
+
+    vkBeginCommandBuffer(cb, &beginInfo);
+
+    // The frame is timed from the stage that waits for GL, so time spent waiting for GL isn't counted
+    m_frameTimer.begin(cb, frameIndex, sharedImageStage);
+
+    // The barriers between the passes follow from what they read and write
+    FrameGraph graph(m_context.getGraphicsQueueFamily(), m_context.getPipelineBarrier2());
+    const FrameGraph::Resource sharedImage = m_interop.importSharedImage(graph);
+    FrameGraph::Resource sampledImage = sharedImage;
+    FrameGraph::Access sampledAccess = m_interop.getSharedImageReadAccess(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    if (m_upscaler)
+    {
+        sampledImage = m_upscaler->addPasses(graph, sharedImage, frameIndex);
+        sampledAccess = {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    }
+    const FrameGraph::Resource sharedDepth = m_sharedDepth ? m_interop.importSharedDepth(graph) : 0;
+
+    // The shared content is prepared once, every output only adds a draw of it
+    std::vector<OutputPass> passes;
+    m_uniformDraws = 0;
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        passes.push_back(getOutputPass(i));
+        passes.back().uniformOffset = pushDrawUniforms(frameIndex);
+    }
+
+    // The draws of the outputs are recorded in parallel, the render passes around them in order
+    std::vector<VkCommandBuffer> draws(passes.size(), VK_NULL_HANDLE);
+    if (m_recorder)
+    {
+        std::vector<CommandRecorder::Job> jobs;
+        std::vector<size_t> jobPasses;
+        for (size_t i = 0; i < passes.size(); ++i)
+        {
+            const OutputPass& pass = passes[i];
+            if (pass.scissors.empty() || pass.passthrough)
+            {
+                continue;
+            }
+            CommandRecorder::Job job{};
+            job.inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            job.inheritance.renderPass = pass.renderPass;
+            job.inheritance.subpass = 0;
+            job.inheritance.framebuffer = pass.framebuffer;
+            job.record = [this, frameIndex, &pass](VkCommandBuffer draw) { recordOutputDraws(draw, frameIndex, pass); };
+            jobs.push_back(job);
+            jobPasses.push_back(i);
+        }
+        const std::vector<VkCommandBuffer> recorded = m_recorder->record(frameIndex, jobs);
+        for (size_t i = 0; i < recorded.size(); ++i)
+        {
+            draws[jobPasses[i]] = recorded[i];
+        }
+    }
+
+    // The render passes order their own attachments, the graph only sees the sampled image
+    const VkExtent2D sourceExtent = m_upscaler ? m_interop.getSharedImageExtent() : m_interop.getRenderExtent();
+    for (size_t i = 0; i < passes.size(); ++i)
+    {
+        if (passes[i].scissors.empty())
+        {
+            continue;
+        }
+        if (passes[i].passthrough)
+        {
+            // Acquired images are waited for at the color attachment output stage, presentation waits for the frame
+            const uint32_t output = static_cast<uint32_t>(i);
+            VkImage destination = m_context.getSwapchainImages(output)[m_context.getSwapchainImageIndex(output)];
+            const FrameGraph::Resource swapchainImage =
+                graph.importImage(destination, VK_IMAGE_ASPECT_COLOR_BIT, {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED});
+            VkImage source = graph.getImage(sampledImage);
+            const VkExtent2D destinationExtent = passes[i].extent;
+            const FrameGraph::Pass pass = graph.addPass("Passthrough", [this, source, sourceExtent, destination, destinationExtent](VkCommandBuffer cb) {
+                recordPassthrough(cb, source, sourceExtent, destination, destinationExtent);
+            });
+            graph.read(pass, sampledImage, {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL});
+            graph.write(pass, swapchainImage, {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL}, true);
+            graph.exportResource(swapchainImage, {0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
+            continue;
+        }
+        const FrameGraph::Pass pass =
+            graph.addPass("Output", [this, frameIndex, &passes, &draws, i](VkCommandBuffer cb) { recordOutput(cb, frameIndex, passes[i], draws[i]); });
+        graph.read(pass, sampledImage, sampledAccess);
+        if (m_sharedDepth)
+        {
+            graph.read(pass, sharedDepth, {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL});
+        }
+        graph.setSideEffects(pass);
+    }
+
+    if (m_readback)
+    {
+        m_readback->addPass(graph, sharedImage, frameIndex);
+    }
+    graph.execute(cb);
+
+    // Taken before the export, which applies a new render scale for the next frame
+    RecordedCommands recorded = getRecordedCommands();
+    recorded.waitStages = graph.getFirstUseStages(sharedImage);
+    if (m_sharedDepth)
+    {
+        // GL signals one semaphore for both images
+        recorded.waitStages |= graph.getFirstUseStages(sharedDepth);
+        m_interop.exportSharedDepth(graph, sharedDepth);
+    }
+    m_interop.exportSharedImage(graph, sharedImage);
+    graph.execute(cb);
+    m_barriers += graph.getBarrierCount();
+    m_culledPasses += graph.getCulledPassCount();
+
+    m_frameTimer.end(cb, frameIndex, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    VK_CHECK(vkEndCommandBuffer(cb));
+
+    recorded.valid = m_cacheCommandBuffers;
+    m_recordedCommands[frameIndex] = std::move(recorded);
+}
+
+VKRenderer::OutputPass VKRenderer::getOutputPass(uint32_t output)
+{
+    OutputPass pass;
+    pass.extent = m_context.getSwapchainExtent(output);
+    // Passthrough outputs have no framebuffers
+    pass.passthrough = isPassthrough(output);
+    pass.framebuffer = pass.passthrough ? VK_NULL_HANDLE : m_outputs[output].framebuffers[m_context.getSwapchainImageIndex(output)];
+
+    // With damage tracking only the tiles that changed since the image was last drawn are drawn again
+    pass.partialRedraw = m_interop.isDamageTracking() && getRedrawTiles(output, pass.redrawTiles);
+    pass.renderPass = pass.partialRedraw ? m_loadRenderPass : m_renderPass;
+    pass.renderArea = pass.partialRedraw ? getBoundingRect(pass.redrawTiles) : VkRect2D{{0, 0}, pass.extent};
+    // An image without damage is presented as it is
+    pass.scissors = pass.partialRedraw ? pass.redrawTiles : std::vector<VkRect2D>{VkRect2D{{0, 0}, pass.extent}};
+
+    if (m_interop.isDamageTracking())
+    {
+        for (const VkRect2D& scissor : pass.scissors)
+        {
+            m_redrawnPixels += uint64_t(scissor.extent.width) * scissor.extent.height;
+        }
+        m_windowPixels += uint64_t(pass.extent.width) * pass.extent.height;
+    }
+    return pass;
+}
+
+void VKRenderer::recordOutput(VkCommandBuffer cb, uint32_t frameIndex, const OutputPass& pass, VkCommandBuffer draws)
+{
+    if (pass.scissors.empty())
+    {
+        return;
+    }
+
     std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {0.0f, 0.0f, 0.2f, 1.0f};
+    clearValues[0].color = c_backgroundColor;
     clearValues[1].depthStencil = {1.0f, 0};
 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = m_renderPass;
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = c_windowExtent;
-    renderPassInfo.clearValueCount = ui32Size(clearValues);
+    renderPassInfo.renderPass = pass.renderPass;
+    renderPassInfo.renderArea = pass.renderArea;
+    renderPassInfo.clearValueCount = m_depth ? ui32Size(clearValues) : 1;
     renderPassInfo.pClearValues = clearValues.data();
+    renderPassInfo.framebuffer = pass.framebuffer;
+
+    if (draws != VK_NULL_HANDLE)
+    {
+        vkCmdBeginRenderPass(cb, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(cb, 1, &draws);
+    }
+    else
+    {
+        vkCmdBeginRenderPass(cb, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        recordOutputDraws(cb, frameIndex, pass);
+    }
+    vkCmdEndRenderPass(cb);
+}
+
+void VKRenderer::recordOutputDraws(VkCommandBuffer cb, uint32_t frameIndex, const OutputPass& pass) const
+{
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+
+    const VkViewport viewport{0.0f, 0.0f, float(pass.extent.width), float(pass.extent.height), 0.0f, 1.0f};
+    vkCmdSetViewport(cb, 0, 1, &viewport);
 
     VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cb, 0, 1, &m_vertexBuffer, offsets);
+    vkCmdBindIndexBuffer(cb, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSets[frameIndex], 1, &pass.uniformOffset);
 
-    VkCommandBuffer cb = m_commandBuffers[imageIndex];
-    vkResetCommandBuffer(cb, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+    // Without an upscale pass the rendered part of the shared image is sampled directly
+    PushConstants pushConstants{{1.0f, 1.0f}, {1.0f, 1.0f}};
+    if (m_interop.isRenderScaling() && !m_upscaler)
+    {
+        const VkExtent2D imageExtent = m_interop.getSharedImageExtent();
+        const VkExtent2D renderExtent = m_interop.getRenderExtent();
+        pushConstants.uvScale[0] = float(renderExtent.width) / float(imageExtent.width);
+        pushConstants.uvScale[1] = float(renderExtent.height) / float(imageExtent.height);
+        pushConstants.uvMax[0] = (float(renderExtent.width) - 0.5f) / float(imageExtent.width);
+        pushConstants.uvMax[1] = (float(renderExtent.height) - 0.5f) / float(imageExtent.height);
+    }
+    vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
 
-    vkBeginCommandBuffer(cb, &beginInfo);
+    if (pass.partialRedraw)
+    {
+        // The load render pass only clears depth, the background of the redrawn tiles is cleared here
+        VkClearAttachment clearAttachment{};
+        clearAttachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        clearAttachment.colorAttachment = 0;
+        clearAttachment.clearValue.color = c_backgroundColor;
+        std::vector<VkClearRect> clearRects;
+        for (const VkRect2D& tile : pass.redrawTiles)
+        {
+            clearRects.push_back(VkClearRect{tile, 0, 1});
+        }
+        vkCmdClearAttachments(cb, 1, &clearAttachment, ui32Size(clearRects), clearRects.data());
+    }
 
-    m_interop.transformSharedImageForVKRead(cb);
+    for (const VkRect2D& scissor : pass.scissors)
+    {
+        vkCmdSetScissor(cb, 0, 1, &scissor);
+        vkCmdDrawIndexed(cb, c_indexData.size(), 1, 0, 0, 0);
+    }
 
-    renderPassInfo.framebuffer = m_framebuffers[imageIndex];
+    if (m_overlayPipeline != VK_NULL_HANDLE)
+    {
+        // Hidden wherever GL's content is nearer than the overlay
+        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_overlayPipeline);
+        for (const VkRect2D& scissor : pass.scissors)
+        {
+            vkCmdSetScissor(cb, 0, 1, &scissor);
+            vkCmdDraw(cb, 6, 1, 0, 0);
+        }
+    }
+}
 
-    vkCmdBeginRenderPass(cb, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+bool VKRenderer::isPassthroughSupported(const Settings& settings) const
+{
+    VkFormatProperties sourceProperties{};
+    vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), c_passthroughSourceFormat, &sourceProperties);
+    VkFormatProperties destinationProperties{};
+    vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), c_surfaceFormat.format, &destinationProperties);
+
+    // Mapped readback makes the shared image linear, scaling blits filter linearly
+    const bool linear = settings.readback && settings.readbackMethod == ReadbackMethod::Mapped;
+    const VkFormatFeatureFlags sourceFeatures = linear ? sourceProperties.linearTilingFeatures : sourceProperties.optimalTilingFeatures;
+    const VkFormatFeatureFlags requiredSourceFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (sourceFeatures & requiredSourceFeatures) == requiredSourceFeatures &&
+           (destinationProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+}
 
-    vkCmdBindVertexBuffers(cb, 0, 1, &m_vertexBuffer, offsets);
-    vkCmdBindIndexBuffer(cb, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
-    vkCmdDrawIndexed(cb, c_indexData.size(), 1, 0, 0, 0);
+bool VKRenderer::isPassthrough(uint32_t output) const
+{
+    return m_passthrough && m_context.isSwapchainTransferDst(output);
+}
 
-    vkCmdEndRenderPass(cb);
+void VKRenderer::recordPassthrough(VkCommandBuffer cb, VkImage source, VkExtent2D sourceExtent, VkImage destination, VkExtent2D destinationExtent) const
+{
+    const VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    const bool sameExtent = sourceExtent.width == destinationExtent.width && sourceExtent.height == destinationExtent.height;
+    if (sameExtent && c_passthroughSourceFormat == c_surfaceFormat.format)
+    {
+        VkImageCopy region{};
+        region.srcSubresource = subresource;
+        region.dstSubresource = subresource;
+        region.extent = VkExtent3D{sourceExtent.width, sourceExtent.height, 1};
+        vkCmdCopyImage(cb, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        return;
+    }
 
-    m_interop.transformSharedImageForGLWrite(cb);
+    // The blit swaps RGBA to the surface's BGRA and scales the rendered part to the window
+    VkImageBlit region{};
+    region.srcSubresource = subresource;
+    region.srcOffsets[1] = VkOffset3D{int32_t(sourceExtent.width), int32_t(sourceExtent.height), 1};
+    region.dstSubresource = subresource;
+    region.dstOffsets[1] = VkOffset3D{int32_t(destinationExtent.width), int32_t(destinationExtent.height), 1};
+    vkCmdBlitImage(cb, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region,
+                   sameExtent ? VK_FILTER_NEAREST : VK_FILTER_LINEAR);
+}
 
-    VK_CHECK(vkEndCommandBuffer(cb));
+bool VKRenderer::wasFrameDrawn() const
+{
+    return m_frameDrawn;
+}
 
-    Context::WaitAndSignalInfo waitAndSignalInfo{};
-    waitAndSignalInfo.waitStages = {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
-    waitAndSignalInfo.waitSemaphores = {m_interop.getGLCompleteSemaphore()};
-    waitAndSignalInfo.signalSemaphores = {m_interop.getVKReadySemaphore()};
+void VKRenderer::printStatistics()
+{
+    if (m_skippedFrames > 0)
+    {
+        printf("Vulkan: %llu of %llu frames skipped without changes\n", static_cast<unsigned long long>(m_skippedFrames), static_cast<unsigned long long>(m_frames));
+    }
+    m_skippedFrames = 0;
+    m_frames = 0;
+    if (m_timedFrames > 0)
+    {
+        printf("Vulkan: %.3f ms GPU per frame\n", m_gpuMilliseconds / double(m_timedFrames));
+        m_gpuMilliseconds = 0.0;
+        m_timedFrames = 0;
+    }
+    if (m_drawnFrames > 0)
+    {
+        printf("Vulkan: %.3f ms CPU recording per frame", m_recordMilliseconds / double(m_drawnFrames));
+        if (m_recorder)
+        {
+            printf(", draws on %u threads", m_recorder->getThreadCount());
+        }
+        if (m_cacheCommandBuffers)
+        {
+            printf(", %llu of %llu command buffers reused", static_cast<unsigned long long>(m_reusedCommandBuffers),
+                   static_cast<unsigned long long>(m_drawnFrames));
+        }
+        printf("\n");
+        const uint64_t recordedFrames = m_drawnFrames - m_reusedCommandBuffers;
+        if (recordedFrames > 0)
+        {
+            printf("Vulkan: %.1f barriers per recorded frame, %llu passes culled\n", double(m_barriers) / double(recordedFrames),
+                   static_cast<unsigned long long>(m_culledPasses));
+        }
+        m_recordMilliseconds = 0.0;
+        m_drawnFrames = 0;
+        m_reusedCommandBuffers = 0;
+        m_barriers = 0;
+        m_culledPasses = 0;
+    }
+    if (m_windowPixels > 0)
+    {
+        printf("Vulkan: %.1f%% of the window redrawn\n", double(m_redrawnPixels) * 100.0 / double(m_windowPixels));
+        m_redrawnPixels = 0;
+        m_windowPixels = 0;
+    }
+    if (m_upscaler)
+    {
+        m_upscaler->printStatistics();
+    }
+}
 
-    m_context.submitCommandBuffers({cb}, waitAndSignalInfo);
+double VKRenderer::getGpuMilliseconds() const
+{
+    return m_lastGpuMilliseconds;
+}
 
-    return true;
+uint64_t VKRenderer::getGpuSampleCount() const
+{
+    return m_gpuSampleCount;
 }
 
-void VKRenderer::createRenderPass()
+void VKRenderer::createRenderPasses()
 {
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -153,7 +733,7 @@ void VKRenderer::createRenderPass()
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    subpass.pDepthStencilAttachment = m_depth ? &depthAttachmentRef : nullptr;
 
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = c_surfaceFormat.format;
@@ -165,16 +745,18 @@ void VKRenderer::createRenderPass()
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+    // Depth lives within the render pass, it is never loaded or stored and tile-based GPUs keep it on chip
     VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = c_depthFormat;
+    depthAttachment.format = m_depthFormat;
     depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    // Depth is cleared from an undefined layout every frame, so the previous frame's depth writes have to finish first
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
@@ -182,12 +764,19 @@ void VKRenderer::createRenderPass()
     dependency.srcAccessMask = 0;
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (m_depth)
+    {
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
 
     const std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
 
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = ui32Size(attachments);
+    renderPassInfo.attachmentCount = m_depth ? ui32Size(attachments) : 1;
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
@@ -195,6 +784,67 @@ void VKRenderer::createRenderPass()
     renderPassInfo.pDependencies = &dependency;
 
     VK_CHECK(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass));
+
+    // Partial redraws start from the presented image, which is read before the new tiles are written
+    std::array<VkAttachmentDescription, 2> loadAttachments = attachments;
+    loadAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    loadAttachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    renderPassInfo.pAttachments = loadAttachments.data();
+
+    VK_CHECK(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_loadRenderPass));
+}
+
+void VKRenderer::createSwapchainResources(uint32_t output)
+{
+    updateDepthImage();
+    createImageViews(output);
+    createFramebuffers(output);
+    m_outputs[output].swapchainGeneration = m_context.getSwapchainGeneration(output);
+    // The new images have no content yet
+    m_outputs[output].imageFrames.assign(m_context.getSwapchainImages(output).size(), 0);
+    m_outputs[output].damageHistory.clear();
+}
+
+void VKRenderer::updateDepthImage()
+{
+    // The outputs are drawn one after the other and clear depth from an undefined layout, they share one depth
+    // image as large as the largest of them. Passthrough outputs don't draw and need none.
+    VkExtent2D extent{};
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        if (!m_depth || isPassthrough(i))
+        {
+            continue;
+        }
+        extent.width = std::max(extent.width, m_context.getSwapchainExtent(i).width);
+        extent.height = std::max(extent.height, m_context.getSwapchainExtent(i).height);
+    }
+    if (extent.width == m_depthExtent.width && extent.height == m_depthExtent.height)
+    {
+        return;
+    }
+
+    if (m_depthImage != VK_NULL_HANDLE)
+    {
+        retireDepthImage();
+    }
+    m_depthExtent = extent;
+    if (extent.width > 0)
+    {
+        createDepthImage();
+    }
+
+    // Framebuffers of the other outputs still reference the old image
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        if (!m_outputs[i].framebuffers.empty())
+        {
+            retireFramebuffers(i);
+            createFramebuffers(i);
+        }
+    }
+    invalidateCommandBuffers();
 }
 
 void VKRenderer::createDepthImage()
@@ -202,15 +852,15 @@ void VKRenderer::createDepthImage()
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = c_windowWidth;
-    imageInfo.extent.height = c_windowHeight;
+    imageInfo.extent.width = m_depthExtent.width;
+    imageInfo.extent.height = m_depthExtent.height;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = 1;
     imageInfo.arrayLayers = 1;
-    imageInfo.format = c_depthFormat;
+    imageInfo.format = m_depthFormat;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.flags = 0;
@@ -220,7 +870,12 @@ void VKRenderer::createDepthImage()
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(m_device, m_depthImage, &memRequirements);
 
-    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    // Lazily allocated memory is only backed when the attachment leaves the tile memory, desktop GPUs have none
+    MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    if (!memoryTypeResult.found)
+    {
+        memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
     CHECK(memoryTypeResult.found);
 
     VkMemoryAllocateInfo allocInfo{};
@@ -231,36 +886,58 @@ void VKRenderer::createDepthImage()
     VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &m_depthImageMemory));
     VK_CHECK(vkBindImageMemory(m_device, m_depthImage, m_depthImageMemory, 0));
 
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = m_depthImage;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-    const VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    const VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    VkImageViewCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image = m_depthImage;
+    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format = m_depthFormat;
+    createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    createInfo.subresourceRange.baseMipLevel = 0;
+    createInfo.subresourceRange.levelCount = 1;
+    createInfo.subresourceRange.baseArrayLayer = 0;
+    createInfo.subresourceRange.layerCount = 1;
 
-    const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+    VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &m_depthImageView));
+}
 
-    vkCmdPipelineBarrier(command.commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+VkFormat VKRenderer::findDepthFormat() const
+{
+    for (VkFormat format : c_depthFormats)
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(m_context.getPhysicalDevice(), format, &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            return format;
+        }
+    }
+    // VK_FORMAT_D16_UNORM is required to support this
+    CHECK(false);
+    return VK_FORMAT_UNDEFINED;
+}
 
-    endSingleTimeCommands(m_context.getGraphicsQueue(), command, VK_NULL_HANDLE);
+void VKRenderer::retireDepthImage()
+{
+    VkDevice device = m_device;
+    VkImage depthImage = m_depthImage;
+    VkDeviceMemory depthImageMemory = m_depthImageMemory;
+    VkImageView depthImageView = m_depthImageView;
+    m_context.deferDestroy([device, depthImage, depthImageMemory, depthImageView]() {
+        vkDestroyImageView(device, depthImageView, nullptr);
+        vkDestroyImage(device, depthImage, nullptr);
+        vkFreeMemory(device, depthImageMemory, nullptr);
+    });
+    m_depthImage = VK_NULL_HANDLE;
+    m_depthImageMemory = VK_NULL_HANDLE;
+    m_depthImageView = VK_NULL_HANDLE;
 }
 
-void VKRenderer::createImageViews()
+void VKRenderer::createImageViews(uint32_t output)
 {
-    const std::vector<VkImage>& swapchainImages = m_context.getSwapchainImages();
+    Output& target = m_outputs[output];
+    const std::vector<VkImage>& swapchainImages = m_context.getSwapchainImages(output);
 
-    m_swapchainImageViews.resize(swapchainImages.size());
+    target.imageViews.resize(swapchainImages.size());
     for (size_t i = 0; i < swapchainImages.size(); ++i)
     {
         VkImageViewCreateInfo createInfo{};
@@ -278,41 +955,75 @@ void VKRenderer::createImageViews()
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
 
-        VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &m_swapchainImageViews[i]));
+        VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &target.imageViews[i]));
     }
-
-    VkImageViewCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    createInfo.image = m_depthImage;
-    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    createInfo.format = c_depthFormat;
-    createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    createInfo.subresourceRange.baseMipLevel = 0;
-    createInfo.subresourceRange.levelCount = 1;
-    createInfo.subresourceRange.baseArrayLayer = 0;
-    createInfo.subresourceRange.layerCount = 1;
-
-    VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &m_depthImageView));
 }
 
-void VKRenderer::createFramebuffers()
+void VKRenderer::createFramebuffers(uint32_t output)
 {
-    m_framebuffers.resize(m_swapchainImageViews.size());
+    Output& target = m_outputs[output];
+    if (isPassthrough(output))
+    {
+        return;
+    }
+    target.framebuffers.resize(target.imageViews.size());
 
     VkFramebufferCreateInfo framebufferInfo{};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     framebufferInfo.renderPass = m_renderPass;
-    framebufferInfo.width = c_windowWidth;
-    framebufferInfo.height = c_windowHeight;
+    framebufferInfo.width = m_context.getSwapchainExtent(output).width;
+    framebufferInfo.height = m_context.getSwapchainExtent(output).height;
     framebufferInfo.layers = 1;
 
-    for (size_t i = 0; i < m_swapchainImageViews.size(); ++i)
+    for (size_t i = 0; i < target.imageViews.size(); ++i)
     {
-        const std::array<VkImageView, 2> attachments = {m_swapchainImageViews[i], m_depthImageView};
-        framebufferInfo.attachmentCount = ui32Size(attachments);
+        // The shared depth image can be larger than the framebuffer
+        const std::array<VkImageView, 2> attachments = {target.imageViews[i], m_depthImageView};
+        framebufferInfo.attachmentCount = m_depth ? ui32Size(attachments) : 1;
         framebufferInfo.pAttachments = attachments.data();
 
-        VK_CHECK(vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_framebuffers[i]));
+        VK_CHECK(vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &target.framebuffers[i]));
+    }
+}
+
+void VKRenderer::retireSwapchainResources(uint32_t output)
+{
+    retireFramebuffers(output);
+
+    VkDevice device = m_device;
+    std::vector<VkImageView> imageViews = m_outputs[output].imageViews;
+    m_context.deferDestroy([device, imageViews]() {
+        for (VkImageView imageView : imageViews)
+        {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+    });
+}
+
+void VKRenderer::retireFramebuffers(uint32_t output)
+{
+    VkDevice device = m_device;
+    std::vector<VkFramebuffer> framebuffers = m_outputs[output].framebuffers;
+    m_context.deferDestroy([device, framebuffers]() {
+        for (VkFramebuffer framebuffer : framebuffers)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+    });
+    m_outputs[output].framebuffers.clear();
+}
+
+void VKRenderer::recreateSwapchainResources(uint32_t output)
+{
+    // Frames in flight still use the old attachments, the render pass and pipeline don't depend on the size
+    retireSwapchainResources(output);
+    createSwapchainResources(output);
+    invalidateCommandBuffers();
+
+    // The shared image follows the first output, the others scale it
+    if (output == 0 && m_interop.isResizable())
+    {
+        m_interop.requestResize(m_context.getSwapchainExtent(0));
     }
 }
 
@@ -320,7 +1031,7 @@ void VKRenderer::createDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -330,9 +1041,18 @@ void VKRenderer::createDescriptorSetLayout()
     samplerLayoutBinding.descriptorCount = 1;
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
+    // Samplers with a YCbCr conversion have to be immutable
+    const bool ycbcr = m_interop.getSharedImageYcbcrConversion() != VK_NULL_HANDLE;
+    samplerLayoutBinding.pImmutableSamplers = ycbcr ? &m_sampler : nullptr;
 
-    const std::vector<VkDescriptorSetLayoutBinding> bindings{uboLayoutBinding, samplerLayoutBinding};
+    std::vector<VkDescriptorSetLayoutBinding> bindings{uboLayoutBinding, samplerLayoutBinding};
+    if (m_sharedDepth)
+    {
+        VkDescriptorSetLayoutBinding depthLayoutBinding = samplerLayoutBinding;
+        depthLayoutBinding.binding = 2;
+        depthLayoutBinding.pImmutableSamplers = nullptr;
+        bindings.push_back(depthLayoutBinding);
+    }
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = ui32Size(bindings);
@@ -343,10 +1063,17 @@ void VKRenderer::createDescriptorSetLayout()
 
 void VKRenderer::createGraphicsPipeline()
 {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
     pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
 
@@ -378,24 +1105,19 @@ void VKRenderer::createGraphicsPipeline()
     inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssemblyState.primitiveRestartEnable = VK_FALSE;
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(c_windowExtent.width);
-    viewport.height = static_cast<float>(c_windowExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = c_windowExtent;
-
+    // Viewport and scissor follow the swapchain size, set while recording
     VkPipelineViewportStateCreateInfo viewportState{};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
+    viewportState.pViewports = nullptr;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+    viewportState.pScissors = nullptr;
+
+    const std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = ui32Size(dynamicStates);
+    dynamicState.pDynamicStates = dynamicStates.data();
 
     VkPipelineRasterizationStateCreateInfo rasterizationState{};
     rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -423,7 +1145,9 @@ void VKRenderer::createGraphicsPipeline()
     depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depthStencilState.depthTestEnable = VK_TRUE;
     depthStencilState.depthWriteEnable = VK_TRUE;
-    depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+    // The composition writes GL's depth wherever it draws, including the far plane. Writing gl_FragDepth rules
+    // out early depth tests anyway, and the composition covers every pixel once.
+    depthStencilState.depthCompareOp = m_sharedDepth ? VK_COMPARE_OP_ALWAYS : VK_COMPARE_OP_LESS;
     depthStencilState.depthBoundsTestEnable = VK_FALSE;
     depthStencilState.stencilTestEnable = VK_FALSE;
 
@@ -449,7 +1173,7 @@ void VKRenderer::createGraphicsPipeline()
     colorBlendState.blendConstants[3] = 0.0f;
 
     VkShaderModule vertexShaderModule = createShaderModule(m_device, "shaders/shader.vert.spv");
-    VkShaderModule fragmentShaderModule = createShaderModule(m_device, "shaders/shader.frag.spv");
+    VkShaderModule fragmentShaderModule = createShaderModule(m_device, m_sharedDepth ? "shaders/shader_depth.frag.spv" : "shaders/shader.frag.spv");
 
     VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
     vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -474,9 +1198,9 @@ void VKRenderer::createGraphicsPipeline()
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizationState;
     pipelineInfo.pMultisampleState = &multisampleState;
-    pipelineInfo.pDepthStencilState = &depthStencilState;
+    pipelineInfo.pDepthStencilState = m_depth ? &depthStencilState : nullptr;
     pipelineInfo.pColorBlendState = &colorBlendState;
-    pipelineInfo.pDynamicState = nullptr;
+    pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = m_pipelineLayout;
     pipelineInfo.renderPass = m_renderPass;
     pipelineInfo.subpass = 0;
@@ -489,6 +1213,27 @@ void VKRenderer::createGraphicsPipeline()
     {
         vkDestroyShaderModule(m_device, stage.module, nullptr);
     }
+
+    if (m_sharedDepth)
+    {
+        // The overlay's corners come from the vertex shader, it is tested against GL's depth without changing it
+        VkPipelineVertexInputStateCreateInfo overlayVertexInputState{};
+        overlayVertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencilState.depthWriteEnable = VK_FALSE;
+        rasterizationState.cullMode = VK_CULL_MODE_NONE;
+
+        shaderStages[0].module = createShaderModule(m_device, "shaders/overlay.vert.spv");
+        shaderStages[1].module = createShaderModule(m_device, "shaders/overlay.frag.spv");
+        pipelineInfo.pVertexInputState = &overlayVertexInputState;
+
+        VK_CHECK(vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_overlayPipeline));
+
+        for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
+        {
+            vkDestroyShaderModule(m_device, stage.module, nullptr);
+        }
+    }
 }
 
 void VKRenderer::createSampler()
@@ -499,42 +1244,78 @@ void VKRenderer::createSampler()
     samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerCreateInfo.maxLod = 1.0f;
     samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_sampler);
+
+    // NV12 shared image, filters have to match the conversion's chroma filter and addressing has to clamp
+    VkSamplerYcbcrConversionInfo conversionInfo{};
+    conversionInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO;
+    conversionInfo.conversion = m_interop.getSharedImageYcbcrConversion();
+    if (conversionInfo.conversion != VK_NULL_HANDLE)
+    {
+        samplerCreateInfo.pNext = &conversionInfo;
+        samplerCreateInfo.magFilter = m_interop.getSharedImageChromaFilter();
+        samplerCreateInfo.minFilter = m_interop.getSharedImageChromaFilter();
+        samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    }
+    VK_CHECK(vkCreateSampler(m_device, &samplerCreateInfo, nullptr, &m_sampler));
+
+    if (m_sharedDepth)
+    {
+        VkSamplerCreateInfo depthSamplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+        depthSamplerInfo.magFilter = VK_FILTER_NEAREST;
+        depthSamplerInfo.minFilter = VK_FILTER_NEAREST;
+        depthSamplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        depthSamplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        depthSamplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        depthSamplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        VK_CHECK(vkCreateSampler(m_device, &depthSamplerInfo, nullptr, &m_depthSampler));
+    }
 }
 
 void VKRenderer::createDescriptorPool()
 {
     std::array<VkDescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = 1;
+    const uint32_t setCount = m_context.getFrameCount();
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = setCount;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = 1;
+    // Implementations may use a descriptor per plane for multi-planar images
+    poolSizes[1].descriptorCount = setCount * (m_interop.getSharedImageFormat() == SharedImageFormat::Nv12 ? 2 : 1);
+    poolSizes[1].descriptorCount += m_sharedDepth ? setCount : 0;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = ui32Size(poolSizes);
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = 1;
+    poolInfo.maxSets = setCount;
 
     VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
 }
 
 void VKRenderer::createDescriptorSet()
 {
-    std::vector<VkDescriptorSetLayout> layouts{m_descriptorSetLayout};
+    std::vector<VkDescriptorSetLayout> layouts(m_context.getFrameCount(), m_descriptorSetLayout);
+    m_descriptorSets.resize(layouts.size());
+    m_descriptorSetGenerations.resize(layouts.size(), 0);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = m_descriptorPool;
     allocInfo.descriptorSetCount = ui32Size(layouts);
     allocInfo.pSetLayouts = layouts.data();
 
-    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet));
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, m_descriptorSets.data()));
 }
 
 void VKRenderer::createUniformBuffer()
 {
     const VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    const uint64_t bufferSize = sizeof(c_colorData);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_context.getPhysicalDevice(), &properties);
+    const VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_uniformStride = (sizeof(c_colorData) + alignment - 1) / alignment * alignment;
+    const VkDeviceSize bufferSize = m_uniformStride * m_context.getFrameCount() * m_outputs.size();
 
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -558,15 +1339,23 @@ void VKRenderer::createUniformBuffer()
     VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &m_uniformBufferMemory));
     VK_CHECK(vkBindBufferMemory(m_device, m_uniformBuffer, m_uniformBufferMemory, 0));
 
-    void* dst;
-    VK_CHECK(vkMapMemory(m_device, m_uniformBufferMemory, 0, bufferSize, 0, &dst));
-    std::memcpy(dst, c_colorData.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(m_device, m_uniformBufferMemory);
+    // Stays mapped, coherent writes need no flush and a frame slot's part is only written once its frame completed
+    void* data;
+    VK_CHECK(vkMapMemory(m_device, m_uniformBufferMemory, 0, bufferSize, 0, &data));
+    m_uniformData = static_cast<uint8_t*>(data);
 }
 
-void VKRenderer::updateDescriptorSet()
+uint32_t VKRenderer::pushDrawUniforms(uint32_t frameIndex)
 {
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    CHECK(m_uniformDraws < m_outputs.size());
+    const VkDeviceSize offset = (frameIndex * m_outputs.size() + m_uniformDraws++) * m_uniformStride;
+    std::memcpy(m_uniformData + offset, c_colorData.data(), sizeof(c_colorData));
+    return static_cast<uint32_t>(offset);
+}
+
+void VKRenderer::updateDescriptorSet(uint32_t index)
+{
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
 
     VkDescriptorBufferInfo bufferInfo{};
     bufferInfo.buffer = m_uniformBuffer;
@@ -574,27 +1363,41 @@ void VKRenderer::updateDescriptorSet()
     bufferInfo.range = sizeof(c_colorData);
 
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = m_descriptorSet;
+    descriptorWrites[0].dstSet = m_descriptorSets[index];
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pBufferInfo = &bufferInfo;
 
+    // The upscaled image follows the shared image, both change with its generation
     VkDescriptorImageInfo imageInfo{};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = m_interop.getSharedImageView();
+    imageInfo.imageLayout = m_upscaler ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : m_interop.getSharedImageReadLayout();
+    imageInfo.imageView = m_upscaler ? m_upscaler->getOutputView() : m_interop.getSharedImageView();
     imageInfo.sampler = m_sampler;
 
     descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = m_descriptorSet;
+    descriptorWrites[1].dstSet = m_descriptorSets[index];
     descriptorWrites[1].dstBinding = 1;
     descriptorWrites[1].dstArrayElement = 0;
     descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     descriptorWrites[1].descriptorCount = 1;
     descriptorWrites[1].pImageInfo = &imageInfo;
 
-    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+    // Replaced together with the shared image
+    VkDescriptorImageInfo depthInfo{};
+    depthInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthInfo.imageView = m_interop.getSharedDepthView();
+    depthInfo.sampler = m_depthSampler;
+
+    descriptorWrites[2] = descriptorWrites[1];
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].pImageInfo = &depthInfo;
+
+    vkUpdateDescriptorSets(m_device, m_sharedDepth ? 3 : 2, descriptorWrites.data(), 0, nullptr);
+    m_descriptorSetGenerations[index] = m_interop.getSharedImageGeneration();
+    // Updating a bound set invalidates the command buffers that use it
+    m_recordedCommands[index].valid = false;
 }
 
 void VKRenderer::createVertexAndIndexBuffer()
@@ -672,9 +1475,99 @@ void VKRenderer::createVertexAndIndexBuffer()
     releaseStagingBuffer(m_device, vertexStagingBuffer);
 }
 
+bool VKRenderer::isFrameNeeded() const
+{
+    // Nothing to show before GL's first frame
+    const uint64_t contentGeneration = m_interop.getContentGeneration();
+    if (contentGeneration == 0)
+    {
+        return false;
+    }
+    // The uniform buffer and geometry never change, the window and the upscaling can
+    const UpscaleFilter upscaleFilter = m_upscaler ? m_upscaler->getFilter() : UpscaleFilter::None;
+    return contentGeneration != m_drawnContentGeneration || m_interop.getRenderScale() != m_drawnRenderScale ||
+           upscaleFilter != m_drawnUpscaleFilter || m_context.isSwapchainOutOfDate();
+}
+
+VKRenderer::RecordedCommands VKRenderer::getRecordedCommands() const
+{
+    RecordedCommands recorded;
+    for (uint32_t i = 0; i < ui32Size(m_outputs); ++i)
+    {
+        recorded.imageIndices.push_back(m_context.getSwapchainImageIndex(i));
+    }
+    recorded.renderExtent = m_interop.getRenderExtent();
+    recorded.upscaleFilter = m_upscaler ? m_upscaler->getFilter() : UpscaleFilter::None;
+    return recorded;
+}
+
+bool VKRenderer::canReuseCommandBuffer(uint32_t frameIndex) const
+{
+    const RecordedCommands& recorded = m_recordedCommands[frameIndex];
+    if (!recorded.valid || !m_interop.canReuseSharedImageBarriers())
+    {
+        return false;
+    }
+    // The framebuffers follow the acquired images, the push constants and upscale dispatch the render extent
+    const RecordedCommands current = getRecordedCommands();
+    return recorded.imageIndices == current.imageIndices && recorded.renderExtent.width == current.renderExtent.width &&
+           recorded.renderExtent.height == current.renderExtent.height && recorded.upscaleFilter == current.upscaleFilter;
+}
+
+void VKRenderer::invalidateCommandBuffers()
+{
+    for (RecordedCommands& recorded : m_recordedCommands)
+    {
+        recorded.valid = false;
+    }
+}
+
+bool VKRenderer::getRedrawTiles(uint32_t output, std::vector<VkRect2D>& tiles)
+{
+    Output& target = m_outputs[output];
+    const VkExtent2D extent = m_context.getSwapchainExtent(output);
+    std::vector<VkRect2D> damage;
+    for (const VkRect2D& rect : m_interop.getDamage())
+    {
+        VkRect2D windowRect;
+        if (mapDamageToWindow(rect, m_interop.getSharedImageExtent(), extent, windowRect))
+        {
+            damage.push_back(windowRect);
+        }
+    }
+
+    // The presentation engine wants what changed since the previous present, a new swapchain changed everything.
+    // No regions count as a full update, frames without damage are still presented whole.
+    m_context.setPresentRegions(output, target.damageHistory.empty() ? std::vector<VkRect2D>{} : damage);
+    target.damageHistory.push_back(std::move(damage));
+    if (target.damageHistory.size() > target.imageFrames.size())
+    {
+        target.damageHistory.pop_front();
+    }
+
+    // The image still holds the frame it was last drawn in, everything damaged since has to be drawn again. Images
+    // that were never drawn, or missed more frames than are remembered, are drawn completely.
+    const uint32_t imageIndex = m_context.getSwapchainImageIndex(output);
+    const uint64_t lastFrame = target.imageFrames[imageIndex];
+    target.imageFrames[imageIndex] = m_frame;
+    const uint64_t age = m_frame - lastFrame;
+    if (lastFrame == 0 || age > target.damageHistory.size())
+    {
+        return false;
+    }
+
+    std::vector<VkRect2D> rects;
+    for (size_t i = target.damageHistory.size() - size_t(age); i < target.damageHistory.size(); ++i)
+    {
+        rects.insert(rects.end(), target.damageHistory[i].begin(), target.damageHistory[i].end());
+    }
+    tiles = getDamageTiles(rects, extent);
+    return true;
+}
+
 void VKRenderer::allocateCommandBuffers()
 {
-    m_commandBuffers.resize(m_framebuffers.size());
+    m_commandBuffers.resize(m_context.getFrameCount());
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1,53 +1,177 @@
 #pragma once
 
+#include "CommandRecorder.hpp"
 #include "Context.hpp"
+#include "GpuTimer.hpp"
 #include "Interop.hpp"
+#include "Readback.hpp"
+#include "Settings.hpp"
+#include "Upscaler.hpp"
+#include <deque>
 #include <vector>
+#include <memory>
 
 class VKRenderer final
 {
 public:
-    VKRenderer(Context& context, Interop& interop);
+    VKRenderer(Context& context, Interop& interop, const Settings& settings);
     ~VKRenderer();
 
+    // Frames are skipped while neither the shared image content nor anything else they are composed from changed
     bool render();
+    bool wasFrameDrawn() const;
+    void printStatistics();
+    // Newest measured GPU time of a frame, a few frames old, 0 until the first one is available
+    double getGpuMilliseconds() const;
+    // Grows with every measured frame, getGpuMilliseconds() only has a new value when this changed
+    uint64_t getGpuSampleCount() const;
 
 private:
-    void createRenderPass();
+    // Swapchain dependent resources of one output
+    struct Output
+    {
+        uint64_t swapchainGeneration = 0;
+        std::vector<VkImageView> imageViews;
+        std::vector<VkFramebuffer> framebuffers;
+        // Damage tracking, the frame each swapchain image was last drawn in, 0 while its content is undefined
+        std::vector<uint64_t> imageFrames;
+        // Window damage of the most recent frames, newest last
+        std::deque<std::vector<VkRect2D>> damageHistory;
+    };
+
+    // What a frame slot's command buffer was recorded for, it's submitted again while all of it still matches
+    struct RecordedCommands
+    {
+        bool valid = false;
+        std::vector<uint32_t> imageIndices;
+        VkExtent2D renderExtent{};
+        UpscaleFilter upscaleFilter = UpscaleFilter::None;
+        // Where the frame first accesses the shared image, the wait for GL is placed there
+        VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    };
+
+    // How one output is drawn this frame
+    struct OutputPass
+    {
+        VkExtent2D extent;
+        VkFramebuffer framebuffer;
+        VkRenderPass renderPass;
+        VkRect2D renderArea;
+        // Copied from the shared image without a render pass
+        bool passthrough;
+        bool partialRedraw;
+        // Dynamic offset of the draw's uniforms in the ring
+        uint32_t uniformOffset;
+        std::vector<VkRect2D> redrawTiles;
+        // Nothing is drawn without any
+        std::vector<VkRect2D> scissors;
+    };
+
+    void createRenderPasses();
+    void createSwapchainResources(uint32_t output);
+    // Recreates the depth image shared by the outputs when the largest of them changed size
+    void updateDepthImage();
     void createDepthImage();
-    void createImageViews();
-    void createFramebuffers();
+    VkFormat findDepthFormat() const;
+    void retireDepthImage();
+    void createImageViews(uint32_t output);
+    void createFramebuffers(uint32_t output);
+    void retireSwapchainResources(uint32_t output);
+    void retireFramebuffers(uint32_t output);
+    void recreateSwapchainResources(uint32_t output);
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
     void createSampler();
     void createDescriptorPool();
     void createDescriptorSet();
     void createUniformBuffer();
-    void updateDescriptorSet();
+    void updateDescriptorSet(uint32_t index);
+    // Writes the uniforms of the next draw of the frame and returns their dynamic offset
+    uint32_t pushDrawUniforms(uint32_t frameIndex);
     void createVertexAndIndexBuffer();
     void allocateCommandBuffers();
+    bool isFrameNeeded() const;
+    RecordedCommands getRecordedCommands() const;
+    bool canReuseCommandBuffer(uint32_t frameIndex) const;
+    void invalidateCommandBuffers();
+    void recordCommandBuffer(VkCommandBuffer cb, uint32_t frameIndex, VkPipelineStageFlagBits sharedImageStage);
+    // Decides what of the output's acquired image is drawn again, on the main thread
+    OutputPass getOutputPass(uint32_t output);
+    // Runs the output's render pass with the draws recorded inline, or executes them when already recorded
+    void recordOutput(VkCommandBuffer cb, uint32_t frameIndex, const OutputPass& pass, VkCommandBuffer draws);
+    // Draws the shared content inside the render pass, safe to call from the recording threads
+    void recordOutputDraws(VkCommandBuffer cb, uint32_t frameIndex, const OutputPass& pass) const;
+    bool isPassthroughSupported(const Settings& settings) const;
+    bool isPassthrough(uint32_t output) const;
+    // Copies or blits the shared content into the output's swapchain image, both in transfer layouts
+    void recordPassthrough(VkCommandBuffer cb, VkImage source, VkExtent2D sourceExtent, VkImage destination, VkExtent2D destinationExtent) const;
+    // Returns false when the whole window has to be drawn
+    bool getRedrawTiles(uint32_t output, std::vector<VkRect2D>& tiles);
 
     Context& m_context;
     Interop& m_interop;
     VkDevice m_device;
+    GpuTimer m_frameTimer;
+    double m_lastGpuMilliseconds = 0.0;
+    uint64_t m_gpuSampleCount = 0;
+    double m_gpuMilliseconds = 0.0;
+    uint64_t m_timedFrames = 0;
+    bool m_idle;
+    bool m_frameDrawn = false;
+    uint64_t m_drawnContentGeneration = 0;
+    float m_drawnRenderScale = 0.0f;
+    UpscaleFilter m_drawnUpscaleFilter = UpscaleFilter::None;
+    uint64_t m_skippedFrames = 0;
+    uint64_t m_frames = 0;
+    // Number of the frame being recorded, counts drawn frames only
+    uint64_t m_frame = 0;
+    uint64_t m_redrawnPixels = 0;
+    uint64_t m_windowPixels = 0;
+    bool m_cacheCommandBuffers;
+    bool m_passthrough;
+    bool m_depth;
+    // The composition samples GL's depth and writes it to the depth attachment
+    bool m_sharedDepth;
+    double m_recordMilliseconds = 0.0;
+    uint64_t m_drawnFrames = 0;
+    uint64_t m_reusedCommandBuffers = 0;
+    uint64_t m_barriers = 0;
+    uint64_t m_culledPasses = 0;
 
     VkRenderPass m_renderPass;
-    VkImage m_depthImage;
-    VkDeviceMemory m_depthImageMemory;
-    std::vector<VkImageView> m_swapchainImageViews;
-    VkImageView m_depthImageView;
-    std::vector<VkFramebuffer> m_framebuffers;
+    // Same attachments, keeps the previous content of the swapchain image for partial redraws
+    VkRenderPass m_loadRenderPass;
+    std::vector<Output> m_outputs;
+    VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D m_depthExtent{};
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_depthImageMemory = VK_NULL_HANDLE;
+    VkImageView m_depthImageView = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_descriptorSetLayout;
     VkPipelineLayout m_pipelineLayout;
     VkPipeline m_graphicsPipeline;
+    // Vulkan content depth-tested against GL's shared depth, drawn after the composition
+    VkPipeline m_overlayPipeline = VK_NULL_HANDLE;
     VkSampler m_sampler;
+    // Depth formats often can't be filtered
+    VkSampler m_depthSampler = VK_NULL_HANDLE;
     VkDescriptorPool m_descriptorPool;
-    VkDescriptorSet m_descriptorSet;
+    // One per frame slot so a set is only rewritten once the frame that used it has completed
+    std::vector<VkDescriptorSet> m_descriptorSets;
+    std::vector<uint64_t> m_descriptorSetGenerations;
+    // Persistently mapped ring, every frame slot has room for one draw per output at aligned offsets
     VkBuffer m_uniformBuffer;
     VkDeviceMemory m_uniformBufferMemory;
+    uint8_t* m_uniformData = nullptr;
+    VkDeviceSize m_uniformStride = 0;
+    uint32_t m_uniformDraws = 0;
     VkBuffer m_vertexBuffer;
     VkDeviceMemory m_vertexBufferMemory;
     VkBuffer m_indexBuffer;
     VkDeviceMemory m_indexBufferMemory;
     std::vector<VkCommandBuffer> m_commandBuffers;
+    std::vector<RecordedCommands> m_recordedCommands;
+    std::unique_ptr<Readback> m_readback;
+    std::unique_ptr<Upscaler> m_upscaler;
+    std::unique_ptr<CommandRecorder> m_recorder;
 };
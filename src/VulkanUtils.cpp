@@ -48,9 +48,16 @@ void printPhysicalDeviceName(VkPhysicalDeviceProperties properties)
     printf("Device name: %s\n", properties.deviceName);
 }
 
-std::vector<const char*> getRequiredInstanceExtensions()
+std::vector<const char*> getRequiredInstanceExtensions(bool headless)
 {
     std::vector<const char*> extensions;
+    if (headless)
+    {
+        extensions = c_headlessInstanceExtensions;
+        extensions.insert(extensions.end(), c_instanceExtensions.begin(), c_instanceExtensions.end());
+        return extensions;
+    }
+
     unsigned int glfwExtensionCount = 0;
     const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
@@ -121,6 +128,30 @@ bool hasDeviceExtensionSupport(VkPhysicalDevice physicalDevice)
     return requiredExtensions.empty();
 }
 
+std::vector<const char*> getAvailableDeviceExtensions(VkPhysicalDevice physicalDevice, const std::vector<const char*>& extensions)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    std::set<std::string> availableNames;
+    for (const auto& extension : availableExtensions)
+    {
+        availableNames.insert(extension.extensionName);
+    }
+
+    std::vector<const char*> found;
+    for (const char* extension : extensions)
+    {
+        if (availableNames.count(extension))
+        {
+            found.push_back(extension);
+        }
+    }
+    return found;
+}
+
 SwapchainCapabilities getSwapchainCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
 {
     SwapchainCapabilities capabilities;
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "Utils.hpp"
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <vulkan/vulkan.h>
+#ifdef _WIN32
 #include <vulkan/vulkan_win32.h>
+#endif
 #include <vector>
 #include <cstdint>
 #include <cassert>
@@ -18,17 +22,66 @@ const std::vector<const char*> c_instanceExtensions = {
     VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME //
 };
 
+// Replace the window system extensions GLFW asks for when presenting without a display
+const std::vector<const char*> c_headlessInstanceExtensions = {
+    VK_KHR_SURFACE_EXTENSION_NAME, //
+    VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME //
+};
+
 const std::vector<const char*> c_deviceExtensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME, //
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME //
+};
+
+// Enabled when available, without them the shared image is transferred through host memory
+const std::vector<const char*> c_interopDeviceExtensions = {
     VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME, //
-    VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME, //
     VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME, //
+#ifdef _WIN32
+    VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME, //
     VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME //
+#else
+    VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, //
+    VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME //
+#endif
+};
+
+// Enabled when available, lets the presentation engine update only the changed parts of the window
+const std::vector<const char*> c_presentDeviceExtensions = {
+    VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME //
 };
 
-const VkExtent2D c_windowExtent{c_windowWidth, c_windowHeight};
+// Enabled together for the low latency mode when the present id and present wait features are available
+const std::vector<const char*> c_presentWaitDeviceExtensions = {
+    VK_KHR_PRESENT_ID_EXTENSION_NAME, //
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME //
+};
+
+// Enabled for --sync2 when the synchronization2 feature is available
+const std::vector<const char*> c_synchronization2DeviceExtensions = {
+    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME //
+};
+
+// Enabled together when the sampler YCbCr conversion feature is available
+const std::vector<const char*> c_ycbcrDeviceExtensions = {
+    VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME, //
+    VK_KHR_MAINTENANCE1_EXTENSION_NAME, //
+    VK_KHR_BIND_MEMORY_2_EXTENSION_NAME, //
+    VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME //
+};
+
+#ifdef _WIN32
+using ExternalHandle = HANDLE;
+const ExternalHandle c_invalidExternalHandle = nullptr;
+const VkExternalMemoryHandleTypeFlagBits c_externalMemoryHandleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+const VkExternalSemaphoreHandleTypeFlagBits c_externalSemaphoreHandleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+#else
+using ExternalHandle = int;
+const ExternalHandle c_invalidExternalHandle = -1;
+const VkExternalMemoryHandleTypeFlagBits c_externalMemoryHandleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+const VkExternalSemaphoreHandleTypeFlagBits c_externalSemaphoreHandleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+#endif
+
 const VkSurfaceFormatKHR c_surfaceFormat{VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
-const VkFormat c_depthFormat = VK_FORMAT_D24_UNORM_S8_UINT;
 
 #define VK_CHECK(f)                                                                             \
     do                                                                                          \
@@ -78,10 +131,11 @@ void printInstanceLayers();
 void printInstanceExtensions();
 void printDeviceExtensions(VkPhysicalDevice physicalDevice);
 void printPhysicalDeviceName(VkPhysicalDeviceProperties properties);
-std::vector<const char*> getRequiredInstanceExtensions();
+std::vector<const char*> getRequiredInstanceExtensions(bool headless);
 bool hasAllQueueFamilies(const QueueFamilyIndices& indices);
 QueueFamilyIndices getQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 bool hasDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
+std::vector<const char*> getAvailableDeviceExtensions(VkPhysicalDevice physicalDevice, const std::vector<const char*>& extensions);
 SwapchainCapabilities getSwapchainCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 bool areSwapchainCapabilitiesAdequate(const SwapchainCapabilities& capabilities);
 bool isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
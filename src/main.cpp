@@ -2,28 +2,157 @@
 #include "Interop.hpp"
 #include "VKRenderer.hpp"
 #include "GLRenderer.hpp"
+#include "RemoteInterop.hpp"
+#include "ResolutionController.hpp"
+#include "Settings.hpp"
+#include "PixelConversion.hpp"
 #include "Utils.hpp"
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
-int main(void)
+namespace
 {
-    const int glfwInitialized = glfwInit();
-    CHECK(glfwInitialized == GLFW_TRUE);
+const double c_statisticsInterval = 5.0;
 
-    Context context;
-    Interop interop(context);
-    VKRenderer vkRenderer(context, interop);
-    GLRenderer glRenderer(interop);
+// GL side of a consumer process, renders a frame whenever the consumer asks for one
+void runProducer(const Settings& settings)
+{
+    // The consumer sizes the shared image without knowing about the source
+    CHECK(settings.source.empty());
+    const bool windowSystem = !settings.surfacelessGL || settings.glMirror;
+    if (windowSystem)
+    {
+        const int glfwInitialized = glfwInit();
+        CHECK(glfwInitialized == GLFW_TRUE);
+    }
+
+    {
+        RemoteInterop interop(settings.ipcSocket);
+        GLRenderer glRenderer(interop, settings, windowSystem);
+
+        Timer statisticsTimer;
+        bool toggleAnimation = false;
+        while (interop.receiveRender(toggleAnimation))
+        {
+            if (toggleAnimation)
+            {
+                glRenderer.toggleAnimation();
+            }
+            const bool running = glRenderer.render();
+            interop.sendRendered(running, glRenderer.getGpuMilliseconds(), glRenderer.getGpuSampleCount());
+
+            const double elapsed = statisticsTimer.elapsedSeconds();
+            if (elapsed >= c_statisticsInterval)
+            {
+                glRenderer.printStatistics(elapsed);
+                statisticsTimer.reset();
+            }
+        }
+    }
 
+    if (windowSystem)
+    {
+        glfwTerminate();
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const Settings settings = parseSettings(argc, argv);
+
+    if (settings.benchmarkPixelConversion)
+    {
+        runPixelConversionBenchmark();
+        return 0;
+    }
+    if (settings.ipcRole == IpcRole::Producer)
+    {
+        runProducer(settings);
+        return 0;
+    }
+
+    // Headless with a surfaceless GL context or GL in another process needs no display at all
+    const bool windowSystem = !settings.headless || (settings.ipcRole == IpcRole::None && !settings.surfacelessGL);
+    if (windowSystem)
+    {
+        const int glfwInitialized = glfwInit();
+        CHECK(glfwInitialized == GLFW_TRUE);
+    }
+
+    Context context(settings);
+    Interop interop(context, settings);
+    VKRenderer vkRenderer(context, interop, settings);
+    std::unique_ptr<FrameProducer> producer;
+    if (settings.ipcRole == IpcRole::Consumer)
+    {
+        producer = std::make_unique<RemoteProducer>(interop, settings.ipcSocket);
+    }
+    else
+    {
+        producer = std::make_unique<GLRenderer>(interop, settings, windowSystem);
+    }
+    context.addKeyHandler([&producer](int key) {
+        if (key == GLFW_KEY_P)
+        {
+            producer->toggleAnimation();
+        }
+    });
+    std::unique_ptr<ResolutionController> resolutionController;
+    if (settings.targetFrameMilliseconds > 0.0)
+    {
+        resolutionController = std::make_unique<ResolutionController>(interop, settings);
+    }
+
+    Timer statisticsTimer;
+    uint64_t frames = 0;
+    uint64_t totalFrames = 0;
+    uint64_t glSampleCount = 0;
+    uint64_t vkSampleCount = 0;
     bool running = true;
     while (running)
     {
-        running = glRenderer.render() && vkRenderer.render();
+        running = producer->render() && vkRenderer.render();
+        if (vkRenderer.wasFrameDrawn())
+        {
+            // Only new measurements of both APIs, a repeated one would count the same frame again
+            if (resolutionController && producer->getGpuSampleCount() != glSampleCount &&
+                vkRenderer.getGpuSampleCount() != vkSampleCount)
+            {
+                glSampleCount = producer->getGpuSampleCount();
+                vkSampleCount = vkRenderer.getGpuSampleCount();
+                resolutionController->update(producer->getGpuMilliseconds(), vkRenderer.getGpuMilliseconds());
+            }
+            ++frames;
+            ++totalFrames;
+        }
+        if (settings.frameLimit > 0 && totalFrames >= settings.frameLimit)
+        {
+            running = false;
+        }
+
+        // A limited run also reports the frames since the last interval
+        const double elapsed = statisticsTimer.elapsedSeconds();
+        if (elapsed >= c_statisticsInterval || (!running && frames > 0))
+        {
+            interop.printStatistics(elapsed, frames);
+            producer->printStatistics(elapsed);
+            vkRenderer.printStatistics();
+            context.printStatistics();
+            if (resolutionController)
+            {
+                resolutionController->printStatistics();
+            }
+            statisticsTimer.reset();
+            frames = 0;
+        }
     }
 
-    glfwTerminate();
+    if (windowSystem)
+    {
+        glfwTerminate();
+    }
 
     return 0;
 }
\ No newline at end of file